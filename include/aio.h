@@ -0,0 +1,107 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "dfs.h"
+
+// asynchronous client interface on a pair of rings. The client fills
+// submission entries and publishes a batch of them with one aio_submit, a
+// worker thread drains them against the cluster in submission order and posts
+// one completion per entry with its result and the caller's tag. Each posted
+// batch bumps an eventfd, so the client can block on it in aio_wait_cqe or
+// hand aio_event_fd to poll/epoll beside its other descriptors
+
+#define AIO_MAX_ENTRIES 4096
+
+typedef enum {
+    AIO_NOP = 0,
+    AIO_CREATE,
+    AIO_OPEN,
+    AIO_READ,
+    AIO_WRITE,
+    AIO_CLOSE
+} aio_op_t;
+
+typedef struct {
+    int op;
+    char name[FILE_NAME_MAX + 1];  // create and open
+    int handle;       // from a completed AIO_OPEN
+    int node;         // node serving a read, -1 for the file's leader
+    void* buf;        // must stay valid until the entry completes
+    int len;
+    int offset;
+    uint64_t user_data;
+} aio_sqe_t;
+
+typedef struct {
+    uint64_t user_data;
+    int result;       // what the synchronous call returns: bytes, a handle, 0 or -1
+} aio_cqe_t;
+
+typedef struct {
+    dfs_t* dfs;
+
+    // indices run freely and are masked on use; the rings are powers of two
+    aio_sqe_t* sqes;
+    unsigned sq_mask;
+    unsigned sq_head;   // next entry the worker takes
+    unsigned sq_tail;   // end of what the client has published
+    unsigned sq_fill;   // end of what the client has filled
+
+    // twice the submission ring, so a full batch can complete while the client
+    // is still reaping the previous one
+    aio_cqe_t* cqes;
+    unsigned cq_mask;
+    unsigned cq_head;   // next completion the client reads
+    unsigned cq_tail;   // end of what the worker has posted
+
+    int event_fd;
+    pthread_t worker;
+    pthread_mutex_t wake_lock;
+    pthread_cond_t wake;
+    int idle;           // why the worker sleeps, 0 while it runs
+    int stop;
+
+    long submitted;
+    long completed;
+    long batches;       // times the worker took dfs->lock
+} aio_t;
+
+// entries rounds up to a power of two, at most AIO_MAX_ENTRIES
+int aio_setup(aio_t* aio, dfs_t* dfs, int entries);
+
+// stops the worker after its current batch, entries still queued are dropped
+void aio_teardown(aio_t* aio);
+
+// next free submission entry, NULL while the ring is full
+aio_sqe_t* aio_get_sqe(aio_t* aio);
+
+void aio_prep_create(aio_sqe_t* sqe, const char* name, uint64_t user_data);
+
+void aio_prep_open(aio_sqe_t* sqe, const char* name, uint64_t user_data);
+
+void aio_prep_read(aio_sqe_t* sqe, int handle, void* buf, int len, int offset, uint64_t user_data);
+
+void aio_prep_write(aio_sqe_t* sqe, int handle, const void* buf, int len, int offset, uint64_t user_data);
+
+void aio_prep_close(aio_sqe_t* sqe, int handle, uint64_t user_data);
+
+// publishes every entry filled since the last call, returns how many
+int aio_submit(aio_t* aio);
+
+// 0 and the oldest unseen completion if there is one, -1 otherwise
+int aio_peek_cqe(aio_t* aio, aio_cqe_t* cqe);
+
+// as aio_peek_cqe, sleeping on the eventfd until a completion arrives
+int aio_wait_cqe(aio_t* aio, aio_cqe_t* cqe);
+
+// releases the completion last returned by peek or wait
+void aio_cqe_seen(aio_t* aio);
+
+// readable while completions may be waiting
+int aio_event_fd(aio_t* aio);
+
+void aio_stats(aio_t* aio);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef APPLY_H
+#define APPLY_H
+
+#include <pthread.h>
+#include "wal.h"
+
+// parallel apply of taken entries. Every node stages each operation through
+// its own descriptor and bitmap buffers, open file table and block cache, so
+// an entry's read and write set is the nodes it is applied on: two entries
+// conflict where those overlap and keep their order there, and run side by
+// side everywhere else. Each node has a lane its copies queue on in sequence
+// order and a pool of workers serves the lanes, one worker per lane at a
+// time. The first node's copy still decides the entry's result, so a refused
+// entry never reaches a follower; the thread holding dfs->lock applies it
+// itself when that node's lane is idle
+
+#define APPLY_MAX_WORKERS 8
+#define APPLY_WINDOW 32  // entries in flight before the oldest must finish
+
+typedef enum {
+    COPY_FIRST,     // decides the entry's result
+    COPY_FOLLOWER,
+    COPY_SKIP       // node outside the entry's shard, only its sequence moves on
+} apply_copy_t;
+
+typedef struct {
+    wal_entry_t local;  // the entry as the lane's node sees it
+    int slot;           // entry in flight it belongs to
+    apply_copy_t copy;
+} apply_task_t;
+
+typedef struct {
+    apply_task_t tasks[APPLY_WINDOW];
+    int head;
+    int count;
+    int busy;  // a worker is applying the head task
+} apply_lane_t;
+
+typedef struct {
+    wal_entry_t entry;    // as taken, committed once every copy is in
+    int result;           // the first copy's
+    int in_place;         // and whether it took, freed or laid out no block
+    int refused[MAX_NODES];  // followers whose copy failed
+} apply_slot_t;
+
+struct applier_s {
+    dfs_t* dfs;
+    pthread_mutex_t lock;
+    pthread_cond_t work;  // a lane has a task no worker holds
+    pthread_cond_t done;  // a task finished
+    int stop;
+
+    pthread_t threads[APPLY_MAX_WORKERS];
+    int workers;
+
+    apply_lane_t lanes[MAX_NODES];
+    int queued;   // tasks on every lane, the one being applied included
+    int active;   // copies being applied
+
+    apply_slot_t slots[APPLY_WINDOW];
+    int oldest;   // slot of the oldest entry in flight
+    int in_flight;
+
+    long inline_copies;  // applied by the dfs->lock holder
+    long worker_copies;  // applied by a worker
+    long overlapped;     // worker copies that ran alongside another copy
+    long first_waits;    // first copies that queued behind a busy lane
+    long flushes;
+};
+
+// logs nothing: entry is already in the logs. Applies its first copy,
+// queues the rest and commits entries whose copies are all in as the window
+// fills or a checkpoint comes due; caller holds dfs->lock
+void apply_dispatch(dfs_t* dfs, wal_entry_t* entry);
+
+// waits for every copy in flight and commits their entries in sequence
+// order, leaving each result in the append queue
+void apply_flush(dfs_t* dfs);
+
+#endif
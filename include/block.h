@@ -0,0 +1,64 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdio.h>
+#include "fs.h"
+
+#define CACHE_SLOTS 64
+// a full window pinned for each open file and room for the blocks an
+// operation pins beside them
+#define CACHE_MIN_SLOTS (3 * OFT_WINDOW + 2)
+
+// every access to a node's volume goes through here. An in-memory volume hands
+// out its blocks directly; a disk-backed volume serves them from a bounded
+// cache in front of a storage file, evicting with CLOCK and writing dirty
+// blocks back on eviction or block_sync; a tiered volume (tier.h) keeps the
+// blocks in use in memory and the rest in a cold file
+
+typedef struct {
+    byte data[BLOCK_SIZE];
+    int block;      // -1 if empty
+    int pins;
+    int dirty;
+    int referenced; // CLOCK second-chance bit
+} cache_slot_t;
+
+struct block_cache_s {
+    FILE * file;
+    int n_slots;
+    int hand;
+    int map[N_BLOCKS]; // block -> slot, -1 if not cached
+    cache_slot_t * slots;
+
+    long hits;
+    long misses;
+    long evictions;
+    long writebacks;
+};
+
+int block_open_memory(fs_node_t* fs);
+
+int block_open_file(fs_node_t* fs, const char* path, int n_slots);
+
+void block_close(fs_node_t* fs);
+
+// pointer stays valid until the matching unpin; dirty marks the block modified
+byte * block_pin(fs_node_t* fs, int block);
+
+void block_unpin(fs_node_t* fs, int block, int dirty);
+
+int block_read(fs_node_t* fs, int block, byte* dst);
+
+int block_write(fs_node_t* fs, int block, const byte* src);
+
+int block_zero(fs_node_t* fs, int block);
+
+int block_scrub(fs_node_t* fs, int block, byte* out);
+
+int block_repair(fs_node_t* fs, int block, const byte* data);
+
+int block_sync(fs_node_t* fs);
+
+void block_stats(fs_node_t* fs);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include "fs.h"
+
+// optional CRC32C per block. The block layer stores a block's sum when its last
+// writer unpins it and checks it the first time the block is read after it was
+// loaded or changed, so a corrupt block is refused instead of served. Sums live
+// in memory beside the volume and are taken over from its contents on enable
+
+#define SUM_KNOWN   0x1  // crc matches what was last written
+#define SUM_CHECKED 0x2  // contents verified since they were last loaded
+#define SUM_STALE   0x4  // written under a pin, crc due at the last unpin
+
+struct checksum_s {
+    uint32_t crc[N_BLOCKS];
+    byte state[N_BLOCKS];
+    unsigned short pins[N_BLOCKS];  // in-memory volumes, the cache counts its own
+
+    long verified;
+    long mismatches;
+    long repaired;
+};
+
+// SSE4.2 crc32 instruction when the CPU has it, slicing-by-8 tables otherwise
+uint32_t crc32c(uint32_t crc, const void* data, int len);
+
+const char* crc32c_impl(void);
+
+int checksum_enable(fs_node_t* fs);
+
+void checksum_disable(fs_node_t* fs);
+
+// 0 when data matches or nothing is known about the block, -1 on a mismatch
+int checksum_verify(fs_node_t* fs, int block, const byte* data);
+
+// contents were just read from storage and must be checked again
+int checksum_loaded(fs_node_t* fs, int block, const byte* data);
+
+// a writer let go of the block, pins_left others still hold it
+void checksum_unpinned(fs_node_t* fs, int block, const byte* data, int pins_left, int dirty);
+
+void checksum_update(fs_node_t* fs, int block, const byte* data);
+
+void checksum_forget(fs_node_t* fs, int block);
+
+void checksum_stats(fs_node_t* fs);
+
+#endif
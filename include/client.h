@@ -0,0 +1,44 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "dfs.h"
+
+// client-side file cache on top of the cluster's read leases. A miss reads
+// the whole file from the node serving it and keeps it for as long as the
+// lease holds; repeat reads of a leased file never reach a node. Like the
+// rest of the client calls, these run under dfs->lock, which also orders
+// revocations against reads
+
+#define CLIENT_FILES 8
+
+typedef struct {
+    char name[FILE_NAME_MAX + 1];  // empty for a free entry
+    byte* data;
+    int size;
+    long expires;   // lease end, lease_now() time
+    long last_use;
+} client_file_t;
+
+struct client_s {
+    dfs_t* dfs;
+    int id;         // in dfs->leases
+    client_file_t files[CLIENT_FILES];
+    long tick;
+
+    long hits;
+    long misses;
+    long revocations;
+};
+
+int client_setup(client_t* client, dfs_t* dfs);
+
+// drops the cache and the client's leases
+void client_teardown(client_t* client);
+
+// up to n bytes of name from offset, from the cache while the file's lease
+// holds and from the cluster otherwise; caller holds dfs->lock
+int client_read(client_t* client, const char* name, void* buf, int n, int offset);
+
+void client_stats(client_t* client);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <time.h>
+#include "types.h"
+#include "payload.h"
+
+// pluggable compression for WAL payloads. A packed payload keeps its codec and
+// raw length next to the compressed bytes, so followers can unpack it on apply
+
+typedef enum {
+    CODEC_NONE = 0,
+    CODEC_LZ,
+    CODEC_COUNT
+} codec_id_t;
+
+typedef struct {
+    const char* name;
+    // both return the output length, -1 when it does not fit in cap
+    int (*compress)(const byte* src, int len, byte* dst, int cap);
+    int (*decompress)(const byte* src, int len, byte* dst, int cap);
+} codec_t;
+
+// payloads smaller than this are never worth a codec pass
+#define COMPRESS_MIN_LEN 64
+// output must save at least 1/COMPRESS_MIN_GAIN of the input to be kept
+#define COMPRESS_MIN_GAIN 8
+// longest run of payloads sent raw after repeated incompressible ones
+#define COMPRESS_MAX_BACKOFF 64
+
+typedef struct {
+    int codec;
+    int misses;     // incompressible payloads in a row
+    int skip_left;  // payloads still to send raw before trying again
+
+    long payloads;
+    long packed;
+    long rejected;  // tried but did not shrink enough
+    long skipped;   // not tried, backing off
+    long bytes_in;
+    long bytes_out;
+    clock_t compress_clock;
+} compressor_t;
+
+const codec_t* codec_get(int id);
+
+int codec_find(const char* name);
+
+void compressor_init(compressor_t* z, int codec);
+
+// payload to log in place of raw: a new packed payload, or raw itself with an
+// extra reference when compression is off, skipped or not worth it
+payload_t* compressor_pack(compressor_t* z, payload_t* raw);
+
+// decompresses a packed payload into dst (raw_len bytes), returns raw_len or -1
+int payload_unpack(const payload_t* p, byte* dst);
+
+void compressor_stats(const compressor_t* z);
+
+// ratio and throughput of every codec over templated and random samples
+void compress_bench(int rounds);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include "fs.h"
+#include "hash.h"
+
+// optional content-addressed block sharing: data blocks are indexed by
+// fingerprint and shared between files, each block carrying a reference count
+// next to its bitmap bit. Shared blocks are copied before they are written.
+// Counts and index live in memory, so enable it right after formatting
+
+#define DEDUP_TABLE_SIZE (2 * N_BLOCKS)
+
+typedef struct {
+    fingerprint_t fp;
+    int block;  // -1 empty, -2 deleted
+} dedup_slot_t;
+
+struct dedup_s {
+    dedup_slot_t table[DEDUP_TABLE_SIZE];
+    fingerprint_t block_fp[N_BLOCKS];
+    byte indexed[N_BLOCKS];
+    unsigned short refs[N_BLOCKS];
+
+    long shared;       // blocks mapped onto existing content
+    long cow_copies;   // shared blocks copied before a write
+};
+
+int dedup_enable(fs_node_t* fs);
+
+void dedup_disable(fs_node_t* fs);
+
+int dedup_find(fs_node_t* fs, fingerprint_t fp);
+
+void dedup_insert(fs_node_t* fs, int block, fingerprint_t fp);
+
+void dedup_remove(fs_node_t* fs, int block);
+
+int dedup_indexed_as(fs_node_t* fs, int block, fingerprint_t fp);
+
+int dedup_refs(fs_node_t* fs, int block);
+
+void dedup_track(fs_node_t* fs, int block);
+
+void dedup_ref(fs_node_t* fs, int block);
+
+int dedup_unref(fs_node_t* fs, int block);
+
+void dedup_stats(fs_node_t* fs);
+
+#endif
@@ -1,22 +1,326 @@
 #ifndef DISTRIBUTED_FILE_SYSTEM
 #define DISTRIBUTED_FILE_SYSTEM
 
-#define NUM_NODES 3
+#ifndef NUM_NODES
+#define NUM_NODES 3  // nodes a fresh cluster starts with
+#endif
+#ifndef MAX_NODES
+#define MAX_NODES 16  // registry slots, node ids run below this
+#endif
+#if NUM_NODES > MAX_NODES
+#error "NUM_NODES exceeds MAX_NODES"
+#endif
 #define CHECK_POINT_INTERVAL 10
 
 #define MAX_ARGC 256
 
+#include <sys/uio.h>
+#include <pthread.h>
 #include "node.h"
+#include "compress.h"
+#include "ring.h"
+#include "pool.h"
+#include "lease.h"
 
+#if MAX_NODES > RING_MAX_NODES
+#error "MAX_NODES exceeds RING_MAX_NODES"
+#endif
+
+#define DFS_MAX_OPEN 16
+
+typedef struct fs_node_s fs_node_t;
+typedef struct wal_entry_s wal_entry_t;
+typedef struct wal_queue_s wal_queue_t;
+typedef struct client_s client_t;
+typedef struct applier_s applier_t;
+
+// background walk over every node's blocks, checking each against its checksum
+// and rewriting corrupt ones from a replica that holds an intact copy
+typedef struct {
+    pthread_t thread;
+    int running;
+    int stop;
+    int rate;   // blocks checked per second
+    int node;   // next block to visit
+    int block;
+
+    long scanned;
+    long corrupt;
+    long repaired;
+    long unrepaired;
+} scrubber_t;
+
+// background pass over every tiered node, decaying block heat and demoting
+// blocks that went cold
 typedef struct {
-    node_t nodes[NUM_NODES];
-    fs_node_t file_systems[NUM_NODES];
+    pthread_t thread;
+    int running;
+    int stop;
+    int interval_ms;  // between passes
+
+    long passes;
+    long demoted;
+} migrator_t;
+
+// background walk over the directories that logs a defragmentation of each
+// file it finds scattered, one file per step and only while no other entry
+// was appended since its last step
+typedef struct {
+    pthread_t thread;
+    int running;
+    int stop;
+    int rate;      // files looked at per second
+    int node;      // directory scanned next
+    char last[FILE_NAME_MAX + 1];  // name the scan goes on after, "" at a directory's start
+    int seen;      // sequence counter after the last step
+
+    long files;    // defragmentations logged
+    long deferred; // steps skipped for foreground traffic
+} defragmenter_t;
+
+// replica comparison by merkle tree: roots first, then only the subtrees
+// where nodes disagree, down to the blocks to rewrite from the majority
+typedef struct {
+    int interval;      // run every this many replicated entries, 0 only on demand
+    long passes;
+    long compared;     // tree nodes compared across replicas
+    long repaired;     // blocks rewritten
+    long unresolved;   // blocks with no majority copy
+} anti_entropy_t;
+
+// a file opened on every replica of its shard; with sharding on, the oft_idx
+// of logged writes and seeks names one of these. Without sharding the entry
+// at the replicas' shared slot only records the name
+typedef struct {
+    int in_use;
+    char name[FILE_NAME_MAX + 1];
+    int oft[MAX_NODES];  // each replica's own slot, -1 on nodes outside the shard
+} shard_handle_t;
+
+typedef struct {
+    long files_moved;
+    long files_dropped;
+    long bytes_moved;
+    long move_failures;
+} rebalance_stats_t;
+
+typedef struct {
+    node_t nodes[MAX_NODES];
+    fs_node_t* file_systems[MAX_NODES];  // NULL for ids not in the cluster
+    int node_count;
+    pool_t node_pool;            // fs_node_t, one per registered node
+    pool_t wal_slab;             // wal entries of every node's log
     int leader;
-    int global_sequence_counter;
+    int global_sequence_counter; // next sequence number, taken by atomic add
+    wal_queue_t* queue;          // entries appended but not yet logged
+    long replication_bytes;      // payload bytes shipped to followers
+    long replication_by_hash;    // of those, full blocks a follower already held, sent as fingerprints
+    compressor_t compressor;     // applied to write payloads as they are logged
+    pthread_mutex_t lock;        // held by each command and each background step
+    scrubber_t scrub;
+    migrator_t migrator;
+    defragmenter_t defrag;
+    anti_entropy_t anti_entropy;
+    ring_t ring;                 // file placement, every node holds everything while disabled
+    shard_handle_t handles[DFS_MAX_OPEN];
+    rebalance_stats_t rebalance;
+    lease_table_t leases;        // clients' read leases, revoked as writes commit
+    client_t* client;            // the shell's own cache client, set up on first use
+    applier_t* applier;          // workers applying entries side by side, NULL when off
 } dfs_t;
 
 void dfs_init(dfs_t* dfs);
 
+// releases every node and the pools they came from
+void dfs_destroy(dfs_t* dfs);
+
+// runs one shell command, parameters after the command name; argc counts
+// the command itself. Caller holds dfs->lock
+void dfs_process_command(dfs_t* dfs, char command[3], char* parameters[MAX_ARGC], int argc);
+
+// runs every line of a command file through dfs_process_command, taking
+// dfs->lock for each
+int dfs_read_operation(dfs_t* dfs, char* filename);
+
+// logs and applies every entry published so far, returns how many it took;
+// caller holds dfs->lock
+int dfs_drain_published(dfs_t* dfs);
+
+// logs and applies queued entries in order through entry, returns entry's
+// result; caller holds dfs->lock
 int dfs_replicate_operation(dfs_t* dfs, wal_entry_t* entry);
 
+void dfs_checkpoint(dfs_t* dfs);
+
+// bytes the follower is sent for entry: aligned full blocks whose content it
+// already indexes go as a fingerprint, everything else in full
+void dfs_account_replication(dfs_t* dfs, fs_node_t* follower, wal_entry_t* entry);
+
+// what follows an entry applied on every node holding it: leases on the file
+// revoked, and a checkpoint or anti-entropy pass when one is due
+void dfs_commit_entry(dfs_t* dfs, wal_entry_t* entry);
+
+int dfs_attach_storage(dfs_t* dfs, const char* dir, int cache_slots);
+
+// each node gets a cold tier file in dir under hot_blocks frames of memory,
+// volumes are formatted fresh
+int dfs_attach_tiers(dfs_t* dfs, const char* dir, int hot_blocks);
+
+// one migration pass over every tiered node, returns blocks demoted
+int dfs_migrate_pass(dfs_t* dfs);
+
+int dfs_migrate_start(dfs_t* dfs, int interval_ms);
+
+// returns once the migrator has exited, releasing dfs->lock while it waits
+void dfs_migrate_stop(dfs_t* dfs);
+
+void dfs_migrate_stats(dfs_t* dfs);
+
+// logs a defragmentation of the named file for every node holding it
+int dfs_defragment(dfs_t* dfs, const char* name);
+
+int dfs_defrag_start(dfs_t* dfs, int rate);
+
+// returns once the defragmenter has exited, releasing dfs->lock while it waits
+void dfs_defrag_stop(dfs_t* dfs);
+
+void dfs_defrag_stats(dfs_t* dfs);
+
+// applies entries on a pool of workers, copies on different nodes side by
+// side; 0 goes back to applying them one by one. Caller holds dfs->lock
+int dfs_apply_start(dfs_t* dfs, int workers);
+
+void dfs_apply_stop(dfs_t* dfs);
+
+void dfs_apply_stats(dfs_t* dfs);
+
+int dfs_enable_dedup(dfs_t* dfs);
+
+int dfs_enable_checksums(dfs_t* dfs);
+
+// 1 intact, 0 corrupt (repaired if a replica could help), -1 not checked
+int dfs_scrub_block(dfs_t* dfs, int node_id, int block);
+
+// checks every block of every node now, returns how many were corrupt
+int dfs_scrub_pass(dfs_t* dfs);
+
+int dfs_scrub_start(dfs_t* dfs, int rate);
+
+// returns once the scrubber has exited, releasing dfs->lock while it waits
+void dfs_scrub_stop(dfs_t* dfs);
+
+void dfs_scrub_stats(dfs_t* dfs);
+
+// returns how many blocks were rewritten
+int dfs_anti_entropy(dfs_t* dfs);
+
+void dfs_anti_entropy_stats(dfs_t* dfs);
+
+///// BULK TRANSFER /////
+
+// streams every regular file under dir, subdirectories included, into the
+// cluster: readers threads load host files ahead while the caller's thread
+// creates each one and writes it in batches of several blocks per logged
+// entry. Files keep their base name, which must fit in FILE_NAME_MAX bytes;
+// caller holds dfs->lock. Returns files imported, -1 if none could be
+int dfs_import(dfs_t* dfs, const char* dir, int readers);
+
+// writes every file in the cluster to dir under its own name: the caller's
+// thread reads each from the nodes while writers threads store the ones
+// before it; caller holds dfs->lock. Returns files exported or -1
+int dfs_export(dfs_t* dfs, const char* dir, int writers);
+
+///// NODE REGISTRY /////
+
+// the node's state, NULL if node_id is not in the cluster
+fs_node_t* dfs_node(dfs_t* dfs, int node_id);
+
+// registers a node under the lowest free id and brings it up to date: with
+// sharding on it joins the ring and receives its files, otherwise it starts
+// as a block-for-block copy of the leader. Returns the id or -1
+int dfs_node_add(dfs_t* dfs);
+
+// hands the node's files off (sharding on) and releases its state
+int dfs_node_remove(dfs_t* dfs, int node_id);
+
+// stops applying entries on node_id, which still logs them. Not for the
+// leader or with sharding on; closes are refused until it catches up
+int dfs_node_pause(dfs_t* dfs, int node_id);
+
+// replays a paused node's log from where it stopped, compacted first when
+// compact is set, and makes it active again. Returns entries replayed
+int dfs_node_catch_up(dfs_t* dfs, int node_id, int compact);
+
+// hands leadership to an active node, which serves reads from then on
+int dfs_node_elect(dfs_t* dfs, int node_id);
+
+// paused nodes
+int dfs_lagging(dfs_t* dfs);
+
+void dfs_node_stats(dfs_t* dfs);
+
+///// SHARDING /////
+
+// places files on a ring over every registered node and moves existing ones to match
+int dfs_shard_enable(dfs_t* dfs, int replication, int vnodes);
+
+int dfs_shard_join(dfs_t* dfs, int node_id);
+
+int dfs_shard_leave(dfs_t* dfs, int node_id);
+
+int dfs_shard_open(dfs_t* dfs, const char* name);
+
+int dfs_shard_close(dfs_t* dfs, int handle);
+
+// nodes an entry is logged and applied on, shard leader first
+int dfs_entry_nodes(dfs_t* dfs, wal_entry_t* entry, int* nodes);
+
+// entry as node_id sees it, with the handle swapped for the node's own slot
+int dfs_entry_local(dfs_t* dfs, wal_entry_t* entry, int node_id, wal_entry_t* local);
+
+// node_id's slot for oft_idx: oft_idx itself unless sharding is on
+int dfs_node_oft(dfs_t* dfs, int node_id, int oft_idx);
+
+void dfs_shard_show(dfs_t* dfs, const char* name);
+
+void dfs_shard_stats(dfs_t* dfs);
+
+// opens name on every node that holds it, returns the oft_idx logged writes
+// and reads name it by: a shard handle with sharding on, else the slot every
+// replica shares
+int dfs_open(dfs_t* dfs, const char* name);
+
+int dfs_close(dfs_t* dfs, int oft_idx);
+
+// node that serves reads of oft_idx when the caller has no preference
+int dfs_read_node(dfs_t* dfs, int oft_idx);
+
+// positional I/O against caller buffers: writes are logged and replicated to every node,
+// reads are served by node_id
+int dfs_pwrite(dfs_t* dfs, int oft_idx, const void* buf, int n, int offset);
+
+// reserves oft_idx's blocks up to size bytes on every node holding it, so
+// writes up to there allocate nothing; the file's size is untouched
+int dfs_fallocate(dfs_t* dfs, int oft_idx, int size);
+
+int dfs_pread(dfs_t* dfs, int node_id, int oft_idx, void* buf, int n, int offset);
+
+// dfs_pwrite for callers that do not hold dfs->lock: the append takes no lock,
+// and whichever waiting writer gets the lock applies everyone's entries
+int dfs_pwrite_shared(dfs_t* dfs, int oft_idx, const void* buf, int n, int offset);
+
+// the vector as one logged write, applied whole or not at all
+int dfs_pwritev(dfs_t* dfs, int oft_idx, const struct iovec* iov, int iovcnt, int offset);
+
+int dfs_preadv(dfs_t* dfs, int node_id, int oft_idx, const struct iovec* iov, int iovcnt, int offset);
+
+// the whole named file from the node serving its reads, in a buffer the
+// caller frees; opened for the purpose unless a handle already names it.
+// NULL if there is no such file or a node lags
+byte* dfs_read_file(dfs_t* dfs, const char* name, int* size);
+
+// next name after after, "" to start, on any node; with sharding on no node
+// holds them all. 0 with the name in name, -1 past the last one
+int dfs_next_file(dfs_t* dfs, const char* after, char name[FILE_NAME_MAX + 1]);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef DIR_H
+#define DIR_H
+
+#include "fs.h"
+
+// the directory is a B+ tree from file name to descriptor, rooted in block 7,
+// the directory descriptor's one block; the other nodes come from the bitmap
+// like extent tree nodes. Names are 1 to FILE_NAME_MAX bytes without '/' and
+// sort bytewise, so lookups, inserts and removals touch one node per level
+// and listings walk the leaves in name order. A node split by an insert is
+// never merged back, a leaf only goes once it is empty
+//
+// node: INNER (1) | COUNT (2) | FIRST (2) | then COUNT x (LENGTH (1) | NAME (LENGTH) | VALUE (2)),
+// VALUE is a descriptor in leaves and a child block in inner nodes. An inner
+// node's FIRST child holds the names before its first entry's, every other
+// child the names from its entry's up to the next one's
+#define DIR_ROOT 7
+#define DIR_NODE_HEADER 5
+#define DIR_MAX_DEPTH 16
+
+// descriptor of name, -1 if the directory has none
+int dir_lookup(fs_node_t* fs, const char* name);
+
+// insert and remove take the bitmap loaded in fs->O, the caller writes it back
+int dir_insert(fs_node_t* fs, const char* name, int fd);
+
+int dir_remove(fs_node_t* fs, const char* name);
+
+// first name at or after from, into name; its descriptor, -1 past the last one
+int dir_first(fs_node_t* fs, const char* from, char name[FILE_NAME_MAX + 1]);
+
+// first name after after, "" starts from the beginning
+int dir_next(fs_node_t* fs, const char* after, char name[FILE_NAME_MAX + 1]);
+
+void dir_stats(fs_node_t* fs);
+
+#endif
@@ -2,6 +2,7 @@
 #define EMULATED_FILE_SYSTEM_EFS_H
 
 #include <memory.h>
+#include <sys/uio.h>
 #include "fs.h"
 
 int init(fs_node_t* fs);
@@ -10,11 +11,11 @@ int read_memory(fs_node_t* fs, int m, int n);
 
 int write_memory(fs_node_t* fs, int m, char* string);
 
-int create(fs_node_t* fs, char file_name[4]);
+int create(fs_node_t* fs, const char* name);
 
-int destroy(fs_node_t* fs, char name[4]);
+int destroy(fs_node_t* fs, const char* name);
 
-int open(fs_node_t* fs, char name[4]);
+int open(fs_node_t* fs, const char* name);
 
 int close(fs_node_t* fs, int i);
 
@@ -22,9 +23,39 @@ int f_read(fs_node_t* fs, int i, int m, int n);
 
 int f_write(fs_node_t* fs, int i, int m, int n);
 
+// f_write from a caller buffer instead of M
+int f_write_buf(fs_node_t* fs, int i, const void* buf, int n);
+
 int seek(fs_node_t* fs, int i, int p);
- 
-int directory(fs_node_t* fs);
+
+// positional I/O on open file i straight from/to caller buffers, curr_pos is untouched
+int f_pread(fs_node_t* fs, int i, void* buf, int n, int offset);
+
+int f_pwrite(fs_node_t* fs, int i, const void* buf, int n, int offset);
+
+// maps blocks for open file i up to size bytes ahead of the writes that fill
+// them, in one run where the volume has one; the size stays as it is and the
+// blocks are zeroed only as writes reach them. Returns blocks reserved, -1 if
+// the volume has too few
+int f_allocate(fs_node_t* fs, int i, int size);
+
+int f_preadv(fs_node_t* fs, int i, const struct iovec* iov, int iovcnt, int offset);
+
+int f_pwritev(fs_node_t* fs, int i, const struct iovec* iov, int iovcnt, int offset);
+
+// names starting with prefix in name order, with their sizes
+int directory(fs_node_t* fs, const char* prefix);
+
+// contiguous runs of blocks behind the named file, -1 if there is none
+int file_runs(fs_node_t* fs, const char* name);
+
+// next file past after, in name order, whose blocks lie in more than one run
+// and would fit in one; 0 with its name in name, -1 when no later file qualifies
+int fragmented_file(fs_node_t* fs, const char* after, char name[FILE_NAME_MAX + 1]);
+
+// moves the named file's blocks into one run, open or not; returns blocks
+// moved, 0 if it already was one or no run fits, -1 if there is no such file
+int defragment(fs_node_t* fs, const char* name);
 
 int name_to_int (fs_node_t* fs, char name[4]);
 
@@ -32,13 +63,18 @@ int get_fd_info(fs_node_t* fs, int i, int section);
 
 int write_fd_info(fs_node_t* fs,int info, int fd, int section);
 
-int get_dir_info_name(fs_node_t* fs,int block, char name[4]);
+int get_bit_map_info(fs_node_t* fs, int block);
 
-int get_dir_info_desc (fs_node_t* fs, int block);
+// whether block holds what the current format put there: block 0, the
+// directory root, descriptor blocks laid out since and allocated data blocks
+int block_formatted(fs_node_t* fs, int block);
 
-int write_dir_info(fs_node_t* fs, void * info, int block, int section);
+int alloc_block(fs_node_t* fs, int goal);
 
-int get_bit_map_info(fs_node_t* fs, int block);
+// data blocks left free, caller has the bitmap loaded in fs->O
+int free_block_count(fs_node_t* fs);
+
+void free_block(fs_node_t* fs, int block);
 
 int write_bit_map_info(fs_node_t* fs, int info, int block);
 
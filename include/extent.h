@@ -0,0 +1,41 @@
+#ifndef EXTENT_H
+#define EXTENT_H
+
+#include "fs.h"
+
+// descriptor sections: FILE_LENGTH | EXTENT 0 | EXTENT 1 | EXTENT TREE ROOT
+// an extent packs a run of contiguous blocks as START (16 bits) | LENGTH (16 bits),
+// 0 marks an unused extent. Files needing more than two runs move them into a
+// B+ tree of extent blocks keyed by logical block
+#define EXT_INLINE 1
+#define EXT_INLINE_COUNT 2
+#define EXT_TREE 3
+#define EXT_MAX_LEN 0xffff
+
+#define EXTENT(start, len) ((int) (((unsigned) (start) << 16) | ((unsigned) (len) & 0xffff)))
+#define EXTENT_START(e) ((int) (((unsigned) (e)) >> 16))
+#define EXTENT_LEN(e) ((int) (((unsigned) (e)) & 0xffff))
+#define EXTENT_EMPTY(e) ((e) == 0 || (e) == -1)
+
+// tree node: DEPTH (4) | COUNT (4) | then COUNT x (LOGICAL_BLOCK (4) | VALUE (4)),
+// VALUE is an extent in leaves (depth 0) and a child block in inner nodes
+#define EXT_NODE_HEADER 8
+#define EXT_NODE_ENTRIES ((BLOCK_SIZE - EXT_NODE_HEADER) / 8)
+
+// all take the file's descriptor block loaded in fs->I; calls that allocate or
+// free also take the bitmap loaded in fs->O. The caller writes both back
+
+int extent_lookup(fs_node_t* fs, int fd, int blk);
+
+int extent_block_count(fs_node_t* fs, int fd);
+
+int extent_append(fs_node_t* fs, int fd, int disk_block);
+
+int extent_remap(fs_node_t* fs, int fd, int blk, int disk_block);
+
+void extent_free_all(fs_node_t* fs, int fd);
+
+// flags owned[b] for each of N_BLOCKS blocks the file's data or tree sits in
+void extent_owned(fs_node_t* fs, int fd, byte * owned);
+
+#endif
@@ -4,44 +4,92 @@
 #include "types.h"
 #include "wal.h"
 
-#define N_BLOCKS 64
+#ifndef N_BLOCKS
+#define N_BLOCKS 64 // at most 3840, the bitmap shares block 0 with the superblock
+#endif
 #define BLOCK_SIZE 512
 #define BITS_PER_BYTE 8
 #define N_FILE_DESC 192
+#define OFT_WINDOW 4
 
-#define FD_BLOCK(x) ((x * 16) / BLOCK_SIZE + 1)
-#define FD_OFFSET(x) ((x * 16) % BLOCK_SIZE)
-#define BIT_MAP_BLOCK(x) (x / BITS_PER_BYTE)
-#define BIT_MAP_OFFSET(x) (x % BITS_PER_BYTE)
+#define FD_BLOCK(x) (((x) * 16) / BLOCK_SIZE + 1)
+#define FD_OFFSET(x) (((x) * 16) % BLOCK_SIZE)
+#define BIT_MAP_BLOCK(x) ((x) / BITS_PER_BYTE)
+#define BIT_MAP_OFFSET(x) ((x) % BITS_PER_BYTE)
 
-typedef enum {
-    NAME = 0,
-    FD = 1
-} dir_section;
+// tail of block 0: MAGIC (4) | GENERATION (4) | FORMATTED IN (4) per descriptor block
+#define SUPER_MAGIC 0x45465331
+#define SUPER_SIZE 32
+#define SUPER_OFFSET (BLOCK_SIZE - SUPER_SIZE)
+#define SUPER_GENERATION (SUPER_OFFSET + 4)
+#define SUPER_FD_STAMP(b) (SUPER_OFFSET + 8 + ((b) - 1) * 4)
+
+#if N_BLOCKS / BITS_PER_BYTE > SUPER_OFFSET
+#error "the bitmap and the superblock share block 0"
+#endif
+
+typedef struct block_cache_s block_cache_t;
+typedef struct tier_s tier_t;
+typedef struct dedup_s dedup_t;
+typedef struct checksum_s checksum_t;
+typedef struct merkle_s merkle_t;
+typedef struct pool_s pool_t;
+typedef struct wal_entry_s wal_entry_t;
+
+typedef struct {
+    byte * data;    // pinned in the node's block cache
+    int block;      // logical block held, -1 if empty
+    int disk_block;
+    int dirty;
+    int last_use;
+} oft_slot_t;
 
 typedef struct {
-    byte rw_buffer[BLOCK_SIZE];
     int file_size;
     int curr_pos;
     int fd;
+
+    // per-file block window with readahead and write-behind
+    oft_slot_t window[OFT_WINDOW];
+    int tick;
+    int next_block; // block a sequential reader or writer touches next
+    int seq_run;
 } OFT_entry;
 
-typedef struct {
+typedef struct fs_node_s {
     OFT_entry OFT[4];
-    byte D[N_BLOCKS][BLOCK_SIZE];
+    byte (*D)[BLOCK_SIZE];  // in-memory volume, NULL when disk-backed
+    block_cache_t * cache;  // disk-backed volume, NULL when in memory
+    tier_t * tier;          // hot frames over a cold file, NULL otherwise
+    dedup_t * dedup;        // block sharing, NULL when off
+    checksum_t * sums;      // per-block CRC32C, NULL when off
+    merkle_t * merkle;      // hash tree over the blocks, NULL when off
     byte I[BLOCK_SIZE];
     byte O[BLOCK_SIZE];
     byte M[BLOCK_SIZE];
 
-    wal_entry_t wal[WAL_SIZE];
-    int wal_head;
-    int wal_tail;
+    // logged entries oldest first, drawn from the cluster's slab and handed
+    // back to it as the low water mark passes them
+    wal_entry_t* wal_head;
+    wal_entry_t* wal_tail;
     int wal_count;
+    pool_t* wal_slab;
 
+    int window_hits;
+    int window_misses;
+    int readahead_blocks;
+    int window_writebacks;
+    int blocks_defragmented;
+    int blocks_reserved;
+
+    int applied_sequence;
     int operations_applied;
     int operations_failed;
     int log_replays;
     time_t last_checkpoint;
+
+    int payloads_unpacked;
+    clock_t unpack_clock;
 } fs_node_t;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,16 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+// 128-bit content fingerprint (MurmurHash3 x64 128)
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} fingerprint_t;
+
+fingerprint_t fingerprint(const void* data, int len);
+
+int fingerprint_equal(fingerprint_t a, fingerprint_t b);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef LEASE_H
+#define LEASE_H
+
+#include "types.h"
+
+// read leases the cluster grants per file. A client caching a file holds a
+// lease on it until it expires or the cluster revokes it, which it does
+// through the client's callback as soon as a replicated write to or destroy
+// of the file commits. Until then the client serves reads from its own copy
+
+#define LEASE_MAX 64      // leases held across all clients at once
+#define LEASE_CLIENTS 16
+#define LEASE_TTL_MS 5000
+
+// name is the file whose lease ended
+typedef void (*lease_revoke_fn)(void* arg, const char* name);
+
+typedef struct {
+    int client;    // -1 for a free entry
+    char name[FILE_NAME_MAX + 1];
+    long expires;  // lease_now() time the lease lapses on its own
+} lease_t;
+
+typedef struct {
+    lease_t leases[LEASE_MAX];
+    lease_revoke_fn revoke[LEASE_CLIENTS];  // NULL for ids not registered
+    void* arg[LEASE_CLIENTS];
+    int ttl_ms;    // 0 grants nothing, clients read through
+
+    long granted;
+    long revoked;  // callbacks made
+    long expired;  // lapsed leases reclaimed without one
+    long refused;
+} lease_table_t;
+
+// monotonic milliseconds
+long lease_now(void);
+
+void lease_init(lease_table_t* table);
+
+// client id for lease requests, -1 when every id is taken
+int lease_register(lease_table_t* table, lease_revoke_fn revoke, void* arg);
+
+// drops the client's leases without calling back
+void lease_unregister(lease_table_t* table, int client);
+
+// grants or renews client's lease on name, returns when it lapses or -1
+long lease_grant(lease_table_t* table, int client, const char* name);
+
+void lease_release(lease_table_t* table, int client, const char* name);
+
+// ends every lease on name, every lease at all when name is NULL or empty,
+// telling each holder whose lease had not lapsed yet
+void lease_revoke(lease_table_t* table, const char* name);
+
+void lease_stats(lease_table_t* table);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include "fs.h"
+#include "hash.h"
+
+// hash tree over every block of a node, metadata blocks included. Writes only
+// mark their leaf and its path to the root dirty; hashes along dirty paths are
+// recomputed when a node is next asked for, so comparing two nodes costs in
+// proportion to where they differ
+
+#if (N_BLOCKS & (N_BLOCKS - 1)) != 0
+#error "merkle tree needs N_BLOCKS to be a power of two"
+#endif
+
+#define MERKLE_ROOT 1
+#define MERKLE_LEAF(block) (N_BLOCKS + (block))
+#define MERKLE_IS_LEAF(index) ((index) >= N_BLOCKS)
+
+struct merkle_s {
+    fingerprint_t node[2 * N_BLOCKS];  // children of i are 2i and 2i+1
+    byte dirty[2 * N_BLOCKS];
+
+    long rehashed;  // nodes recomputed
+};
+
+int merkle_enable(fs_node_t* fs);
+
+void merkle_disable(fs_node_t* fs);
+
+void merkle_touch(fs_node_t* fs, int block);
+
+fingerprint_t merkle_node(fs_node_t* fs, int index);
+
+#endif
@@ -10,7 +10,10 @@ typedef enum {
     OP_WRITE,
     OP_OPEN,
     OPEN_CLOSE,
-    OP_SEEK
+    OP_SEEK,
+    OP_PWRITE,
+    OP_DEFRAG,
+    OP_FALLOCATE
 } operation_type_h;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include "types.h"
+
+// reference-counted write payload, shared by every WAL copy of an entry,
+// the replication path and apply instead of being copied into each
+typedef struct {
+    int refcount; // atomic, producers drop theirs while the log holds on
+    int len;      // bytes in data
+    int raw_len;  // bytes once unpacked, len unless compressed
+    byte codec;   // CODEC_NONE for raw bytes
+    byte data[];
+} payload_t;
+
+payload_t* payload_alloc(int len);
+
+payload_t* payload_ref(payload_t* p);
+
+void payload_release(payload_t* p);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// fixed-size object pool carved from chunks of per_chunk objects. Each chunk
+// keeps its own free list, allocation prefers chunks that are already in use,
+// and a chunk whose last object is freed goes back to malloc unless it is the
+// pool's only empty one, so the footprint follows the number of live objects.
+// Not thread-safe; dfs pools are used under dfs->lock
+
+typedef struct pool_chunk_s pool_chunk_t;
+
+typedef struct pool_s {
+    const char* name;
+    size_t size;          // object size as asked for
+    size_t stride;        // object plus its chunk back-pointer, aligned
+    int per_chunk;
+    pool_chunk_t* partial;  // chunks with at least one free object
+    pool_chunk_t* all;
+    int empty_chunks;     // on the partial list with no live objects
+
+    long chunks;
+    long live;
+    long peak;
+    long allocs;
+} pool_t;
+
+void pool_init(pool_t* pool, const char* name, size_t size, int per_chunk);
+
+// releases every chunk, objects still live included
+void pool_destroy(pool_t* pool);
+
+// uninitialised object, NULL when out of memory
+void* pool_alloc(pool_t* pool);
+
+void pool_free(pool_t* pool, void* obj);
+
+// bytes held from malloc
+size_t pool_footprint(const pool_t* pool);
+
+void pool_stats(const pool_t* pool);
+
+#endif
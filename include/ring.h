@@ -0,0 +1,37 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+// consistent-hash ring: every member node owns vnodes points on a 64-bit ring
+// and a file belongs to the first replication distinct members found walking
+// clockwise from its name's hash, the first of them leading its shard. A node
+// joining or leaving only moves the files whose walk crosses its points
+
+#define RING_MAX_NODES 64
+#define RING_MAX_VNODES 64
+
+typedef struct {
+    uint64_t pos;
+    int node;
+} ring_point_t;
+
+typedef struct {
+    int enabled;
+    int replication;
+    int vnodes;
+    int member[RING_MAX_NODES];
+    int n_points;
+    ring_point_t points[RING_MAX_NODES * RING_MAX_VNODES];
+} ring_t;
+
+int ring_init(ring_t* ring, int n_nodes, int replication, int vnodes);
+
+int ring_join(ring_t* ring, int node);
+
+int ring_leave(ring_t* ring, int node);
+
+// fills out with the file's replica nodes, leader first, returns how many
+int ring_replicas(const ring_t* ring, const char* name, int* out);
+
+#endif
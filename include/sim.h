@@ -0,0 +1,44 @@
+#ifndef SIM_H
+#define SIM_H
+
+// deterministic fault simulation: a scratch cluster whose entries really go
+// through the log, pause and catch up, while a seeded event queue on a
+// virtual clock decides when messages arrive, heartbeats lapse, elections
+// finish and nodes fail. The same seed and faults give the same report
+
+#define SIM_MAX_FAULTS 16
+
+typedef enum {
+    SIM_CRASH,      // down, and a leader coming back steps down
+    SIM_PAUSE,      // frozen, a leader coming back before a new one is elected carries on
+    SIM_PARTITION,  // cut off but running, it keeps calling elections it cannot win
+    SIM_SLOW        // applies factor times slower
+} sim_fault_kind_t;
+
+typedef struct {
+    sim_fault_kind_t kind;
+    int node;       // -1 hits whichever node leads when the fault starts
+    int start_ms;
+    int length_ms;
+    int factor;
+
+    // filled in by the run, -1 where they do not apply
+    int skipped;    // the node was already down, or no node led
+    int led;        // the node led when hit
+    long detect_us; // fault start to the first node noticing
+    long elect_us;  // leader lost to the next one elected
+    long catch_up_us;  // fault end to the node being current again
+    int replayed;   // log entries the node replayed
+} sim_fault_t;
+
+// kind:node@start+length in ms, kind crash, pause, part or slow, node L for
+// the leader; slow takes xfactor after the length
+int sim_parse_fault(const char* text, sim_fault_t* fault);
+
+// runs ms of virtual time with a client writing at a steady rate, elections
+// after timeout_ms to twice that of silence, and prints each fault's detect,
+// elect and catch-up times with the write stalls they caused. Without faults
+// the seed picks some. Returns -1 if the cluster could not be set up
+int sim_run(unsigned seed, int ms, int heartbeat_ms, int timeout_ms, sim_fault_t* faults, int n_faults);
+
+#endif
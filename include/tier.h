@@ -0,0 +1,58 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include <stdio.h>
+#include "fs.h"
+
+// two-tier volume: a few in-memory frames hold the blocks files are using,
+// every other block sits in a cold file. Reads and writes through open files
+// heat their blocks, a migrator lets the heat decay and demotes blocks that
+// went cold, and pinning a cold block promotes it back into a frame
+
+#define TIER_RESIDENT 8  // bitmap, descriptors and directory root never leave memory
+// resident blocks, a full window for each open file and room for the blocks
+// an operation pins beside them
+#define TIER_MIN_HOT (TIER_RESIDENT + 3 * OFT_WINDOW + 2)
+
+struct tier_s {
+    FILE * file;
+    int n_hot;
+    byte (*hot)[BLOCK_SIZE];
+    int frame[N_BLOCKS];  // block -> frame, -1 while cold
+    int * owner;          // frame -> block, -1 if free
+    int * pins;
+    int * dirty;          // frame differs from the block's copy in the file
+    unsigned heat[N_BLOCKS];  // file accesses, halved by each migration pass
+
+    long promotions;
+    long demotions;
+    long forced;          // demotions a promotion had to make itself
+    long writebacks;
+};
+
+int tier_open(fs_node_t* fs, const char* path, int n_hot);
+
+void tier_close(fs_node_t* fs);
+
+// frame holding block, promoted if it was cold; NULL if every frame is pinned
+byte * tier_pin(fs_node_t* fs, int block);
+
+void tier_unpin(fs_node_t* fs, int block, int dirty);
+
+// an open file read or wrote the block
+void tier_touch(fs_node_t* fs, int block);
+
+// the block as it sits in the tiers, without promoting it
+int tier_peek(fs_node_t* fs, int block, byte* out);
+
+int tier_store(fs_node_t* fs, int block, const byte* data);
+
+int tier_sync(fs_node_t* fs);
+
+// decays heat and demotes blocks nobody used since the last pass,
+// returns how many were demoted
+int tier_migrate(fs_node_t* fs);
+
+void tier_stats(fs_node_t* fs);
+
+#endif
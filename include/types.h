@@ -3,4 +3,7 @@
 
 typedef unsigned char byte;
 
+// longest file name; a directory node holds two of them with room to spare
+#define FILE_NAME_MAX 250
+
 #endif
\ No newline at end of file
@@ -2,41 +2,121 @@
 #define WAL_H
 
 #include "operation.h"
+#include "payload.h"
 #include "fs.h"
 #include "dfs.h"
 
-#define WAL_SIZE 256
+#define WAL_SIZE 256  // most entries a node holds past the low water mark
+#define WAL_SLAB_CHUNK 64
 
-typedef struct {
+typedef struct wal_entry_s {
     operation_type_h op_type;
     time_t time_stamp;
     int sequence_number;
+    // file the entry touches, picks its shard; creates, destroys and
+    // defragmentations take their name from here
+    char key[FILE_NAME_MAX + 1];
     union {
-        struct { char name[4]; } create_params;
-        struct { char name[4]; } destroy_params;
-        struct { int oft_idx; int m; int n; byte data[512]; } write_params;
+        struct { int oft_idx; int m; int n; payload_t* data; } write_params;
         struct { int oft_idx; int position; } seek_params;
+        struct { int oft_idx; int offset; payload_t* data; } pwrite_params;
+        struct { int oft_idx; int size; } fallocate_params;
     } params;
+    int failed;  // refused when applied, changed nothing and is not replayed
+    int in_place;  // create or destroy that left block 0 as it was when first applied
+    struct wal_entry_s* next;  // next entry in a node's log
 } wal_entry_t;
 
+// entries on their way into the logs. Producers reserve a sequence number
+// and with it a slot by one atomic add, fill the slot and publish it; the
+// thread holding dfs->lock takes published entries strictly in sequence order,
+// logs and applies them, and leaves each result in its slot for the producer
+// to collect, which frees the slot for the next lap. Slot stamps tell the
+// states apart: seq free, seq + 1 published, seq + 2 done
+#define WAL_QUEUE_SIZE 1024
+
+typedef struct {
+    int stamp;
+    int result;
+    wal_entry_t entry;
+} wal_slot_t;
+
+struct wal_queue_s {
+    wal_slot_t slots[WAL_QUEUE_SIZE];
+    int next;       // next sequence number to take, under dfs->lock
+
+    long drained;   // entries taken
+    long drains;    // times a holder of dfs->lock took at least one
+    long waits;     // producers that found their slot still in use
+};
+
+void wal_queue_reset(wal_queue_t* q, int seq);
+
+// published entry seq, NULL while its producer is still filling it
+wal_entry_t* wal_queue_peek(wal_queue_t* q, int seq);
+
+// result of entry seq is in, its payload reference is dropped
+void wal_queue_done(wal_queue_t* q, int seq, int result);
+
+// 0 with the result once seq is done, freeing its slot; -1 while it is not
+int wal_queue_collect(wal_queue_t* q, int seq, int* result);
+
+// logs a taken entry on every node that holds its file, packing its payload
+int wal_log_nodes(dfs_t* dfs, wal_entry_t* entry);
+
 void wal_init(fs_node_t* fs);
 
-wal_entry_t wal_log_create(dfs_t* dfs, char name[4]);
+wal_entry_t wal_log_create(dfs_t* dfs, const char* name);
 
-wal_entry_t wal_log_destroy(dfs_t* dfs, char name[4]);
+wal_entry_t wal_log_destroy(dfs_t* dfs, const char* name);
 
-wal_entry_t wal_log_write(dfs_t* dfs, int oft_idx, int m, int n, byte data[512]);
+wal_entry_t wal_log_write(dfs_t* dfs, int oft_idx, int m, int n, payload_t* data);
 
 wal_entry_t wal_log_seek(dfs_t* dfs, int oft_idx, int position);
 
+wal_entry_t wal_log_pwrite(dfs_t* dfs, int oft_idx, int offset, payload_t* data);
+
+wal_entry_t wal_log_defrag(dfs_t* dfs, const char* name);
+
+wal_entry_t wal_log_fallocate(dfs_t* dfs, int oft_idx, int size);
+
+void wal_truncate(fs_node_t* fs, int sequence_number);
+
+// flags entry sequence_number in fs's log, usually its newest, as refused
+void wal_mark_failed(fs_node_t* fs, int sequence_number);
+
+// flags it as a create or destroy that took, freed and laid out no block
+void wal_mark_in_place(fs_node_t* fs, int sequence_number);
+
+// rewrites the entries of fs's log past sequence number after into fewer ones
+// that leave a replay from fs's current state with the same files and the
+// same block layout: refused entries go, writes to a slot that follow on or
+// overlap merge into one, a seek a later one overrides goes, and a file both
+// created and destroyed in the span leaves no trace when both were applied in
+// place, no other entry between names it and no other create between takes
+// the descriptor the pair would have shifted. Any other create or destroy
+// stays: a directory node it split or freed, or a descriptor block it laid
+// out, does not come back when the name goes again. Every entry in the span
+// must have been applied somewhere, so refusals are flagged, and no close may
+// fall inside it, so slots keep naming the same files. Returns entries removed
+int wal_compact(dfs_t* dfs, fs_node_t* fs, int after);
+
 // void wal_print(dfs_t* dfs);
 
 // void wal_clear(dfs_t* dfs);
 
 // void wal_stats(dfs_t* dfs);
 
-static int wal_apply_entry(fs_node_t * fs, int node_id, wal_entry_t* entry);
+int wal_apply_entry(fs_node_t * fs, int node_id, wal_entry_t* entry);
 
 // int wal_replay(dfs_t* dfs);
 
+// appends from 1 to max_threads producers, lock-free queue against one mutex
+void wal_bench(int max_threads, int ops);
+
+// replays ops random operations onto two lagging nodes of a scratch cluster,
+// one log as it stands and one compacted, and compares both with the leader;
+// -1 if either differs
+int wal_compact_check(int ops);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "aio.h"
+#include "wal.h"
+
+// entries run per hold of dfs->lock, so scrub steps and commands still get in
+// between batches
+#define AIO_BATCH 64
+
+#define AIO_IDLE_EMPTY 1  // worker sleeps until entries are submitted
+#define AIO_IDLE_FULL  2  // worker sleeps until completions are reaped
+
+// the client publishes its index and then looks at the worker's sleep flag,
+// the worker raises the flag and then looks at the client's index once more;
+// sequentially consistent order keeps one of them from missing the other
+
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+static unsigned sq_ready(aio_t* aio) {
+    return LOAD(aio->sq_tail) - aio->sq_head;
+}
+
+static unsigned cq_room(aio_t* aio) {
+    return aio->cq_mask + 1 - (aio->cq_tail - LOAD(aio->cq_head));
+}
+
+static int aio_execute(dfs_t* dfs, aio_sqe_t* sqe) {
+    switch (sqe->op) {
+        case AIO_NOP:
+            return 0;
+
+        case AIO_CREATE: {
+            wal_entry_t entry = wal_log_create(dfs, sqe->name);
+            if (entry.sequence_number < 0 || dfs_replicate_operation(dfs, &entry) < 0) {
+                return -1;
+            }
+            return 0;
+        }
+
+        case AIO_OPEN:
+            return dfs_open(dfs, sqe->name);
+
+        case AIO_READ: {
+            int node = sqe->node >= 0 ? sqe->node : dfs_read_node(dfs, sqe->handle);
+            return dfs_pread(dfs, node, sqe->handle, sqe->buf, sqe->len, sqe->offset);
+        }
+
+        case AIO_WRITE:
+            return dfs_pwrite(dfs, sqe->handle, sqe->buf, sqe->len, sqe->offset);
+
+        case AIO_CLOSE:
+            return dfs_close(dfs, sqe->handle);
+
+        default:
+            return -1;
+    }
+}
+
+static void* aio_worker(void* arg) {
+    aio_t* aio = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&aio->wake_lock);
+        while (!aio->stop && (sq_ready(aio) == 0 || cq_room(aio) == 0)) {
+            int reason = sq_ready(aio) == 0 ? AIO_IDLE_EMPTY : AIO_IDLE_FULL;
+            STORE(aio->idle, reason);
+            if (reason == AIO_IDLE_EMPTY ? sq_ready(aio) != 0 : cq_room(aio) != 0) {
+                continue;
+            }
+            pthread_cond_wait(&aio->wake, &aio->wake_lock);
+        }
+        STORE(aio->idle, 0);
+        int stop = aio->stop;
+        pthread_mutex_unlock(&aio->wake_lock);
+
+        if (stop) {
+            return NULL;
+        }
+
+        unsigned n = sq_ready(aio);
+        if (n > cq_room(aio)) n = cq_room(aio);
+        if (n > AIO_BATCH) n = AIO_BATCH;
+
+        pthread_mutex_lock(&aio->dfs->lock);
+        for (unsigned k = 0; k < n; k++) {
+            aio_sqe_t* sqe = &aio->sqes[(aio->sq_head + k) & aio->sq_mask];
+            aio_cqe_t* cqe = &aio->cqes[(aio->cq_tail + k) & aio->cq_mask];
+            cqe->user_data = sqe->user_data;
+            cqe->result = aio_execute(aio->dfs, sqe);
+        }
+        pthread_mutex_unlock(&aio->dfs->lock);
+
+        STORE(aio->sq_head, aio->sq_head + n);
+        STORE(aio->cq_tail, aio->cq_tail + n);
+        aio->completed += n;
+        aio->batches++;
+        eventfd_write(aio->event_fd, n);
+    }
+}
+
+// wakes the worker if it went to sleep for want of what the caller just freed
+// or published
+static void aio_wake(aio_t* aio, int reason) {
+    int idle = LOAD(aio->idle);
+    if (idle != 0 && (reason == 0 || idle == reason)) {
+        pthread_mutex_lock(&aio->wake_lock);
+        pthread_cond_signal(&aio->wake);
+        pthread_mutex_unlock(&aio->wake_lock);
+    }
+}
+
+///// SETUP /////
+
+int aio_setup(aio_t* aio, dfs_t* dfs, int entries) {
+    if (aio == NULL || dfs == NULL || entries < 1 || entries > AIO_MAX_ENTRIES) {
+        return -1;
+    }
+
+    unsigned size = 1;
+    while (size < (unsigned) entries) {
+        size <<= 1;
+    }
+
+    memset(aio, 0, sizeof(aio_t));
+    aio->dfs = dfs;
+    aio->sq_mask = size - 1;
+    aio->cq_mask = 2 * size - 1;
+    aio->sqes = calloc(size, sizeof(aio_sqe_t));
+    aio->cqes = calloc(2 * size, sizeof(aio_cqe_t));
+    aio->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (aio->sqes == NULL || aio->cqes == NULL || aio->event_fd < 0) {
+        goto fail;
+    }
+
+    pthread_mutex_init(&aio->wake_lock, NULL);
+    pthread_cond_init(&aio->wake, NULL);
+    if (pthread_create(&aio->worker, NULL, aio_worker, aio) != 0) {
+        pthread_cond_destroy(&aio->wake);
+        pthread_mutex_destroy(&aio->wake_lock);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (aio->event_fd >= 0) {
+        close(aio->event_fd);
+    }
+    free(aio->sqes);
+    free(aio->cqes);
+    return -1;
+}
+
+void aio_teardown(aio_t* aio) {
+    pthread_mutex_lock(&aio->wake_lock);
+    aio->stop = 1;
+    pthread_cond_signal(&aio->wake);
+    pthread_mutex_unlock(&aio->wake_lock);
+    pthread_join(aio->worker, NULL);
+
+    pthread_cond_destroy(&aio->wake);
+    pthread_mutex_destroy(&aio->wake_lock);
+    close(aio->event_fd);
+    free(aio->sqes);
+    free(aio->cqes);
+    aio->sqes = NULL;
+    aio->cqes = NULL;
+}
+
+///// SUBMISSION /////
+
+aio_sqe_t* aio_get_sqe(aio_t* aio) {
+    if (aio->sq_fill - LOAD(aio->sq_head) > aio->sq_mask) {
+        return NULL;
+    }
+
+    aio_sqe_t* sqe = &aio->sqes[aio->sq_fill++ & aio->sq_mask];
+    memset(sqe, 0, sizeof(aio_sqe_t));
+    sqe->node = -1;
+    return sqe;
+}
+
+static void aio_prep(aio_sqe_t* sqe, int op, const char* name, int handle, uint64_t user_data) {
+    sqe->op = op;
+    memset(sqe->name, 0, sizeof(sqe->name));
+    if (name != NULL) {
+        strncpy(sqe->name, name, FILE_NAME_MAX);
+        // longer names are refused when the entry runs
+        if (strlen(name) > FILE_NAME_MAX) sqe->name[0] = '\0';
+    }
+    sqe->handle = handle;
+    sqe->user_data = user_data;
+}
+
+void aio_prep_create(aio_sqe_t* sqe, const char* name, uint64_t user_data) {
+    aio_prep(sqe, AIO_CREATE, name, -1, user_data);
+}
+
+void aio_prep_open(aio_sqe_t* sqe, const char* name, uint64_t user_data) {
+    aio_prep(sqe, AIO_OPEN, name, -1, user_data);
+}
+
+void aio_prep_read(aio_sqe_t* sqe, int handle, void* buf, int len, int offset, uint64_t user_data) {
+    aio_prep(sqe, AIO_READ, NULL, handle, user_data);
+    sqe->buf = buf;
+    sqe->len = len;
+    sqe->offset = offset;
+}
+
+void aio_prep_write(aio_sqe_t* sqe, int handle, const void* buf, int len, int offset, uint64_t user_data) {
+    aio_prep(sqe, AIO_WRITE, NULL, handle, user_data);
+    sqe->buf = (void*) buf;
+    sqe->len = len;
+    sqe->offset = offset;
+}
+
+void aio_prep_close(aio_sqe_t* sqe, int handle, uint64_t user_data) {
+    aio_prep(sqe, AIO_CLOSE, NULL, handle, user_data);
+}
+
+int aio_submit(aio_t* aio) {
+    int n = aio->sq_fill - aio->sq_tail;
+    if (n == 0) {
+        return 0;
+    }
+
+    STORE(aio->sq_tail, aio->sq_fill);
+    aio->submitted += n;
+    aio_wake(aio, 0);
+    return n;
+}
+
+///// COMPLETION /////
+
+int aio_peek_cqe(aio_t* aio, aio_cqe_t* cqe) {
+    if (aio->cq_head == LOAD(aio->cq_tail)) {
+        return -1;
+    }
+
+    *cqe = aio->cqes[aio->cq_head & aio->cq_mask];
+    return 0;
+}
+
+int aio_wait_cqe(aio_t* aio, aio_cqe_t* cqe) {
+    // a count left over from completions already reaped only costs an extra look
+    while (aio_peek_cqe(aio, cqe) < 0) {
+        eventfd_t posted;
+        if (eventfd_read(aio->event_fd, &posted) < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void aio_cqe_seen(aio_t* aio) {
+    STORE(aio->cq_head, aio->cq_head + 1);
+    aio_wake(aio, AIO_IDLE_FULL);
+}
+
+int aio_event_fd(aio_t* aio) {
+    return aio->event_fd;
+}
+
+void aio_stats(aio_t* aio) {
+    printf("aio: %ld submitted, %ld completed in %ld batches (%.1f per batch), %u in flight\n",
+           aio->submitted, aio->completed, aio->batches,
+           aio->batches > 0 ? (double) aio->completed / aio->batches : 0.0,
+           LOAD(aio->sq_tail) - LOAD(aio->sq_head));
+}
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfs.h"
+#include "apply.h"
+
+static int apply_copy(dfs_t* dfs, int node_id, apply_task_t* task) {
+    fs_node_t* fs = dfs->file_systems[node_id];
+    if (task->copy == COPY_SKIP) {
+        fs->applied_sequence = task->local.sequence_number;
+        return 0;
+    }
+    if (task->copy == COPY_FOLLOWER) {
+        dfs_account_replication(dfs, fs, &task->local);
+    }
+    return wal_apply_entry(fs, node_id, &task->local);
+}
+
+// lanes take turns, a worker holds one lane while it applies its head task
+static void* apply_worker(void* arg) {
+    applier_t* ap = arg;
+    int next = 0;
+
+    pthread_mutex_lock(&ap->lock);
+    for (;;) {
+        int node_id = -1;
+        for (int k = 0; k < MAX_NODES && node_id == -1; k++) {
+            apply_lane_t* lane = &ap->lanes[(next + k) % MAX_NODES];
+            if (lane->count > 0 && !lane->busy) {
+                node_id = (next + k) % MAX_NODES;
+            }
+        }
+        if (node_id == -1) {
+            if (ap->stop) {
+                break;
+            }
+            pthread_cond_wait(&ap->work, &ap->lock);
+            continue;
+        }
+
+        apply_lane_t* lane = &ap->lanes[node_id];
+        apply_task_t* task = &lane->tasks[lane->head];
+        lane->busy = 1;
+        ap->overlapped += ap->active > 0;
+        ap->active++;
+        next = node_id + 1;
+        pthread_mutex_unlock(&ap->lock);
+
+        int result = apply_copy(ap->dfs, node_id, task);
+
+        pthread_mutex_lock(&ap->lock);
+        apply_slot_t* slot = &ap->slots[task->slot];
+        if (task->copy == COPY_FIRST) {
+            slot->result = result;
+            slot->in_place = task->local.in_place;
+        } else if (result < 0) {
+            slot->refused[node_id] = 1;
+        }
+        lane->head = (lane->head + 1) % APPLY_WINDOW;
+        lane->count--;
+        lane->busy = 0;
+        ap->queued--;
+        ap->active--;
+        ap->worker_copies++;
+        pthread_cond_broadcast(&ap->done);
+    }
+    pthread_mutex_unlock(&ap->lock);
+    return NULL;
+}
+
+// caller holds ap->lock; a lane never holds more than one copy of an entry
+static void apply_queue(applier_t* ap, int node_id, wal_entry_t* local, int slot, apply_copy_t copy) {
+    apply_lane_t* lane = &ap->lanes[node_id];
+    apply_task_t* task = &lane->tasks[(lane->head + lane->count) % APPLY_WINDOW];
+    task->local = *local;
+    task->slot = slot;
+    task->copy = copy;
+    lane->count++;
+    ap->queued++;
+}
+
+// the first copy waits behind whatever the node still has queued, and is
+// applied right here when that is nothing
+static int apply_first(applier_t* ap, int node_id, wal_entry_t* local, int slot) {
+    apply_lane_t* lane = &ap->lanes[node_id];
+
+    pthread_mutex_lock(&ap->lock);
+    if (lane->count > 0) {
+        ap->first_waits++;
+        apply_queue(ap, node_id, local, slot, COPY_FIRST);
+        pthread_cond_broadcast(&ap->work);
+        while (lane->count > 0) {
+            pthread_cond_wait(&ap->done, &ap->lock);
+        }
+        int result = ap->slots[slot].result;
+        local->in_place = ap->slots[slot].in_place;
+        pthread_mutex_unlock(&ap->lock);
+        return result;
+    }
+    ap->active++;
+    pthread_mutex_unlock(&ap->lock);
+
+    int result = wal_apply_entry(ap->dfs->file_systems[node_id], node_id, local);
+
+    pthread_mutex_lock(&ap->lock);
+    ap->active--;
+    ap->inline_copies++;
+    pthread_mutex_unlock(&ap->lock);
+    return result;
+}
+
+// checkpoints and anti-entropy passes look at every node, nothing may be in flight
+static int apply_barrier(dfs_t* dfs, wal_entry_t* entry) {
+    int interval = dfs->anti_entropy.interval;
+    return (entry->sequence_number + 1) % CHECK_POINT_INTERVAL == 0 ||
+           (interval > 0 && (entry->sequence_number + 1) % interval == 0);
+}
+
+void apply_dispatch(dfs_t* dfs, wal_entry_t* entry) {
+    applier_t* ap = dfs->applier;
+    if (ap->in_flight == APPLY_WINDOW) {
+        apply_flush(dfs);
+    }
+
+    int s = (ap->oldest + ap->in_flight) % APPLY_WINDOW;
+    apply_slot_t* slot = &ap->slots[s];
+    slot->entry = *entry;
+    slot->result = 0;
+    memset(slot->refused, 0, sizeof(slot->refused));
+    ap->in_flight++;
+
+    int nodes[MAX_NODES];
+    int count = dfs_entry_nodes(dfs, entry, nodes);
+    int holds[MAX_NODES] = { 0 };
+    int first = -1;
+
+    for (int k = 0; k < count; k++) {
+        int i = nodes[k];
+        holds[i] = 1;
+        if (dfs->nodes[i].status == LAGGING) {
+            continue;  // logged all the same, applied when it catches up
+        }
+
+        wal_entry_t local;
+        int result = dfs_entry_local(dfs, entry, i, &local);
+        if (first != -1) {
+            if (result < 0) {
+                slot->refused[i] = 1;
+            } else {
+                pthread_mutex_lock(&ap->lock);
+                apply_queue(ap, i, &local, s, COPY_FOLLOWER);
+                pthread_mutex_unlock(&ap->lock);
+            }
+            continue;
+        }
+
+        first = i;
+        if (result == 0) {
+            result = apply_first(ap, i, &local, s);
+        }
+        if (result < 0) {
+            // refused by the first node to see it, so a no-op on every one
+            for (int j = 0; j < count; j++) {
+                wal_mark_failed(dfs->file_systems[nodes[j]], entry->sequence_number);
+            }
+            printf("Failed to replicate to node %d\n", i);
+            slot->result = -1;
+            return;
+        }
+        if (local.in_place) {
+            for (int j = 0; j < count; j++) {
+                wal_mark_in_place(dfs->file_systems[nodes[j]], entry->sequence_number);
+            }
+        }
+    }
+
+    // nodes outside the shard have nothing to apply and count as caught up
+    pthread_mutex_lock(&ap->lock);
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] != NULL && !holds[i]) {
+            apply_queue(ap, i, entry, s, COPY_SKIP);
+        }
+    }
+    pthread_cond_broadcast(&ap->work);
+    pthread_mutex_unlock(&ap->lock);
+
+    if (apply_barrier(dfs, entry)) {
+        apply_flush(dfs);
+    }
+}
+
+void apply_flush(dfs_t* dfs) {
+    applier_t* ap = dfs->applier;
+    if (ap == NULL || ap->in_flight == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&ap->lock);
+    ap->flushes++;
+    while (ap->queued > 0) {
+        pthread_cond_wait(&ap->done, &ap->lock);
+    }
+    pthread_mutex_unlock(&ap->lock);
+
+    for (; ap->in_flight > 0; ap->in_flight--) {
+        apply_slot_t* slot = &ap->slots[ap->oldest];
+        int result = slot->result;
+        for (int i = 0; i < MAX_NODES && slot->result == 0; i++) {
+            if (slot->refused[i]) {
+                wal_mark_failed(dfs->file_systems[i], slot->entry.sequence_number);
+                printf("Failed to replicate to node %d\n", i);
+                result = -1;
+            }
+        }
+        if (result == 0) {
+            dfs_commit_entry(dfs, &slot->entry);
+        }
+        wal_queue_done(dfs->queue, slot->entry.sequence_number, result);
+        ap->oldest = (ap->oldest + 1) % APPLY_WINDOW;
+    }
+}
+
+///// WORKERS /////
+
+// caller holds dfs->lock, so no drain is under way and every lane is empty
+int dfs_apply_start(dfs_t* dfs, int workers) {
+    if (workers < 0 || workers > APPLY_MAX_WORKERS) {
+        return -1;
+    }
+    dfs_apply_stop(dfs);
+    if (workers == 0) {
+        return 0;
+    }
+
+    applier_t* ap = calloc(1, sizeof(applier_t));
+    if (ap == NULL) {
+        return -1;
+    }
+    ap->dfs = dfs;
+    pthread_mutex_init(&ap->lock, NULL);
+    pthread_cond_init(&ap->work, NULL);
+    pthread_cond_init(&ap->done, NULL);
+
+    while (ap->workers < workers && pthread_create(&ap->threads[ap->workers], NULL, apply_worker, ap) == 0) {
+        ap->workers++;
+    }
+    dfs->applier = ap;
+    if (ap->workers < workers) {
+        dfs_apply_stop(dfs);
+        return -1;
+    }
+    return 0;
+}
+
+// back to applying every copy in the dfs->lock holder's thread
+void dfs_apply_stop(dfs_t* dfs) {
+    applier_t* ap = dfs->applier;
+    if (ap == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&ap->lock);
+    ap->stop = 1;
+    pthread_cond_broadcast(&ap->work);
+    pthread_mutex_unlock(&ap->lock);
+    for (int t = 0; t < ap->workers; t++) {
+        pthread_join(ap->threads[t], NULL);
+    }
+
+    pthread_cond_destroy(&ap->done);
+    pthread_cond_destroy(&ap->work);
+    pthread_mutex_destroy(&ap->lock);
+    free(ap);
+    dfs->applier = NULL;
+}
+
+void dfs_apply_stats(dfs_t* dfs) {
+    applier_t* ap = dfs->applier;
+    if (ap == NULL) {
+        printf("parallel apply off\n");
+        return;
+    }
+
+    printf("parallel apply on %d workers: %ld copies applied inline, %ld by workers (%ld alongside another), "
+           "%ld first copies queued behind their node, %ld flushes\n",
+           ap->workers, ap->inline_copies, ap->worker_copies, ap->overlapped, ap->first_waits, ap->flushes);
+}
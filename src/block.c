@@ -0,0 +1,382 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "block.h"
+#include "checksum.h"
+#include "merkle.h"
+#include "tier.h"
+
+int block_open_memory(fs_node_t* fs) {
+    if (fs->D == NULL) {
+        fs->D = calloc(N_BLOCKS, BLOCK_SIZE);
+        if (fs->D == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int block_open_file(fs_node_t* fs, const char* path, int n_slots) {
+    if (path == NULL || n_slots < CACHE_MIN_SLOTS) {
+        return -1;
+    }
+
+    // stdio rather than open(2): the efs API claims open and close for itself
+    FILE* file = fopen(path, "r+b");
+    if (file == NULL) {
+        file = fopen(path, "w+b");
+    }
+    if (file == NULL) {
+        return -1;
+    }
+
+    if (ftruncate(fileno(file), (off_t) N_BLOCKS * BLOCK_SIZE) < 0) {
+        fclose(file);
+        return -1;
+    }
+
+    block_cache_t* cache = calloc(1, sizeof(block_cache_t));
+    if (cache == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    cache->slots = calloc(n_slots, sizeof(cache_slot_t));
+    if (cache->slots == NULL) {
+        free(cache);
+        fclose(file);
+        return -1;
+    }
+
+    cache->file = file;
+    cache->n_slots = n_slots;
+    for (int b = 0; b < N_BLOCKS; b++) {
+        cache->map[b] = -1;
+    }
+    for (int s = 0; s < n_slots; s++) {
+        cache->slots[s].block = -1;
+    }
+
+    block_close(fs);
+    fs->cache = cache;
+    return 0;
+}
+
+static int cache_writeback(block_cache_t* cache, cache_slot_t* slot) {
+    if (slot->block == -1 || !slot->dirty) {
+        return 0;
+    }
+
+    off_t pos = (off_t) slot->block * BLOCK_SIZE;
+    if (pwrite(fileno(cache->file), slot->data, BLOCK_SIZE, pos) != BLOCK_SIZE) {
+        return -1;
+    }
+
+    slot->dirty = 0;
+    cache->writebacks++;
+    return 0;
+}
+
+void block_close(fs_node_t* fs) {
+    if (fs->cache != NULL) {
+        block_sync(fs);
+        fclose(fs->cache->file);
+        free(fs->cache->slots);
+        free(fs->cache);
+        fs->cache = NULL;
+    }
+
+    tier_close(fs);
+    free(fs->D);
+    fs->D = NULL;
+}
+
+// CLOCK: sweep the hand past pinned slots, giving referenced ones a second chance
+static int cache_victim(block_cache_t* cache) {
+    for (int step = 0; step < 2 * cache->n_slots; step++) {
+        int s = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->n_slots;
+
+        cache_slot_t* slot = &cache->slots[s];
+        if (slot->block == -1) {
+            return s;
+        }
+        if (slot->pins > 0) {
+            continue;
+        }
+        if (slot->referenced) {
+            slot->referenced = 0;
+            continue;
+        }
+        return s;
+    }
+    return -1;  // everything is pinned
+}
+
+byte * block_pin(fs_node_t* fs, int block) {
+    if (block < 0 || block >= N_BLOCKS) {
+        return NULL;
+    }
+
+    block_cache_t* cache = fs->cache;
+    if (cache == NULL) {
+        byte* data = fs->tier != NULL ? tier_pin(fs, block) : fs->D[block];
+        if (data == NULL) {
+            return NULL;
+        }
+
+        checksum_t* sums = fs->sums;
+        if (sums != NULL) {
+            // a block nobody holds is as it was last written, unless corrupted
+            if (sums->pins[block] == 0 && sums->state[block] == SUM_KNOWN &&
+                checksum_verify(fs, block, data) < 0) {
+                if (fs->tier != NULL) {
+                    tier_unpin(fs, block, 0);
+                }
+                return NULL;
+            }
+            sums->pins[block]++;
+        }
+        return data;
+    }
+
+    int s = cache->map[block];
+    if (s != -1) {
+        cache->hits++;
+        cache->slots[s].pins++;
+        cache->slots[s].referenced = 1;
+        return cache->slots[s].data;
+    }
+
+    cache->misses++;
+    s = cache_victim(cache);
+    if (s == -1) {
+        return NULL;
+    }
+
+    cache_slot_t* slot = &cache->slots[s];
+    if (slot->block != -1) {
+        if (cache_writeback(cache, slot) < 0) {
+            return NULL;
+        }
+        cache->map[slot->block] = -1;
+        cache->evictions++;
+    }
+
+    off_t pos = (off_t) block * BLOCK_SIZE;
+    ssize_t got = pread(fileno(cache->file), slot->data, BLOCK_SIZE, pos);
+    if (got < 0) {
+        slot->block = -1;
+        return NULL;
+    }
+    if (got < BLOCK_SIZE) {
+        memset(slot->data + got, 0, BLOCK_SIZE - got);
+    }
+    if (checksum_loaded(fs, block, slot->data) < 0) {
+        slot->block = -1;
+        return NULL;
+    }
+
+    slot->block = block;
+    slot->pins = 1;
+    slot->dirty = 0;
+    slot->referenced = 1;
+    cache->map[block] = s;
+
+    return slot->data;
+}
+
+void block_unpin(fs_node_t* fs, int block, int dirty) {
+    if (block < 0 || block >= N_BLOCKS) {
+        return;
+    }
+
+    if (dirty) {
+        merkle_touch(fs, block);
+    }
+
+    block_cache_t* cache = fs->cache;
+    if (cache == NULL) {
+        tier_t* tier = fs->tier;
+        if (tier != NULL && tier->frame[block] == -1) {
+            return;
+        }
+
+        byte* data = tier != NULL ? tier->hot[tier->frame[block]] : fs->D[block];
+        checksum_t* sums = fs->sums;
+        if (sums != NULL && sums->pins[block] > 0) {
+            sums->pins[block]--;
+            if (dirty || (sums->state[block] & SUM_STALE)) {
+                checksum_unpinned(fs, block, data, sums->pins[block], dirty);
+            }
+        }
+        if (tier != NULL) {
+            tier_unpin(fs, block, dirty);
+        }
+        return;
+    }
+
+    int s = cache->map[block];
+    if (s == -1) {
+        return;
+    }
+
+    if (cache->slots[s].pins > 0) {
+        cache->slots[s].pins--;
+    }
+    if (dirty) {
+        cache->slots[s].dirty = 1;
+    }
+    if (dirty || (fs->sums != NULL && (fs->sums->state[block] & SUM_STALE))) {
+        checksum_unpinned(fs, block, cache->slots[s].data, cache->slots[s].pins, dirty);
+    }
+}
+
+int block_read(fs_node_t* fs, int block, byte* dst) {
+    byte* data = block_pin(fs, block);
+    if (data == NULL) {
+        return -1;
+    }
+
+    memcpy(dst, data, BLOCK_SIZE);
+    block_unpin(fs, block, 0);
+    return 0;
+}
+
+int block_write(fs_node_t* fs, int block, const byte* src) {
+    byte* data = block_pin(fs, block);
+    if (data == NULL) {
+        return -1;
+    }
+
+    memcpy(data, src, BLOCK_SIZE);
+    block_unpin(fs, block, 1);
+    return 0;
+}
+
+int block_zero(fs_node_t* fs, int block) {
+    byte* data = block_pin(fs, block);
+    if (data == NULL) {
+        return -1;
+    }
+
+    memset(data, 0, BLOCK_SIZE);
+    block_unpin(fs, block, 1);
+    return 0;
+}
+
+// checks the block as it sits in storage against its sum and leaves the bytes
+// in out: 1 intact, 0 corrupt, -1 not checkable (no sum, or held by a writer)
+int block_scrub(fs_node_t* fs, int block, byte* out) {
+    checksum_t* sums = fs->sums;
+    if (sums == NULL || block < 0 || block >= N_BLOCKS) {
+        return -1;
+    }
+    if (!(sums->state[block] & SUM_KNOWN) || (sums->state[block] & SUM_STALE)) {
+        return -1;
+    }
+
+    block_cache_t* cache = fs->cache;
+    if (cache == NULL) {
+        if (sums->pins[block] > 0) {
+            return -1;
+        }
+        if (fs->tier != NULL) {
+            if (tier_peek(fs, block, out) < 0) {
+                return -1;
+            }
+        } else {
+            memcpy(out, fs->D[block], BLOCK_SIZE);
+        }
+    } else {
+        int s = cache->map[block];
+        if (s != -1 && cache->slots[s].pins > 0) {
+            return -1;
+        }
+
+        // a dirty page is the newest copy, otherwise what counts is the file
+        if (s != -1 && cache->slots[s].dirty) {
+            memcpy(out, cache->slots[s].data, BLOCK_SIZE);
+        } else if (pread(fileno(cache->file), out, BLOCK_SIZE, (off_t) block * BLOCK_SIZE) != BLOCK_SIZE) {
+            return -1;
+        }
+    }
+
+    sums->verified++;
+    if (crc32c(0, out, BLOCK_SIZE) == sums->crc[block]) {
+        return 1;
+    }
+
+    sums->mismatches++;
+    sums->state[block] &= ~SUM_CHECKED;
+    return 0;
+}
+
+// overwrites a corrupt block with a good copy, without reading it first
+int block_repair(fs_node_t* fs, int block, const byte* data) {
+    if (block < 0 || block >= N_BLOCKS) {
+        return -1;
+    }
+
+    block_cache_t* cache = fs->cache;
+    if (fs->tier != NULL) {
+        if (tier_store(fs, block, data) < 0) {
+            return -1;
+        }
+    } else if (cache == NULL) {
+        memcpy(fs->D[block], data, BLOCK_SIZE);
+    } else {
+        int s = cache->map[block];
+        if (s != -1) {
+            memcpy(cache->slots[s].data, data, BLOCK_SIZE);
+            cache->slots[s].dirty = 1;
+        } else if (pwrite(fileno(cache->file), data, BLOCK_SIZE, (off_t) block * BLOCK_SIZE) != BLOCK_SIZE) {
+            return -1;
+        }
+    }
+
+    checksum_update(fs, block, data);
+    merkle_touch(fs, block);
+    if (fs->sums != NULL) {
+        fs->sums->repaired++;
+    }
+    return 0;
+}
+
+int block_sync(fs_node_t* fs) {
+    if (fs->tier != NULL) {
+        return tier_sync(fs);
+    }
+
+    block_cache_t* cache = fs->cache;
+    if (cache == NULL) {
+        return 0;
+    }
+
+    int result = 0;
+    for (int s = 0; s < cache->n_slots; s++) {
+        if (cache_writeback(cache, &cache->slots[s]) < 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+void block_stats(fs_node_t* fs) {
+    if (fs->tier != NULL) {
+        tier_stats(fs);
+        return;
+    }
+
+    block_cache_t* cache = fs->cache;
+    if (cache == NULL) {
+        printf("in-memory volume, %d blocks\n", N_BLOCKS);
+        return;
+    }
+
+    long lookups = cache->hits + cache->misses;
+    double hit_ratio = lookups > 0 ? (double) cache->hits / lookups : 0.0;
+    printf("cache %d slots: %ld hits %ld misses (%.1f%% hit) %ld evictions %ld writebacks\n",
+           cache->n_slots, cache->hits, cache->misses, hit_ratio * 100.0,
+           cache->evictions, cache->writebacks);
+}
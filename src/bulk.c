@@ -0,0 +1,384 @@
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "dfs.h"
+#include "efs.h"
+#include "wal.h"
+
+#define BULK_FILES (N_FILE_DESC - 1)  // a volume has no more descriptors
+#define BULK_QUEUE 8                  // files in flight between the two sides
+#define BULK_THREADS 16
+#define BULK_BATCH (8 * BLOCK_SIZE)   // bytes per logged write
+#define BULK_MAX_SIZE ((N_BLOCKS - 8) * BLOCK_SIZE)
+#define BULK_DEPTH 16                 // subdirectories followed on import
+
+typedef struct {
+    char name[FILE_NAME_MAX + 1];
+    char path[PATH_MAX];
+    byte* data;  // NULL when it could not be read
+    int size;
+} bulk_file_t;
+
+// files handed from the threads doing host I/O to the one holding dfs->lock
+// or the other way round, at most BULK_QUEUE at once so memory stays bounded
+typedef struct {
+    bulk_file_t files[BULK_FILES];
+    int n;
+    int next;      // next file a reader claims, taken by atomic add
+
+    bulk_file_t* ready[BULK_QUEUE];
+    int head;
+    int count;
+    int closed;    // nothing more will be queued
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    const char* dir;
+    int failed;    // host writes that did not go through
+} bulk_t;
+
+static void bulk_init(bulk_t* bulk, const char* dir) {
+    memset(bulk, 0, sizeof(bulk_t));
+    bulk->dir = dir;
+    pthread_mutex_init(&bulk->lock, NULL);
+    pthread_cond_init(&bulk->changed, NULL);
+}
+
+static void bulk_destroy(bulk_t* bulk) {
+    for (int k = 0; k < bulk->n; k++) {
+        free(bulk->files[k].data);
+    }
+    pthread_cond_destroy(&bulk->changed);
+    pthread_mutex_destroy(&bulk->lock);
+}
+
+static void bulk_push(bulk_t* bulk, bulk_file_t* file) {
+    pthread_mutex_lock(&bulk->lock);
+    while (bulk->count == BULK_QUEUE) {
+        pthread_cond_wait(&bulk->changed, &bulk->lock);
+    }
+    bulk->ready[(bulk->head + bulk->count++) % BULK_QUEUE] = file;
+    pthread_cond_broadcast(&bulk->changed);
+    pthread_mutex_unlock(&bulk->lock);
+}
+
+// next queued file, NULL once the queue is closed and empty
+static bulk_file_t* bulk_pop(bulk_t* bulk) {
+    pthread_mutex_lock(&bulk->lock);
+    while (bulk->count == 0 && !bulk->closed) {
+        pthread_cond_wait(&bulk->changed, &bulk->lock);
+    }
+
+    bulk_file_t* file = NULL;
+    if (bulk->count > 0) {
+        file = bulk->ready[bulk->head];
+        bulk->head = (bulk->head + 1) % BULK_QUEUE;
+        bulk->count--;
+        pthread_cond_broadcast(&bulk->changed);
+    }
+    pthread_mutex_unlock(&bulk->lock);
+    return file;
+}
+
+static void bulk_close(bulk_t* bulk) {
+    pthread_mutex_lock(&bulk->lock);
+    bulk->closed = 1;
+    pthread_cond_broadcast(&bulk->changed);
+    pthread_mutex_unlock(&bulk->lock);
+}
+
+static int bulk_find(bulk_t* bulk, const char* name) {
+    for (int k = 0; k < bulk->n; k++) {
+        if (strcmp(bulk->files[k].name, name) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// stops at the first thread that will not start, so ids[0..started) are all joinable
+static int bulk_threads(void* (*main)(void*), bulk_t* bulk, pthread_t* ids, int n) {
+    int started = 0;
+    while (started < n && pthread_create(&ids[started], NULL, main, bulk) == 0) {
+        started++;
+    }
+    return started;
+}
+
+static double bulk_seconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void bulk_progress(int k, int n, const char* name, int size, long bytes, struct timespec* start) {
+    double sec = bulk_seconds(start);
+    printf("[%d/%d] %s %d bytes, %ld so far at %.1f KB/s\n",
+           k, n, name, size, bytes, sec > 0 ? bytes / 1024.0 / sec : 0.0);
+}
+
+static void bulk_summary(const char* verb, int files, int total, long bytes, struct timespec* start) {
+    double sec = bulk_seconds(start);
+    printf("%s %d of %d files, %ld bytes in %.3f s (%.1f KB/s)\n",
+           verb, files, total, bytes, sec, sec > 0 ? bytes / 1024.0 / sec : 0.0);
+}
+
+///// IMPORT /////
+
+// collects the regular files under dir, each under its base name
+static void import_walk(bulk_t* bulk, const char* dir, int depth) {
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        printf("import: cannot read %s\n", dir);
+        return;
+    }
+
+    struct dirent* ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if (stat(path, &st) < 0) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            if (depth < BULK_DEPTH) {
+                import_walk(bulk, path, depth + 1);
+            }
+        } else if (!S_ISREG(st.st_mode)) {
+            continue;
+        } else if (strlen(ent->d_name) > FILE_NAME_MAX) {
+            printf("import: skipped %s, names are at most %d bytes\n", path, FILE_NAME_MAX);
+        } else if (bulk_find(bulk, ent->d_name) >= 0) {
+            printf("import: skipped %s, %s is already taken\n", path, ent->d_name);
+        } else if (bulk->n == BULK_FILES) {
+            printf("import: skipped %s, directory full\n", path);
+        } else {
+            bulk_file_t* file = &bulk->files[bulk->n++];
+            strcpy(file->name, ent->d_name);
+            strcpy(file->path, path);
+        }
+    }
+    closedir(d);
+}
+
+static byte* import_load(const char* path, int* size) {
+    FILE* in = fopen(path, "rb");
+    if (in == NULL) {
+        return NULL;
+    }
+
+    byte* data = NULL;
+    long len = fseek(in, 0, SEEK_END) == 0 ? ftell(in) : -1;
+    if (len >= 0 && len <= BULK_MAX_SIZE && fseek(in, 0, SEEK_SET) == 0) {
+        data = malloc(len > 0 ? len : 1);
+        if (data != NULL && (long) fread(data, 1, len, in) != len) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(in);
+
+    *size = (int) (len > INT_MAX ? INT_MAX : len);
+    return data;
+}
+
+static void* import_reader(void* arg) {
+    bulk_t* bulk = arg;
+    for (;;) {
+        int k = __atomic_fetch_add(&bulk->next, 1, __ATOMIC_RELAXED);
+        if (k >= bulk->n) {
+            return NULL;
+        }
+
+        bulk_file_t* file = &bulk->files[k];
+        file->data = import_load(file->path, &file->size);
+        bulk_push(bulk, file);
+    }
+}
+
+// creates the file and writes it in batches, NULL or why it did not go in
+static const char* import_file(dfs_t* dfs, bulk_file_t* file) {
+    if (file->data == NULL) {
+        return file->size > BULK_MAX_SIZE ? "larger than a volume" : "unreadable";
+    }
+
+    wal_entry_t entry = wal_log_create(dfs, file->name);
+    if (dfs_replicate_operation(dfs, &entry) < 0) {
+        return "exists or no descriptor left";
+    }
+
+    int handle = dfs_open(dfs, file->name);
+
+    // the whole file is reserved first, so the batches allocate nothing and
+    // a file the volume cannot hold is turned away before any of it is written
+    int reserved = handle >= 0 && dfs_fallocate(dfs, handle, file->size) == 0;
+    int written = 0;
+    while (reserved && written < file->size) {
+        int n = file->size - written < BULK_BATCH ? file->size - written : BULK_BATCH;
+        if (dfs_pwrite(dfs, handle, file->data + written, n, written) < 0) {
+            break;
+        }
+        written += n;
+    }
+
+    // a volume that fills up takes part of a write and reports no error
+    int size = -1;
+    if (handle >= 0) {
+        int node = dfs_read_node(dfs, handle);
+        int slot = dfs_node_oft(dfs, node, handle);
+        if (dfs_node(dfs, node) != NULL && slot > 0) {
+            size = dfs_node(dfs, node)->OFT[slot].file_size;
+        }
+        dfs_close(dfs, handle);
+    }
+    if (written == file->size && size == file->size) {
+        return NULL;
+    }
+
+    // no half files left behind
+    entry = wal_log_destroy(dfs, file->name);
+    dfs_replicate_operation(dfs, &entry);
+    return handle < 0 ? "cannot open" : "volume full";
+}
+
+int dfs_import(dfs_t* dfs, const char* dir, int readers) {
+    // a lagging node would keep every close from going through
+    if (dir == NULL || readers < 1 || readers > BULK_THREADS || dfs_lagging(dfs) > 0) {
+        return -1;
+    }
+
+    bulk_t* bulk = malloc(sizeof(bulk_t));
+    if (bulk == NULL) {
+        return -1;
+    }
+    bulk_init(bulk, dir);
+    import_walk(bulk, dir, 0);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t ids[BULK_THREADS];
+    int started = bulk->n > 0 ? bulk_threads(import_reader, bulk, ids, readers) : 0;
+    int imported = 0;
+    long bytes = 0;
+
+    // files arrive as readers finish them, each written while the next load
+    for (int done = 0; started > 0 && done < bulk->n; done++) {
+        bulk_file_t* file = bulk_pop(bulk);
+        const char* failure = import_file(dfs, file);
+        if (failure == NULL) {
+            imported++;
+            bytes += file->size;
+            bulk_progress(done + 1, bulk->n, file->name, file->size, bytes, &start);
+        } else {
+            printf("[%d/%d] %s from %s: %s\n", done + 1, bulk->n, file->name, file->path, failure);
+        }
+        free(file->data);
+        file->data = NULL;
+    }
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    bulk_summary("imported", imported, bulk->n, bytes, &start);
+
+    int result = bulk->n > 0 && imported == 0 ? -1 : imported;
+    bulk_destroy(bulk);
+    free(bulk);
+    return result;
+}
+
+///// EXPORT /////
+
+// every file name in the cluster, in name order
+static void export_list(dfs_t* dfs, bulk_t* bulk) {
+    char name[FILE_NAME_MAX + 1] = "";
+    while (bulk->n < BULK_FILES && dfs_next_file(dfs, name, name) == 0) {
+        strcpy(bulk->files[bulk->n++].name, name);
+    }
+}
+
+static void* export_writer(void* arg) {
+    bulk_t* bulk = arg;
+    bulk_file_t* file;
+    while ((file = bulk_pop(bulk)) != NULL) {
+        snprintf(file->path, sizeof(file->path), "%s/%s", bulk->dir, file->name);
+
+        FILE* out = fopen(file->path, "wb");
+        int ok = out != NULL && (int) fwrite(file->data, 1, file->size, out) == file->size;
+        if (out != NULL && fclose(out) != 0) {
+            ok = 0;
+        }
+        if (!ok) {
+            pthread_mutex_lock(&bulk->lock);
+            bulk->failed++;
+            pthread_mutex_unlock(&bulk->lock);
+            printf("export: cannot write %s\n", file->path);
+        }
+
+        free(file->data);
+        file->data = NULL;
+    }
+    return NULL;
+}
+
+int dfs_export(dfs_t* dfs, const char* dir, int writers) {
+    if (dir == NULL || writers < 1 || writers > BULK_THREADS) {
+        return -1;
+    }
+    struct stat st;
+    if (stat(dir, &st) < 0 ? mkdir(dir, 0755) < 0 : !S_ISDIR(st.st_mode)) {
+        return -1;
+    }
+
+    bulk_t* bulk = malloc(sizeof(bulk_t));
+    if (bulk == NULL) {
+        return -1;
+    }
+    bulk_init(bulk, dir);
+    export_list(dfs, bulk);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t ids[BULK_THREADS];
+    int started = bulk_threads(export_writer, bulk, ids, writers);
+    int read = 0;
+    long bytes = 0;
+
+    // each file is read from the cluster while writers store the ones before
+    for (int k = 0; started > 0 && k < bulk->n; k++) {
+        bulk_file_t* file = &bulk->files[k];
+        file->data = dfs_read_file(dfs, file->name, &file->size);
+        if (file->data == NULL) {
+            printf("[%d/%d] %s: cannot read\n", k + 1, bulk->n, file->name);
+            continue;
+        }
+
+        read++;
+        bytes += file->size;
+        bulk_progress(k + 1, bulk->n, file->name, file->size, bytes, &start);
+        bulk_push(bulk, file);
+    }
+
+    bulk_close(bulk);
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    bulk_summary("exported", read - bulk->failed, bulk->n, bytes, &start);
+
+    int result = started == 0 || (bulk->n > 0 && read == bulk->failed) ? -1 : read - bulk->failed;
+    bulk_destroy(bulk);
+    free(bulk);
+    return result;
+}
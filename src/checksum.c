@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "checksum.h"
+#include "block.h"
+
+///// CRC32C /////
+
+#define CRC32C_POLY 0x82f63b78u  // Castagnoli, reflected
+
+static uint32_t crc_table[8][256];
+static uint32_t (*crc_impl)(uint32_t crc, const byte* p, int len);
+static const char* crc_impl_name;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_sw(uint32_t crc, const byte* p, int len) {
+    crc = ~crc;
+
+    // eight bytes per step, one table per byte position
+    while (len >= 8) {
+        uint32_t lo = (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24)) ^ crc;
+        uint32_t hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t) p[7] << 24);
+        crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+              crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+              crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+
+#if defined(__x86_64__)
+// the crc32 instruction has a 3 cycle latency but issues every cycle, so three
+// independent lanes keep it busy; the lane sums are joined by advancing each
+// over the bytes that follow it
+#define CRC_LANE 168
+
+static uint32_t crc_lane_shift[4][256];  // register advanced over CRC_LANE zero bytes
+
+static uint32_t crc_shift(uint32_t reg) {
+    return crc_lane_shift[0][reg & 0xff] ^ crc_lane_shift[1][(reg >> 8) & 0xff] ^
+           crc_lane_shift[2][(reg >> 16) & 0xff] ^ crc_lane_shift[3][reg >> 24];
+}
+#endif
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const byte* p, int len) {
+    crc = ~crc;
+#if defined(__x86_64__)
+    while (len >= 3 * CRC_LANE) {
+        uint64_t a = crc;
+        uint64_t b = 0;
+        uint64_t c = 0;
+        for (int k = 0; k < CRC_LANE; k += 8) {
+            uint64_t va, vb, vc;
+            memcpy(&va, p + k, 8);
+            memcpy(&vb, p + CRC_LANE + k, 8);
+            memcpy(&vc, p + 2 * CRC_LANE + k, 8);
+            a = _mm_crc32_u64(a, va);
+            b = _mm_crc32_u64(b, vb);
+            c = _mm_crc32_u64(c, vc);
+        }
+        crc = crc_shift(crc_shift((uint32_t) a) ^ (uint32_t) b) ^ (uint32_t) c;
+        p += 3 * CRC_LANE;
+        len -= 3 * CRC_LANE;
+    }
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = (uint32_t) _mm_crc32_u64(crc, v);
+        p += 8;
+        len -= 8;
+    }
+#endif
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return ~crc;
+}
+#endif
+
+static void crc32c_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+        }
+        crc_table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = crc_table[t - 1][i];
+            crc_table[t][i] = (prev >> 8) ^ crc_table[0][prev & 0xff];
+        }
+    }
+
+    crc_impl = crc32c_sw;
+    crc_impl_name = "slicing-by-8";
+#if defined(__x86_64__)
+    for (int k = 0; k < 4; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t reg = (uint32_t) i << (8 * k);
+            for (int n = 0; n < CRC_LANE; n++) {
+                reg = crc_table[0][reg & 0xff] ^ (reg >> 8);
+            }
+            crc_lane_shift[k][i] = reg;
+        }
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc_impl = crc32c_sse42;
+        crc_impl_name = "sse4.2";
+    }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, int len) {
+    pthread_once(&crc_once, crc32c_init);
+    return crc_impl(crc, data, len);
+}
+
+const char* crc32c_impl(void) {
+    pthread_once(&crc_once, crc32c_init);
+    return crc_impl_name;
+}
+
+///// BLOCK SUMS /////
+
+int checksum_enable(fs_node_t* fs) {
+    if (fs->sums != NULL) {
+        return 0;
+    }
+
+    checksum_t* sums = calloc(1, sizeof(checksum_t));
+    if (sums == NULL) {
+        return -1;
+    }
+
+    // whatever is on the volume now is taken as good
+    byte data[BLOCK_SIZE];
+    for (int b = 0; b < N_BLOCKS; b++) {
+        if (block_read(fs, b, data) < 0) {
+            free(sums);
+            return -1;
+        }
+        sums->crc[b] = crc32c(0, data, BLOCK_SIZE);
+        sums->state[b] = SUM_KNOWN | SUM_CHECKED;
+    }
+
+    fs->sums = sums;
+    return 0;
+}
+
+void checksum_disable(fs_node_t* fs) {
+    free(fs->sums);
+    fs->sums = NULL;
+}
+
+int checksum_verify(fs_node_t* fs, int block, const byte* data) {
+    checksum_t* sums = fs->sums;
+    if (sums == NULL || sums->state[block] != SUM_KNOWN) {
+        return 0;  // off, unknown, already checked or mid-write
+    }
+
+    sums->verified++;
+    if (crc32c(0, data, BLOCK_SIZE) != sums->crc[block]) {
+        sums->mismatches++;
+        return -1;
+    }
+
+    sums->state[block] |= SUM_CHECKED;
+    return 0;
+}
+
+int checksum_loaded(fs_node_t* fs, int block, const byte* data) {
+    if (fs->sums == NULL) {
+        return 0;
+    }
+
+    fs->sums->state[block] &= ~SUM_CHECKED;
+    return checksum_verify(fs, block, data);
+}
+
+void checksum_unpinned(fs_node_t* fs, int block, const byte* data, int pins_left, int dirty) {
+    checksum_t* sums = fs->sums;
+    if (sums == NULL) {
+        return;
+    }
+
+    if (dirty) {
+        sums->state[block] |= SUM_STALE;
+    }
+    if (pins_left == 0 && (sums->state[block] & SUM_STALE)) {
+        checksum_update(fs, block, data);
+    }
+}
+
+void checksum_update(fs_node_t* fs, int block, const byte* data) {
+    if (fs->sums != NULL) {
+        fs->sums->crc[block] = crc32c(0, data, BLOCK_SIZE);
+        fs->sums->state[block] = SUM_KNOWN | SUM_CHECKED;
+    }
+}
+
+void checksum_forget(fs_node_t* fs, int block) {
+    if (fs->sums != NULL && block >= 0 && block < N_BLOCKS) {
+        fs->sums->state[block] = 0;
+    }
+}
+
+void checksum_stats(fs_node_t* fs) {
+    checksum_t* sums = fs->sums;
+    if (sums == NULL) {
+        printf("checksums off\n");
+        return;
+    }
+
+    printf("crc32c (%s): %ld blocks verified, %ld mismatches, %ld repaired\n",
+           crc32c_impl(), sums->verified, sums->mismatches, sums->repaired);
+}
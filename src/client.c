@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "client.h"
+
+static void client_drop(client_file_t* file) {
+    free(file->data);
+    memset(file, 0, sizeof(client_file_t));
+}
+
+static client_file_t* client_find(client_t* client, const char* name) {
+    for (int k = 0; k < CLIENT_FILES; k++) {
+        if (client->files[k].name[0] != '\0' && strcmp(client->files[k].name, name) == 0) {
+            return &client->files[k];
+        }
+    }
+    return NULL;
+}
+
+// called under dfs->lock by the commit of a write to or destroy of name
+static void client_revoked(void* arg, const char* name) {
+    client_t* client = arg;
+    client_file_t* file = client_find(client, name);
+    if (file != NULL) {
+        client_drop(file);
+        client->revocations++;
+    }
+}
+
+int client_setup(client_t* client, dfs_t* dfs) {
+    memset(client, 0, sizeof(client_t));
+    client->dfs = dfs;
+    client->id = lease_register(&dfs->leases, client_revoked, client);
+    return client->id < 0 ? -1 : 0;
+}
+
+void client_teardown(client_t* client) {
+    lease_unregister(&client->dfs->leases, client->id);
+    for (int k = 0; k < CLIENT_FILES; k++) {
+        client_drop(&client->files[k]);
+    }
+}
+
+static int client_copy(void* buf, const byte* data, int size, int n, int offset) {
+    int bytes = offset < size ? (n < size - offset ? n : size - offset) : 0;
+    if (bytes > 0) {
+        memcpy(buf, data + offset, bytes);
+    }
+    return bytes;
+}
+
+int client_read(client_t* client, const char* name, void* buf, int n, int offset) {
+    if (client == NULL || name == NULL || strlen(name) > FILE_NAME_MAX || name[0] == '\0' ||
+        buf == NULL || n < 0 || offset < 0) {
+        return -1;
+    }
+
+    client_file_t* file = client_find(client, name);
+
+    if (file != NULL && file->expires > lease_now()) {
+        client->hits++;
+    } else {
+        client->misses++;
+        if (file != NULL) {
+            client_drop(file);  // lapsed, the lease may be gone
+        }
+
+        int size;
+        byte* data = dfs_read_file(client->dfs, name, &size);
+        if (data == NULL) {
+            return -1;
+        }
+
+        // without a lease the copy only serves this read
+        long expires = lease_grant(&client->dfs->leases, client->id, name);
+        if (expires < 0) {
+            int bytes = client_copy(buf, data, size, n, offset);
+            free(data);
+            return bytes;
+        }
+
+        // the free entry or else the least recently used
+        file = &client->files[0];
+        for (int k = 0; k < CLIENT_FILES && file->name[0] != '\0'; k++) {
+            if (client->files[k].name[0] == '\0' || client->files[k].last_use < file->last_use) {
+                file = &client->files[k];
+            }
+        }
+        if (file->name[0] != '\0') {
+            lease_release(&client->dfs->leases, client->id, file->name);
+            client_drop(file);
+        }
+
+        strcpy(file->name, name);
+        file->data = data;
+        file->size = size;
+        file->expires = expires;
+    }
+
+    file->last_use = ++client->tick;
+    return client_copy(buf, file->data, file->size, n, offset);
+}
+
+void client_stats(client_t* client) {
+    int cached = 0;
+    long bytes = 0;
+    for (int k = 0; k < CLIENT_FILES; k++) {
+        if (client->files[k].name[0] != '\0') {
+            cached++;
+            bytes += client->files[k].size;
+        }
+    }
+
+    printf("client %d: %d files cached (%ld bytes), %ld hits, %ld misses, %ld revocations\n",
+           client->id, cached, bytes, client->hits, client->misses, client->revocations);
+}
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "compress.h"
+
+///// NO-OP CODEC /////
+
+static int none_copy(const byte* src, int len, byte* dst, int cap) {
+    if (len > cap) {
+        return -1;
+    }
+    memcpy(dst, src, len);
+    return len;
+}
+
+///// LZ CODEC /////
+// LZ77 in the LZ4 block layout: each sequence is a token (literal count in the
+// high nibble, match length - 4 in the low one, 15 meaning more bytes follow),
+// the literals, then a 2 byte offset back into the output. The last sequence
+// carries literals only
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xffff
+
+static uint32_t lz_read32(const byte* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static int lz_hash(uint32_t seq) {
+    return (int) ((seq * 2654435761u) >> (32 - LZ_HASH_BITS));
+}
+
+// extra length bytes for a nibble that overflowed
+static int lz_put_length(byte* dst, int op, int cap, int n) {
+    for (; n >= 255; n -= 255) {
+        if (op >= cap) return -1;
+        dst[op++] = 255;
+    }
+    if (op >= cap) return -1;
+    dst[op++] = (byte) n;
+    return op;
+}
+
+static int lz_get_length(const byte* src, int* ip, int len, int n) {
+    int b = 255;
+    while (b == 255) {
+        if (*ip >= len) return -1;
+        b = src[(*ip)++];
+        n += b;
+    }
+    return n;
+}
+
+// one sequence; match_len 0 ends the stream with literals only
+static int lz_emit(byte* dst, int op, int cap, const byte* lit, int lit_len, int offset, int match_len) {
+    if (op >= cap) return -1;
+
+    int token = op++;
+    int m = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+    dst[token] = (byte) (((lit_len < 15 ? lit_len : 15) << 4) | (m < 15 ? m : 15));
+
+    if (lit_len >= 15 && (op = lz_put_length(dst, op, cap, lit_len - 15)) < 0) return -1;
+
+    if (op + lit_len > cap) return -1;
+    memcpy(dst + op, lit, lit_len);
+    op += lit_len;
+
+    if (match_len == 0) return op;
+
+    if (op + 2 > cap) return -1;
+    dst[op++] = offset & 0xff;
+    dst[op++] = (offset >> 8) & 0xff;
+
+    if (m >= 15 && (op = lz_put_length(dst, op, cap, m - 15)) < 0) return -1;
+    return op;
+}
+
+static int lz_compress(const byte* src, int len, byte* dst, int cap) {
+    int table[1 << LZ_HASH_BITS];  // last position + 1 seen for each hash, 0 empty
+    memset(table, 0, sizeof(table));
+
+    int anchor = 0;
+    int ip = 0;
+    int op = 0;
+
+    while (ip + LZ_MIN_MATCH <= len) {
+        uint32_t seq = lz_read32(src + ip);
+        int h = lz_hash(seq);
+        int candidate = table[h] - 1;
+        table[h] = ip + 1;
+
+        if (candidate < 0 || ip - candidate > LZ_MAX_OFFSET || lz_read32(src + candidate) != seq) {
+            ip++;
+            continue;
+        }
+
+        int match_len = LZ_MIN_MATCH;
+        while (ip + match_len < len && src[candidate + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+
+        op = lz_emit(dst, op, cap, src + anchor, ip - anchor, ip - candidate, match_len);
+        if (op < 0) return -1;
+
+        ip += match_len;
+        anchor = ip;
+    }
+
+    return lz_emit(dst, op, cap, src + anchor, len - anchor, 0, 0);
+}
+
+static int lz_decompress(const byte* src, int len, byte* dst, int cap) {
+    int ip = 0;
+    int op = 0;
+
+    while (ip < len) {
+        int token = src[ip++];
+
+        int lit_len = token >> 4;
+        if (lit_len == 15 && (lit_len = lz_get_length(src, &ip, len, lit_len)) < 0) return -1;
+        if (ip + lit_len > len || op + lit_len > cap) return -1;
+
+        memcpy(dst + op, src + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip >= len) break;  // literals-only sequence ends the stream
+
+        if (ip + 2 > len) return -1;
+        int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return -1;
+
+        int match_len = token & 15;
+        if (match_len == 15 && (match_len = lz_get_length(src, &ip, len, match_len)) < 0) return -1;
+        match_len += LZ_MIN_MATCH;
+        if (op + match_len > cap) return -1;
+
+        // byte at a time, matches may overlap the bytes they produce
+        for (int k = 0; k < match_len; k++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return op;
+}
+
+static const codec_t codecs[CODEC_COUNT] = {
+    [CODEC_NONE] = { "none", none_copy, none_copy },
+    [CODEC_LZ] = { "lz", lz_compress, lz_decompress },
+};
+
+const codec_t* codec_get(int id) {
+    if (id < 0 || id >= CODEC_COUNT) {
+        return NULL;
+    }
+    return &codecs[id];
+}
+
+int codec_find(const char* name) {
+    for (int id = 0; id < CODEC_COUNT; id++) {
+        if (strcmp(codecs[id].name, name) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+///// PAYLOADS /////
+
+void compressor_init(compressor_t* z, int codec) {
+    memset(z, 0, sizeof(compressor_t));
+    z->codec = codec;
+}
+
+payload_t* compressor_pack(compressor_t* z, payload_t* raw) {
+    if (raw == NULL) {
+        return NULL;
+    }
+
+    z->payloads++;
+    z->bytes_in += raw->len;
+
+    if (z->codec == CODEC_NONE || raw->codec != CODEC_NONE || raw->len < COMPRESS_MIN_LEN) {
+        z->bytes_out += raw->len;
+        return payload_ref(raw);
+    }
+
+    // data that keeps failing to compress is sent raw for a growing stretch
+    if (z->skip_left > 0) {
+        z->skip_left--;
+        z->skipped++;
+        z->bytes_out += raw->len;
+        return payload_ref(raw);
+    }
+
+    int cap = raw->len - raw->len / COMPRESS_MIN_GAIN;
+    payload_t* packed = payload_alloc(cap);
+    if (packed == NULL) {
+        z->bytes_out += raw->len;
+        return payload_ref(raw);
+    }
+
+    clock_t start = clock();
+    int len = codec_get(z->codec)->compress(raw->data, raw->len, packed->data, cap);
+    z->compress_clock += clock() - start;
+
+    if (len < 0) {
+        payload_release(packed);
+
+        z->rejected++;
+        if (z->misses < 6) z->misses++;
+        z->skip_left = (1 << z->misses) < COMPRESS_MAX_BACKOFF ? (1 << z->misses) : COMPRESS_MAX_BACKOFF;
+        z->bytes_out += raw->len;
+        return payload_ref(raw);
+    }
+
+    z->misses = 0;
+    z->packed++;
+    z->bytes_out += len;
+
+    packed->len = len;
+    packed->raw_len = raw->len;
+    packed->codec = z->codec;
+    return packed;
+}
+
+int payload_unpack(const payload_t* p, byte* dst) {
+    const codec_t* codec = codec_get(p->codec);
+    if (codec == NULL) {
+        return -1;
+    }
+
+    int len = codec->decompress(p->data, p->len, dst, p->raw_len);
+    return len == p->raw_len ? len : -1;
+}
+
+void compressor_stats(const compressor_t* z) {
+    double ratio = z->bytes_out > 0 ? (double) z->bytes_in / z->bytes_out : 1.0;
+
+    printf("compression %s: %ld payloads, %ld packed, %ld rejected, %ld skipped\n",
+           codec_get(z->codec)->name, z->payloads, z->packed, z->rejected, z->skipped);
+    printf("%ld bytes in, %ld bytes logged (%.2fx), %.3f s compressing\n",
+           z->bytes_in, z->bytes_out, ratio, (double) z->compress_clock / CLOCKS_PER_SEC);
+}
+
+///// BENCHMARK /////
+
+#define BENCH_LEN (64 * 1024)
+
+// log-like records: a fixed template with a few changing fields
+static void bench_template(byte* buf, int len) {
+    int n = 0;
+    for (int k = 0; n < len; k++) {
+        char line[128];
+        int w = snprintf(line, sizeof(line),
+                         "{\"id\":%d,\"node\":%d,\"op\":\"write\",\"status\":\"ok\",\"bytes\":%d}\n",
+                         k, k % 3, (k * 37) % 4096);
+        if (w > len - n) w = len - n;
+        memcpy(buf + n, line, w);
+        n += w;
+    }
+}
+
+static void bench_random(byte* buf, int len) {
+    uint32_t x = 2463534242u;
+    for (int k = 0; k < len; k++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[k] = (byte) x;
+    }
+}
+
+static void bench_codec(const codec_t* codec, const char* sample, const byte* src, int rounds) {
+    static byte packed[2 * BENCH_LEN];
+    static byte out[BENCH_LEN];
+
+    int len = 0;
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        len = codec->compress(src, BENCH_LEN, packed, sizeof(packed));
+    }
+    double c_sec = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    int ok = len >= 0;
+    start = clock();
+    for (int r = 0; ok && r < rounds; r++) {
+        ok = codec->decompress(packed, len, out, BENCH_LEN) == BENCH_LEN;
+    }
+    double d_sec = (double) (clock() - start) / CLOCKS_PER_SEC;
+    ok = ok && memcmp(src, out, BENCH_LEN) == 0;
+
+    double mb = (double) BENCH_LEN * rounds / (1024 * 1024);
+    printf("%-5s %-9s %6d -> %6d bytes (%.2fx)  compress %8.1f MB/s  decompress %8.1f MB/s%s\n",
+           codec->name, sample, BENCH_LEN, len, len > 0 ? (double) BENCH_LEN / len : 0.0,
+           c_sec > 0 ? mb / c_sec : 0.0, d_sec > 0 ? mb / d_sec : 0.0, ok ? "" : "  MISMATCH");
+}
+
+void compress_bench(int rounds) {
+    static byte templated[BENCH_LEN];
+    static byte random[BENCH_LEN];
+    bench_template(templated, BENCH_LEN);
+    bench_random(random, BENCH_LEN);
+
+    for (int id = 0; id < CODEC_COUNT; id++) {
+        bench_codec(&codecs[id], "templated", templated, rounds);
+        bench_codec(&codecs[id], "random", random, rounds);
+    }
+}
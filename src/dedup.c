@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "dedup.h"
+#include "block.h"
+
+int dedup_enable(fs_node_t* fs) {
+    if (fs->dedup != NULL) {
+        return 0;
+    }
+
+    dedup_t* dedup = calloc(1, sizeof(dedup_t));
+    if (dedup == NULL) {
+        return -1;
+    }
+    for (int s = 0; s < DEDUP_TABLE_SIZE; s++) {
+        dedup->table[s].block = -1;
+    }
+
+    // blocks already allocated start with a single owner
+    byte bitmap[BLOCK_SIZE];
+    if (block_read(fs, 0, bitmap) < 0) {
+        free(dedup);
+        return -1;
+    }
+    for (int b = 0; b < N_BLOCKS; b++) {
+        dedup->refs[b] = (bitmap[BIT_MAP_BLOCK(b)] >> BIT_MAP_OFFSET(b)) & 0x1;
+    }
+
+    fs->dedup = dedup;
+    return 0;
+}
+
+void dedup_disable(fs_node_t* fs) {
+    free(fs->dedup);
+    fs->dedup = NULL;
+}
+
+static int table_home(fingerprint_t fp) {
+    return (int) (fp.lo % DEDUP_TABLE_SIZE);
+}
+
+int dedup_find(fs_node_t* fs, fingerprint_t fp) {
+    dedup_t* dedup = fs->dedup;
+    if (dedup == NULL) {
+        return -1;
+    }
+
+    int s = table_home(fp);
+    for (int n = 0; n < DEDUP_TABLE_SIZE; n++) {
+        dedup_slot_t* slot = &dedup->table[s];
+        if (slot->block == -1) {
+            return -1;
+        }
+        if (slot->block >= 0 && fingerprint_equal(slot->fp, fp)) {
+            return slot->block;
+        }
+        s = (s + 1) % DEDUP_TABLE_SIZE;
+    }
+    return -1;
+}
+
+void dedup_remove(fs_node_t* fs, int block) {
+    dedup_t* dedup = fs->dedup;
+    if (dedup == NULL || !dedup->indexed[block]) {
+        return;
+    }
+
+    int s = table_home(dedup->block_fp[block]);
+    for (int n = 0; n < DEDUP_TABLE_SIZE; n++) {
+        dedup_slot_t* slot = &dedup->table[s];
+        if (slot->block == -1) {
+            break;
+        }
+        if (slot->block == block) {
+            slot->block = -2;
+            break;
+        }
+        s = (s + 1) % DEDUP_TABLE_SIZE;
+    }
+    dedup->indexed[block] = 0;
+}
+
+// block now holds content fp, replacing whatever it was indexed as
+void dedup_insert(fs_node_t* fs, int block, fingerprint_t fp) {
+    dedup_t* dedup = fs->dedup;
+    if (dedup == NULL) {
+        return;
+    }
+
+    dedup_remove(fs, block);
+    if (dedup_find(fs, fp) != -1) {
+        return;  // another block already stands for this content
+    }
+
+    int s = table_home(fp);
+    for (int n = 0; n < DEDUP_TABLE_SIZE; n++) {
+        dedup_slot_t* slot = &dedup->table[s];
+        if (slot->block < 0) {
+            slot->fp = fp;
+            slot->block = block;
+            dedup->block_fp[block] = fp;
+            dedup->indexed[block] = 1;
+            return;
+        }
+        s = (s + 1) % DEDUP_TABLE_SIZE;
+    }
+}
+
+int dedup_indexed_as(fs_node_t* fs, int block, fingerprint_t fp) {
+    dedup_t* dedup = fs->dedup;
+    return dedup != NULL && dedup->indexed[block] && fingerprint_equal(dedup->block_fp[block], fp);
+}
+
+int dedup_refs(fs_node_t* fs, int block) {
+    return fs->dedup != NULL ? fs->dedup->refs[block] : 1;
+}
+
+// freshly allocated block with a single owner
+void dedup_track(fs_node_t* fs, int block) {
+    if (fs->dedup != NULL) {
+        dedup_remove(fs, block);
+        fs->dedup->refs[block] = 1;
+    }
+}
+
+void dedup_ref(fs_node_t* fs, int block) {
+    if (fs->dedup != NULL) {
+        fs->dedup->refs[block]++;
+        fs->dedup->shared++;
+    }
+}
+
+// drops one owner, returns how many remain
+int dedup_unref(fs_node_t* fs, int block) {
+    dedup_t* dedup = fs->dedup;
+    if (dedup == NULL) {
+        return 0;
+    }
+
+    if (dedup->refs[block] > 0) {
+        dedup->refs[block]--;
+    }
+    if (dedup->refs[block] == 0) {
+        dedup_remove(fs, block);
+    }
+    return dedup->refs[block];
+}
+
+void dedup_stats(fs_node_t* fs) {
+    dedup_t* dedup = fs->dedup;
+    if (dedup == NULL) {
+        printf("dedup off\n");
+        return;
+    }
+
+    int indexed = 0;
+    long references = 0;
+    int in_use = 0;
+    for (int b = 0; b < N_BLOCKS; b++) {
+        indexed += dedup->indexed[b];
+        references += dedup->refs[b];
+        in_use += dedup->refs[b] > 0;
+    }
+
+    printf("dedup: %d blocks indexed, %ld references on %d blocks (%ld saved), %ld shared, %ld copy-on-write\n",
+           indexed, references, in_use, references - in_use, dedup->shared, dedup->cow_copies);
+}
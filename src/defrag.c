@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "dfs.h"
+#include "efs.h"
+#include "wal.h"
+
+int dfs_defragment(dfs_t* dfs, const char* name) {
+    wal_entry_t entry = wal_log_defrag(dfs, name);
+    return dfs_replicate_operation(dfs, &entry);
+}
+
+// looks for the next scattered file from the cursor on and logs its
+// defragmentation; a node whose directory is done hands over to the next
+static void defrag_step(dfs_t* dfs) {
+    defragmenter_t* defrag = &dfs->defrag;
+    fs_node_t* fs = dfs->file_systems[defrag->node];
+    char name[FILE_NAME_MAX + 1];
+
+    if (fs == NULL || fragmented_file(fs, defrag->last, name) == -1) {
+        defrag->last[0] = '\0';
+        defrag->node = (defrag->node + 1) % MAX_NODES;
+        return;
+    }
+
+    strcpy(defrag->last, name);
+    if (dfs_defragment(dfs, name) == 0) {
+        defrag->files++;
+    }
+}
+
+// one file per step, the lock is only held for that file
+static void* defrag_main(void* arg) {
+    dfs_t* dfs = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&dfs->lock);
+        defragmenter_t* defrag = &dfs->defrag;
+        if (defrag->stop) {
+            pthread_mutex_unlock(&dfs->lock);
+            return NULL;
+        }
+
+        // entries appended since the last step are foreground traffic, the
+        // moves wait for a quiet interval
+        int seq = __atomic_load_n(&dfs->global_sequence_counter, __ATOMIC_RELAXED);
+        if (seq != defrag->seen) {
+            defrag->deferred++;
+        } else {
+            defrag_step(dfs);
+        }
+        defrag->seen = __atomic_load_n(&dfs->global_sequence_counter, __ATOMIC_RELAXED);
+
+        long pause_ns = 1000000000L / defrag->rate;
+        pthread_mutex_unlock(&dfs->lock);
+
+        struct timespec pause = { pause_ns / 1000000000L, pause_ns % 1000000000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+// caller holds dfs->lock
+int dfs_defrag_start(dfs_t* dfs, int rate) {
+    if (rate < 1) {
+        return -1;
+    }
+
+    if (dfs->defrag.stop) {
+        return -1;  // another caller is still waiting for it to exit
+    }
+
+    dfs->defrag.rate = rate;
+    if (dfs->defrag.running) {
+        return 0;  // still going, picks up the new rate
+    }
+
+    dfs->defrag.seen = __atomic_load_n(&dfs->global_sequence_counter, __ATOMIC_RELAXED);
+    if (pthread_create(&dfs->defrag.thread, NULL, defrag_main, dfs) != 0) {
+        return -1;
+    }
+    dfs->defrag.running = 1;
+    return 0;
+}
+
+// caller holds dfs->lock, which is let go while the thread finishes its step
+void dfs_defrag_stop(dfs_t* dfs) {
+    if (!dfs->defrag.running || dfs->defrag.stop) {
+        return;
+    }
+
+    dfs->defrag.stop = 1;
+    pthread_mutex_unlock(&dfs->lock);
+    pthread_join(dfs->defrag.thread, NULL);
+    pthread_mutex_lock(&dfs->lock);
+    dfs->defrag.running = 0;
+    dfs->defrag.stop = 0;
+}
+
+void dfs_defrag_stats(dfs_t* dfs) {
+    defragmenter_t* defrag = &dfs->defrag;
+    printf("defragmenter %s at %d files/s: %ld files defragmented, %ld steps deferred\n",
+           defrag->running && !defrag->stop ? "running" : "stopped", defrag->rate,
+           defrag->files, defrag->deferred);
+}
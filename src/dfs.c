@@ -1,38 +1,728 @@
 #include "dfs.h"
 #include "efs.h"
 #include "wal.h"
+#include "block.h"
+#include "dedup.h"
+#include "checksum.h"
+#include "merkle.h"
+#include "client.h"
+#include "tier.h"
+#include "dir.h"
+#include "sim.h"
+#include "apply.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
 
 
-int dfs_replication_operation(dfs_t* dfs, wal_entry_t* entry) {
-    if (dfs == NULL || entry == NULL) {
-        return -1;
+void dfs_account_replication(dfs_t* dfs, fs_node_t* follower, wal_entry_t* entry) {
+    payload_t* data = NULL;
+    int offset = 0;
+
+    if (entry->op_type == OP_WRITE) {
+        data = entry->params.write_params.data;
+        offset = -1;  // written at the file position, alignment unknown
+    } else if (entry->op_type == OP_PWRITE) {
+        data = entry->params.pwrite_params.data;
+        offset = entry->params.pwrite_params.offset;
     }
-    
-    // Apply the operation to all nodes
-    for (int i = 0; i < NUM_NODES; i++) {
-        int result = wal_apply_entry(&dfs->file_systems[i], i, entry);
+    if (data == NULL) {
+        return;
+    }
+
+    // packed payloads travel as they are
+    if (data->codec != CODEC_NONE) {
+        __atomic_add_fetch(&dfs->replication_bytes, data->len, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // apply workers account for their followers side by side
+    long bytes = 0;
+    long by_hash = 0;
+    int k = 0;
+    while (k < data->len) {
+        if (offset >= 0 && (offset + k) % BLOCK_SIZE == 0 && data->len - k >= BLOCK_SIZE &&
+            dedup_find(follower, fingerprint(data->data + k, BLOCK_SIZE)) != -1) {
+            bytes += sizeof(fingerprint_t);
+            by_hash++;
+            k += BLOCK_SIZE;
+        } else {
+            bytes++;
+            k++;
+        }
+    }
+    __atomic_add_fetch(&dfs->replication_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dfs->replication_by_hash, by_hash, __ATOMIC_RELAXED);
+}
+
+static int replicate_entry(dfs_t* dfs, wal_entry_t* entry) {
+    // Apply the operation to every node holding the file, the shard leader first
+    int nodes[MAX_NODES];
+    int count = dfs_entry_nodes(dfs, entry, nodes);
+    int holds[MAX_NODES] = { 0 };
+    int applied = 0;
+
+    for (int k = 0; k < count; k++) {
+        int i = nodes[k];
+        holds[i] = 1;
+        if (dfs->nodes[i].status == LAGGING) {
+            continue;  // logged all the same, applied when it catches up
+        }
+        if (k > 0) {
+            dfs_account_replication(dfs, dfs->file_systems[i], entry);
+        }
+
+        wal_entry_t local;
+        int result = dfs_entry_local(dfs, entry, i, &local);
+        if (result == 0) {
+            result = wal_apply_entry(dfs->file_systems[i], i, &local);
+        }
         
         if (result < 0) {
+            // refused by the first node to see it, so a no-op on every one
+            for (int j = 0; j < count; j++) {
+                if (applied == 0 || j == k) {
+                    wal_mark_failed(dfs->file_systems[nodes[j]], entry->sequence_number);
+                }
+            }
             printf("Failed to replicate to node %d\n", i);
             return -1;  // Fail if any node fails
         }
+        if (applied == 0 && local.in_place) {
+            // full replicas lay out alike, so what the first node saw holds for every log
+            for (int j = 0; j < count; j++) {
+                wal_mark_in_place(dfs->file_systems[nodes[j]], entry->sequence_number);
+            }
+        }
+        applied++;
     }
-    
+
+    // nodes outside the shard have nothing to apply and count as caught up
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        if (!holds[i]) {
+            dfs->file_systems[i]->applied_sequence = entry->sequence_number;
+        }
+    }
+
+    dfs_commit_entry(dfs, entry);
     return 0;  // All nodes succeeded
 }
 
+void dfs_commit_entry(dfs_t* dfs, wal_entry_t* entry) {
+    // cached copies of the file are stale once the change commits
+    if (entry->op_type == OP_WRITE || entry->op_type == OP_PWRITE || entry->op_type == OP_DESTROY) {
+        lease_revoke(&dfs->leases, entry->key);
+    }
+
+    if ((entry->sequence_number + 1) % CHECK_POINT_INTERVAL == 0) {
+        dfs_checkpoint(dfs);
+    }
+
+    int interval = dfs->anti_entropy.interval;
+    if (interval > 0 && (entry->sequence_number + 1) % interval == 0) {
+        dfs_anti_entropy(dfs);
+    }
+}
+
+// takes queued entries in sequence order through seq, and any published
+// behind it, logging and applying each; caller holds dfs->lock
+static void dfs_drain(dfs_t* dfs, int seq) {
+    wal_queue_t* q = dfs->queue;
+    wal_entry_t* entry = wal_queue_peek(q, q->next);
+    if (q->next > seq && entry == NULL) {
+        return;
+    }
+
+    q->drains++;
+    while (q->next <= seq || entry != NULL) {
+        if (entry == NULL) {
+            // reserved, its producer is still filling it in and may be waiting
+            // for a slot a lap back that only a result frees
+            apply_flush(dfs);
+            sched_yield();
+        } else {
+            int result = wal_log_nodes(dfs, entry);
+            if (result == 0 && dfs->applier != NULL) {
+                apply_dispatch(dfs, entry);  // the result is left once its copies are in
+                q->next++;
+            } else {
+                if (result == 0) {
+                    result = replicate_entry(dfs, entry);
+                }
+                wal_queue_done(q, q->next++, result);
+            }
+            q->drained++;
+        }
+        entry = wal_queue_peek(q, q->next);
+    }
+    apply_flush(dfs);
+}
+
+int dfs_drain_published(dfs_t* dfs) {
+    long before = dfs->queue->drained;
+    dfs_drain(dfs, dfs->queue->next - 1);
+    return (int) (dfs->queue->drained - before);
+}
+
+int dfs_replicate_operation(dfs_t* dfs, wal_entry_t* entry) {
+    if (dfs == NULL || entry == NULL || entry->sequence_number < 0) {
+        return -1;
+    }
+
+    dfs_drain(dfs, entry->sequence_number);
+
+    int result = -1;
+    wal_queue_collect(dfs->queue, entry->sequence_number, &result);
+    return result;
+}
+
+// entries every node has applied are already reflected in its blocks,
+// so logs are cut back to the low water mark and their payloads freed
+void dfs_checkpoint(dfs_t* dfs) {
+    int low_water_mark = INT_MAX;
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] != NULL && dfs->file_systems[i]->applied_sequence < low_water_mark) {
+            low_water_mark = dfs->file_systems[i]->applied_sequence;
+        }
+    }
+
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        wal_truncate(dfs->file_systems[i], low_water_mark);
+        block_sync(dfs->file_systems[i]);
+        dfs->file_systems[i]->last_checkpoint = time(NULL);
+    }
+}
+
+// each node gets its own volume file in dir and a cache of cache_slots blocks,
+// at least CACHE_MIN_SLOTS; volumes are formatted fresh
+int dfs_attach_storage(dfs_t* dfs, const char* dir, int cache_slots) {
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        char path[256];
+        snprintf(path, sizeof(path), "%s/node%d.vol", dir, i);
+
+        if (block_open_file(dfs->file_systems[i], path, cache_slots) < 0) {
+            return -1;
+        }
+        init(dfs->file_systems[i]);
+    }
+    return 0;
+}
+
+int dfs_attach_tiers(dfs_t* dfs, const char* dir, int hot_blocks) {
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        char path[256];
+        snprintf(path, sizeof(path), "%s/node%d.cold", dir, i);
+
+        if (tier_open(dfs->file_systems[i], path, hot_blocks) < 0) {
+            return -1;
+        }
+        init(dfs->file_systems[i]);
+    }
+    return 0;
+}
+
+int dfs_enable_dedup(dfs_t* dfs) {
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        if (dedup_enable(dfs->file_systems[i]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+///// NODE REGISTRY /////
+
+fs_node_t* dfs_node(dfs_t* dfs, int node_id) {
+    if (node_id < 0 || node_id >= MAX_NODES) {
+        return NULL;
+    }
+    return dfs->file_systems[node_id];
+}
+
+// formatted node with an empty log under id
+static fs_node_t* node_attach(dfs_t* dfs, int id) {
+    fs_node_t* fs = pool_alloc(&dfs->node_pool);
+    if (fs == NULL) {
+        return NULL;
+    }
+    memset(fs, 0, sizeof(fs_node_t));
+    fs->wal_slab = &dfs->wal_slab;
+
+    if (init(fs) < 0) {
+        pool_free(&dfs->node_pool, fs);
+        return NULL;
+    }
+    wal_init(fs);
+    fs->applied_sequence = dfs->queue->next - 1;
+
+    dfs->file_systems[id] = fs;
+    dfs->nodes[id].node_id = id;
+    dfs->nodes[id].status = ACTIVE;
+    dfs->node_count++;
+    return fs;
+}
+
+static void node_detach(dfs_t* dfs, int id) {
+    fs_node_t* fs = dfs->file_systems[id];
+
+    wal_truncate(fs, INT_MAX);
+    dedup_disable(fs);
+    checksum_disable(fs);
+    merkle_disable(fs);
+    block_close(fs);
+    pool_free(&dfs->node_pool, fs);
+
+    dfs->file_systems[id] = NULL;
+    dfs->nodes[id].status = FAILED;
+    dfs->node_count--;
+
+    if (dfs->leader == id) {
+        dfs->leader = 0;
+        while (dfs->leader < MAX_NODES - 1 && dfs->file_systems[dfs->leader] == NULL) {
+            dfs->leader++;
+        }
+    }
+}
+
+static int files_open(fs_node_t* fs) {
+    for (int i = 1; i < 4; i++) {
+        if (fs->OFT[i].curr_pos != -1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// full replicas lay out blocks identically, so a new one takes the leader's
+// volume as it stands along with its staging buffers
+static int node_clone(fs_node_t* fs, fs_node_t* leader) {
+    byte data[BLOCK_SIZE];
+    for (int b = 0; b < N_BLOCKS; b++) {
+        if (block_read(leader, b, data) < 0 || block_write(fs, b, data) < 0) {
+            return -1;
+        }
+    }
+
+    memcpy(fs->I, leader->I, BLOCK_SIZE);
+    memcpy(fs->O, leader->O, BLOCK_SIZE);
+    memcpy(fs->M, leader->M, BLOCK_SIZE);
+
+    // shared blocks keep their counts, sums are taken from the copied blocks
+    if (leader->dedup != NULL) {
+        if (dedup_enable(fs) < 0) {
+            return -1;
+        }
+        memcpy(fs->dedup, leader->dedup, sizeof(dedup_t));
+    }
+    if (leader->sums != NULL && checksum_enable(fs) < 0) {
+        return -1;
+    }
+    if (leader->merkle != NULL && merkle_enable(fs) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int dfs_node_add(dfs_t* dfs) {
+    int id = 0;
+    while (id < MAX_NODES && dfs->file_systems[id] != NULL) {
+        id++;
+    }
+    if (id == MAX_NODES) {
+        return -1;
+    }
+
+    fs_node_t* leader = dfs->file_systems[dfs->leader];
+    if (!dfs->ring.enabled && files_open(leader)) {
+        return -1;  // open files hold state outside the blocks
+    }
+
+    fs_node_t* fs = node_attach(dfs, id);
+    if (fs == NULL) {
+        return -1;
+    }
+
+    int result = dfs->ring.enabled ? dfs_shard_join(dfs, id) : node_clone(fs, leader);
+    if (result < 0) {
+        node_detach(dfs, id);
+        return -1;
+    }
+    return id;
+}
+
+int dfs_node_remove(dfs_t* dfs, int node_id) {
+    if (dfs_node(dfs, node_id) == NULL || dfs->node_count == 1) {
+        return -1;
+    }
+    if (node_id == dfs->leader && dfs_lagging(dfs) > 0) {
+        return -1;  // a lagging node could take over as leader
+    }
+
+    if (dfs->ring.enabled && dfs->ring.member[node_id]) {
+        if (dfs->node_count <= dfs->ring.replication || dfs_shard_leave(dfs, node_id) < 0) {
+            return -1;
+        }
+    }
+
+    node_detach(dfs, node_id);
+    return 0;
+}
+
+int dfs_node_pause(dfs_t* dfs, int node_id) {
+    // sharded nodes trade files outside the log
+    if (dfs_node(dfs, node_id) == NULL || node_id == dfs->leader || dfs->ring.enabled ||
+        dfs->nodes[node_id].status != ACTIVE) {
+        return -1;
+    }
+    dfs->nodes[node_id].status = LAGGING;
+    return 0;
+}
+
+int dfs_node_catch_up(dfs_t* dfs, int node_id, int compact) {
+    fs_node_t* fs = dfs_node(dfs, node_id);
+    if (fs == NULL || dfs->nodes[node_id].status != LAGGING) {
+        return -1;
+    }
+
+    // the node's own log kept every entry it missed
+    if (compact) {
+        wal_compact(dfs, fs, fs->applied_sequence);
+    }
+
+    int replayed = 0;
+    for (wal_entry_t* entry = fs->wal_head; entry != NULL; entry = entry->next) {
+        if (entry->sequence_number <= fs->applied_sequence || entry->failed) {
+            continue;
+        }
+
+        dfs_account_replication(dfs, fs, entry);
+        if (wal_apply_entry(fs, node_id, entry) < 0) {
+            printf("Failed to replay entry %d on node %d\n", entry->sequence_number, node_id);
+            return -1;
+        }
+        fs->log_replays++;
+        replayed++;
+    }
+
+    // refused or compacted entries at the end of the span left nothing to apply
+    fs->applied_sequence = dfs->queue->next - 1;
+    dfs->nodes[node_id].status = ACTIVE;
+    dfs_checkpoint(dfs);
+    return replayed;
+}
+
+int dfs_node_elect(dfs_t* dfs, int node_id) {
+    // a lagging node has not applied everything committed
+    if (dfs_node(dfs, node_id) == NULL || dfs->nodes[node_id].status != ACTIVE) {
+        return -1;
+    }
+    dfs->leader = node_id;
+    return 0;
+}
+
+int dfs_lagging(dfs_t* dfs) {
+    int lagging = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        lagging += dfs->file_systems[i] != NULL && dfs->nodes[i].status == LAGGING;
+    }
+    return lagging;
+}
+
+void dfs_node_stats(dfs_t* dfs) {
+    printf("%d nodes, leader %d\n", dfs->node_count, dfs->leader);
+    for (int i = 0; i < MAX_NODES; i++) {
+        fs_node_t* fs = dfs->file_systems[i];
+        if (fs == NULL) continue;
+        printf("node %d: %d log entries, applied through %d, %d replayed, volume %s%s\n",
+               i, fs->wal_count, fs->applied_sequence, fs->log_replays,
+               fs->cache != NULL ? "on disk" : fs->tier != NULL ? "tiered" : "in memory", dfs->nodes[i].status == LAGGING ? ", lagging" : "");
+    }
+    pool_stats(&dfs->node_pool);
+    pool_stats(&dfs->wal_slab);
+}
+
+int dfs_open(dfs_t* dfs, const char* name) {
+    if (dfs == NULL || name == NULL || strlen(name) > FILE_NAME_MAX) {
+        return -1;
+    }
+    if (dfs->ring.enabled) {
+        return dfs_shard_open(dfs, name);
+    }
+
+    // replicas open in lockstep, so the leader's slot is every node's slot
+    int oft_idx = -1;
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        int slot = open(dfs->file_systems[i], name);
+        if (slot < 0 || (oft_idx >= 0 && slot != oft_idx)) {
+            if (slot >= 0) {
+                close(dfs->file_systems[i], slot);
+            }
+            for (int j = 0; j < i; j++) {
+                if (dfs->file_systems[j] != NULL) {
+                    close(dfs->file_systems[j], oft_idx);
+                }
+            }
+            return -1;
+        }
+        oft_idx = slot;
+    }
+
+    // the name goes into the log with each write, for lease holders
+    shard_handle_t* handle = &dfs->handles[oft_idx];
+    memset(handle, 0, sizeof(shard_handle_t));
+    handle->in_use = 1;
+    strcpy(handle->name, name);
+    return oft_idx;
+}
+
+int dfs_close(dfs_t* dfs, int oft_idx) {
+    // a lagging node still has logged writes to replay through the slot
+    if (dfs == NULL || dfs_lagging(dfs) > 0) {
+        return -1;
+    }
+    if (dfs->ring.enabled) {
+        return dfs_shard_close(dfs, oft_idx);
+    }
+
+    int result = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        if (close(dfs->file_systems[i], oft_idx) < 0) {
+            result = -1;
+        }
+    }
+    if (oft_idx >= 0 && oft_idx < DFS_MAX_OPEN) {
+        dfs->handles[oft_idx].in_use = 0;
+    }
+    return result;
+}
+
+int dfs_read_node(dfs_t* dfs, int oft_idx) {
+    if (!dfs->ring.enabled) {
+        return dfs->leader;
+    }
+    if (oft_idx < 0 || oft_idx >= DFS_MAX_OPEN || !dfs->handles[oft_idx].in_use) {
+        return -1;
+    }
+
+    int nodes[MAX_NODES];
+    if (ring_replicas(&dfs->ring, dfs->handles[oft_idx].name, nodes) <= 0) {
+        return -1;
+    }
+    return nodes[0];
+}
+
+// logs one pwrite of data and drops the caller's reference, returns its length
+static int dfs_pwrite_payload(dfs_t* dfs, int oft_idx, payload_t* data, int offset) {
+    int n = data->len;
+    int result = -1;
+    wal_entry_t entry = wal_log_pwrite(dfs, oft_idx, offset, data);
+    if (entry.sequence_number >= 0 && dfs_replicate_operation(dfs, &entry) >= 0) {
+        result = n;
+    }
+
+    payload_release(data);
+    return result;
+}
+
+int dfs_pwrite(dfs_t* dfs, int oft_idx, const void* buf, int n, int offset) {
+    if (dfs == NULL || buf == NULL || n < 0 || offset < 0) {
+        return -1;
+    }
+
+    // one copy into a shared payload, then every node's log and apply reference it
+    payload_t* data = payload_alloc(n);
+    if (data == NULL) {
+        return -1;
+    }
+    memcpy(data->data, buf, n);
+
+    return dfs_pwrite_payload(dfs, oft_idx, data, offset);
+}
+
+int dfs_fallocate(dfs_t* dfs, int oft_idx, int size) {
+    if (dfs == NULL || size < 0) {
+        return -1;
+    }
+
+    wal_entry_t entry = wal_log_fallocate(dfs, oft_idx, size);
+    return dfs_replicate_operation(dfs, &entry);
+}
+
+int dfs_pwrite_shared(dfs_t* dfs, int oft_idx, const void* buf, int n, int offset) {
+    if (dfs == NULL || buf == NULL || n < 0 || offset < 0) {
+        return -1;
+    }
+
+    payload_t* data = payload_alloc(n);
+    if (data == NULL) {
+        return -1;
+    }
+    memcpy(data->data, buf, n);
+
+    wal_entry_t entry = wal_log_pwrite(dfs, oft_idx, offset, data);
+    payload_release(data);
+    if (entry.sequence_number < 0) {
+        return -1;
+    }
+
+    // the lock holder takes every entry published by then, so most writers
+    // find their result waiting rather than taking the lock themselves
+    int result;
+    while (wal_queue_collect(dfs->queue, entry.sequence_number, &result) < 0) {
+        if (pthread_mutex_trylock(&dfs->lock) == 0) {
+            dfs_drain(dfs, entry.sequence_number);
+            pthread_mutex_unlock(&dfs->lock);
+        } else {
+            sched_yield();
+        }
+    }
+    return result < 0 ? -1 : n;
+}
+
+int dfs_pread(dfs_t* dfs, int node_id, int oft_idx, void* buf, int n, int offset) {
+    if (dfs == NULL || dfs_node(dfs, node_id) == NULL) {
+        return -1;
+    }
+
+    return f_pread(dfs->file_systems[node_id], dfs_node_oft(dfs, node_id, oft_idx), buf, n, offset);
+}
+
+int dfs_pwritev(dfs_t* dfs, int oft_idx, const struct iovec* iov, int iovcnt, int offset) {
+    if (dfs == NULL || iov == NULL || iovcnt < 0 || offset < 0) {
+        return -1;
+    }
+
+    long total = 0;
+    for (int k = 0; k < iovcnt; k++) {
+        if (iov[k].iov_base == NULL && iov[k].iov_len > 0) {
+            return -1;
+        }
+        total += iov[k].iov_len;
+    }
+    if (total > INT_MAX) {
+        return -1;
+    }
+
+    // gathered into one payload and logged as one entry, so every replica
+    // applies or refuses the whole vector
+    payload_t* data = payload_alloc((int) total);
+    if (data == NULL) {
+        return -1;
+    }
+    int at = 0;
+    for (int k = 0; k < iovcnt; k++) {
+        if (iov[k].iov_len > 0) {
+            memcpy(data->data + at, iov[k].iov_base, iov[k].iov_len);
+            at += (int) iov[k].iov_len;
+        }
+    }
+
+    return dfs_pwrite_payload(dfs, oft_idx, data, offset);
+}
+
+int dfs_preadv(dfs_t* dfs, int node_id, int oft_idx, const struct iovec* iov, int iovcnt, int offset) {
+    if (dfs == NULL || dfs_node(dfs, node_id) == NULL) {
+        return -1;
+    }
+
+    return f_preadv(dfs->file_systems[node_id], dfs_node_oft(dfs, node_id, oft_idx), iov, iovcnt, offset);
+}
+
+// open handle naming the file, -1 if there is none
+static int dfs_file_handle(dfs_t* dfs, const char* name) {
+    for (int h = 0; h < DFS_MAX_OPEN; h++) {
+        if (dfs->handles[h].in_use && strcmp(dfs->handles[h].name, name) == 0) {
+            return h;
+        }
+    }
+    return -1;
+}
+
+byte* dfs_read_file(dfs_t* dfs, const char* name, int* size) {
+    int handle = dfs_file_handle(dfs, name);
+    int opened = handle < 0;
+    if (opened) {
+        // a lagging node would keep the close from going through
+        if (dfs_lagging(dfs) > 0 || (handle = dfs_open(dfs, name)) < 0) {
+            return NULL;
+        }
+    }
+
+    int node = dfs_read_node(dfs, handle);
+    int slot = dfs_node_oft(dfs, node, handle);
+    byte* data = NULL;
+    if (dfs_node(dfs, node) != NULL && slot > 0) {
+        *size = dfs_node(dfs, node)->OFT[slot].file_size;
+        data = malloc(*size > 0 ? *size : 1);
+        if (data != NULL && dfs_pread(dfs, node, handle, data, *size, 0) != *size) {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    if (opened) {
+        dfs_close(dfs, handle);
+    }
+    return data;
+}
+
+int dfs_next_file(dfs_t* dfs, const char* after, char name[FILE_NAME_MAX + 1]) {
+    char best[FILE_NAME_MAX + 1] = { 0 };
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+
+        // each directory is in name order, the nearest name across them is next
+        char next[FILE_NAME_MAX + 1];
+        if (dir_next(dfs->file_systems[i], after, next) != -1 && (best[0] == '\0' || strcmp(next, best) < 0)) {
+            strcpy(best, next);
+        }
+    }
+    if (best[0] == '\0') {
+        return -1;
+    }
+    strcpy(name, best);
+    return 0;
+}
+
+// command arguments are non-negative decimals that fit in an int, anything
+// else (a sign, trailing text, overflow) is -1
+static int convert_to_int(char* s) {
+    if (*s < '0' || *s > '9') {
+        return -1;
+    }
+
+    char* end;
+    errno = 0;
+    long value = strtol(s, &end, 10);
+    if (*end != '\0' || errno == ERANGE || value > INT_MAX) {
+        return -1;
+    }
+    return (int) value;
+}
+
 void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC], int argc)
 {
     if (strcmp("in", command) == 0 && argc == 1) {
+        for (int i = 0; i < MAX_NODES; i++) {
+            if (dfs->file_systems[i] == NULL) continue;
+            wal_truncate(dfs->file_systems[i], dfs->global_sequence_counter);
+        }
         dfs_init(dfs);
         printf("distributed system initialized\n");
 
-    } else if (strcmp("wm", command) == 0 && argc >= 3) {
+    } else if (strcmp("wm", command) == 0 && argc >= 4) {
         // Parse node_id and memory position
         int node_id = convert_to_int(parameters[0]);
-        if (node_id == -1 || node_id >= NUM_NODES) {
+        if (dfs_node(dfs, node_id) == NULL) {
             printf("error\n");
             return;
         }
@@ -43,23 +733,24 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
             return;
         }
 
-        // Combine remaining parameters into a single string
+        // Combine remaining parameters into a single string, the last one
+        // is parameters[argc - 2] as argc counts the command
         int total_len = 0;
-        for (int i = 2; i < argc; i++) {
+        for (int i = 2; i < argc - 1; i++) {
             total_len += strlen(parameters[i]) + 1;
         }
         
         char combined[total_len]; 
         combined[0] = '\0';
 
-        for (int i = 2; i < argc; i++) {
+        for (int i = 2; i < argc - 1; i++) {
             strcat(combined, parameters[i]);
-            if (i < argc - 1) {
+            if (i < argc - 2) {
                 strcat(combined, " ");
             }
         }
 
-        int bytes = write_memory(&dfs->file_systems[node_id], m, combined);
+        int bytes = write_memory(dfs->file_systems[node_id], m, combined);
         if (bytes > 0) {
             printf("%d bytes written to M on node %d\n", bytes, node_id);
         } else {
@@ -67,14 +758,14 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
         }
 
     } else if (strcmp("cr", command) == 0 && argc == 2) {
-        if (strlen(parameters[0]) > 4) {
+        if (strlen(parameters[0]) > FILE_NAME_MAX) {
             printf("error\n");
             return;
         }
         
         wal_entry_t entry = wal_log_create(dfs, parameters[0]);
         if (entry.sequence_number >= 0) {
-            int result = dfs_replicate_operation(dfs, entry);
+            int result = dfs_replicate_operation(dfs, &entry);
             if (result == 0) {
                 printf("%s created on all nodes\n", parameters[0]);
             } else {
@@ -85,14 +776,14 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
         }
 
     } else if (strcmp("de", command) == 0 && argc == 2) {
-        if (strlen(parameters[0]) > 4) {
+        if (strlen(parameters[0]) > FILE_NAME_MAX) {
             printf("error\n");
             return;
         }
         
         wal_entry_t entry = wal_log_destroy(dfs, parameters[0]);
         if (entry.sequence_number >= 0) {
-            int result = dfs_replicate_operation(dfs, entry);
+            int result = dfs_replicate_operation(dfs, &entry);
             if (result == 0) {
                 printf("%s destroyed on all nodes\n", parameters[0]);
             } else {
@@ -105,17 +796,17 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
     } else if (strcmp("op", command) == 0 && argc == 3) {
         // op node_id filename
         int node_id = convert_to_int(parameters[0]);
-        if (node_id == -1 || node_id >= NUM_NODES) {
+        if (dfs_node(dfs, node_id) == NULL) {
             printf("error\n");
             return;
         }
 
-        if (strlen(parameters[1]) > 4) {
+        if (strlen(parameters[1]) > FILE_NAME_MAX) {
             printf("error\n");
             return;
         }
 
-        int oft_idx = open(&dfs->file_systems[node_id], parameters[1]);
+        int oft_idx = open(dfs->file_systems[node_id], parameters[1]);
         if (oft_idx >= 0) {
             printf("%s opened at %d on node %d\n", parameters[1], oft_idx, node_id);
         } else {
@@ -125,7 +816,7 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
     } else if (strcmp("cl", command) == 0 && argc == 3) {
         // cl node_id oft_index
         int node_id = convert_to_int(parameters[0]);
-        if (node_id == -1 || node_id >= NUM_NODES) {
+        if (dfs_node(dfs, node_id) == NULL) {
             printf("error\n");
             return;
         }
@@ -136,7 +827,7 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
             return;
         }
 
-        int result = close(&dfs->file_systems[node_id], i);
+        int result = close(dfs->file_systems[node_id], i);
         if (result == 0) {
             printf("%d closed on node %d\n", i, node_id);
         } else {
@@ -163,13 +854,22 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
             return;
         }
 
-        // Get data from leader's memory buffer
-        byte data[512];
-        memcpy(data, dfs->file_systems[dfs->leader].M + m, n);
+        if (m < 0 || n < 0 || m >= BLOCK_SIZE || n > BLOCK_SIZE - m) {
+            printf("error\n");
+            return;
+        }
+
+        // Get data from leader's memory buffer, the only copy before apply
+        payload_t* data = payload_alloc(n);
+        if (data == NULL) {
+            printf("error\n");
+            return;
+        }
+        memcpy(data->data, dfs->file_systems[dfs->leader]->M + m, n);
 
         wal_entry_t entry = wal_log_write(dfs, oft_idx, m, n, data);
         if (entry.sequence_number >= 0) {
-            int result = dfs_replicate_operation(dfs, entry);
+            int result = dfs_replicate_operation(dfs, &entry);
             if (result >= 0) {
                 printf("%d bytes written to all nodes\n", n);
             } else {
@@ -178,11 +878,12 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
         } else {
             printf("error\n");
         }
+        payload_release(data);
 
     } else if (strcmp("rd", command) == 0 && argc == 5) {
         // rd node_id oft_idx m n
         int node_id = convert_to_int(parameters[0]);
-        if (node_id == -1 || node_id >= NUM_NODES) {
+        if (dfs_node(dfs, node_id) == NULL) {
             printf("error\n");
             return;
         }
@@ -205,7 +906,7 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
             return;
         }
 
-        int bytes = f_read(&dfs->file_systems[node_id], i, m, n);
+        int bytes = f_read(dfs->file_systems[node_id], dfs_node_oft(dfs, node_id, i), m, n);
         if (bytes >= 0) {
             printf("%d bytes read from node %d\n", bytes, node_id);
         } else {
@@ -228,7 +929,7 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
 
         wal_entry_t entry = wal_log_seek(dfs, oft_idx, position);
         if (entry.sequence_number >= 0) {
-            int result = dfs_replicate_operation(dfs, entry);
+            int result = dfs_replicate_operation(dfs, &entry);
             if (result == 0) {
                 printf("position is %d on all nodes\n", position);
             } else {
@@ -238,10 +939,25 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
             printf("error\n");
         }
 
+    } else if (strcmp("fa", command) == 0 && argc == 3) {
+        // fa oft_idx size - reserve blocks up to size bytes - replicated via WAL
+        int oft_idx = convert_to_int(parameters[0]);
+        int size = convert_to_int(parameters[1]);
+        if (oft_idx == -1 || size == -1) {
+            printf("error\n");
+            return;
+        }
+
+        if (dfs_fallocate(dfs, oft_idx, size) == 0) {
+            printf("%d bytes reserved on all nodes\n", size);
+        } else {
+            printf("error\n");
+        }
+
     } else if (strcmp("rm", command) == 0 && argc == 4) {
         // rm node_id m n
         int node_id = convert_to_int(parameters[0]);
-        if (node_id == -1 || node_id >= NUM_NODES) {
+        if (dfs_node(dfs, node_id) == NULL) {
             printf("error\n");
             return;
         }
@@ -258,20 +974,422 @@ void dfs_process_command(dfs_t *dfs, char command[3], char *parameters[MAX_ARGC]
             return;
         }
 
-        int result = read_memory(&dfs->file_systems[node_id], m, n);
+        int result = read_memory(dfs->file_systems[node_id], m, n);
         if (result < 0) {
             printf("error\n");
         }
 
-    } else if (strcmp("dr", command) == 0 && argc == 2) {
-        // dr node_id
+    } else if (strcmp("dr", command) == 0 && (argc == 2 || argc == 3)) {
+        // dr node_id [prefix] - the names starting with prefix, in order
+        int node_id = convert_to_int(parameters[0]);
+        if (dfs_node(dfs, node_id) == NULL) {
+            printf("error\n");
+            return;
+        }
+
+        directory(dfs->file_systems[node_id], argc == 3 ? parameters[1] : "");
+
+    } else if (strcmp("vd", command) == 0 && argc == 3) {
+        // vd directory cache_slots - move every node onto a disk-backed volume
+        int slots = convert_to_int(parameters[1]);
+        if (slots == -1) {
+            printf("error\n");
+            return;
+        }
+
+        if (dfs_attach_storage(dfs, parameters[0], slots) == 0) {
+            printf("volumes stored in %s with %d cache slots\n", parameters[0], slots);
+        } else {
+            printf("error\n");
+        }
+
+    } else if (strcmp("vt", command) == 0 && argc == 3) {
+        // vt directory hot_blocks - move every node onto hot frames over a cold file
+        int hot = convert_to_int(parameters[1]);
+        if (hot == -1) {
+            printf("error\n");
+            return;
+        }
+
+        if (dfs_attach_tiers(dfs, parameters[0], hot) == 0) {
+            printf("cold tiers in %s under %d hot blocks\n", parameters[0], hot);
+        } else {
+            printf("error\n");
+        }
+
+    } else if (strcmp("mb", command) == 0 && argc == 2) {
+        // mb interval_ms - start migrating cold blocks out in the background
+        int interval = convert_to_int(parameters[0]);
+        if (interval <= 0 || dfs_migrate_start(dfs, interval) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("migrating every %d ms\n", interval);
+
+    } else if (strcmp("me", command) == 0 && argc == 1) {
+        dfs_migrate_stop(dfs);
+        printf("migrator stopped\n");
+
+    } else if (strcmp("mp", command) == 0 && argc == 1) {
+        // mp - one migration pass right now
+        int demoted = dfs_migrate_pass(dfs);
+        printf("migration pass: %d blocks demoted\n", demoted);
+
+    } else if (strcmp("fd", command) == 0 && argc == 2) {
+        // fd name - move the file's blocks into one run on every node holding it
+        if (dfs_defragment(dfs, parameters[0]) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("%s defragmented\n", parameters[0]);
+
+    } else if (strcmp("fb", command) == 0 && argc == 2) {
+        // fb rate - start defragmenting in the background, rate files per second
+        int rate = convert_to_int(parameters[0]);
+        if (rate <= 0 || dfs_defrag_start(dfs, rate) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("defragmenting %d files/s\n", rate);
+
+    } else if (strcmp("fe", command) == 0 && argc == 1) {
+        dfs_defrag_stop(dfs);
+        printf("defragmenter stopped\n");
+
+    } else if (strcmp("ap", command) == 0 && argc == 2) {
+        // ap workers - apply entries on a worker pool, one lane per node; 0 turns it off
+        int workers = convert_to_int(parameters[0]);
+        if (dfs_apply_start(dfs, workers) < 0) {
+            printf("error\n");
+            return;
+        }
+        if (workers == 0) {
+            printf("parallel apply off\n");
+        } else {
+            printf("applying on %d workers\n", workers);
+        }
+
+    } else if (strcmp("as", command) == 0 && argc == 1) {
+        dfs_apply_stats(dfs);
+
+    } else if (strcmp("fs", command) == 0 && argc == 2) {
+        // fs node_id - how many runs each file's blocks lie in
+        int node_id = convert_to_int(parameters[0]);
+        fs_node_t* fs = dfs_node(dfs, node_id);
+        if (fs == NULL) {
+            printf("error\n");
+            return;
+        }
+
+        char name[FILE_NAME_MAX + 1] = "";
+        while (dir_next(fs, name, name) != -1) {
+            printf("%s %d runs\n", name, file_runs(fs, name));
+        }
+        printf("node %d: %d blocks moved by defragmentation, %d reserved ahead of writes\n", node_id,
+               fs->blocks_defragmented, fs->blocks_reserved);
+        dfs_defrag_stats(dfs);
+
+    } else if (strcmp("im", command) == 0 && argc == 3) {
+        // im directory readers - load every file under a host directory
+        int readers = convert_to_int(parameters[1]);
+        if (dfs_import(dfs, parameters[0], readers) < 0) {
+            printf("error\n");
+        }
+
+    } else if (strcmp("ex", command) == 0 && argc == 3) {
+        // ex directory writers - dump every file to a host directory
+        int writers = convert_to_int(parameters[1]);
+        if (dfs_export(dfs, parameters[0], writers) < 0) {
+            printf("error\n");
+        }
+
+    } else if (strcmp("cs", command) == 0 && argc == 2) {
+        // cs node_id
         int node_id = convert_to_int(parameters[0]);
-        if (node_id == -1 || node_id >= NUM_NODES) {
+        if (dfs_node(dfs, node_id) == NULL) {
+            printf("error\n");
+            return;
+        }
+
+        block_stats(dfs->file_systems[node_id]);
+        dir_stats(dfs->file_systems[node_id]);
+        dedup_stats(dfs->file_systems[node_id]);
+        checksum_stats(dfs->file_systems[node_id]);
+        dfs_scrub_stats(dfs);
+        dfs_migrate_stats(dfs);
+        printf("replication: %ld bytes shipped, %ld blocks sent by hash\n",
+               dfs->replication_bytes, dfs->replication_by_hash);
+
+    } else if (strcmp("zc", command) == 0 && argc == 2) {
+        // zc codec - codec for logged payloads: lz or none
+        int codec = codec_find(parameters[0]);
+        if (codec == -1) {
             printf("error\n");
             return;
         }
 
-        directory(&dfs->file_systems[node_id]);
+        compressor_init(&dfs->compressor, codec);
+        printf("payload codec %s\n", parameters[0]);
+
+    } else if (strcmp("zs", command) == 0 && argc == 1) {
+        compressor_stats(&dfs->compressor);
+        for (int i = 0; i < MAX_NODES; i++) {
+            if (dfs->file_systems[i] == NULL) continue;
+            fs_node_t* fs = dfs->file_systems[i];
+            printf("node %d: %d payloads unpacked, %.3f s decompressing\n",
+                   i, fs->payloads_unpacked, (double) fs->unpack_clock / CLOCKS_PER_SEC);
+        }
+
+    } else if (strcmp("zb", command) == 0 && argc == 2) {
+        // zb rounds - codec throughput and ratio on sample data
+        int rounds = convert_to_int(parameters[0]);
+        if (rounds <= 0) {
+            printf("error\n");
+            return;
+        }
+
+        compress_bench(rounds);
+
+    } else if (strcmp("ck", command) == 0 && argc == 1) {
+        // ck - checksum every block on every node from now on
+        if (dfs_enable_checksums(dfs) == 0) {
+            printf("checksums enabled on all nodes (crc32c %s)\n", crc32c_impl());
+        } else {
+            printf("error\n");
+        }
+
+    } else if (strcmp("sb", command) == 0 && argc == 2) {
+        // sb rate - start the background scrubber at rate blocks per second
+        int rate = convert_to_int(parameters[0]);
+        if (rate <= 0 || dfs_scrub_start(dfs, rate) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("scrubbing %d blocks/s\n", rate);
+
+    } else if (strcmp("se", command) == 0 && argc == 1) {
+        dfs_scrub_stop(dfs);
+        printf("scrubber stopped\n");
+
+    } else if (strcmp("sc", command) == 0 && argc == 1) {
+        // sc - one full scrub pass right now
+        int corrupt = dfs_scrub_pass(dfs);
+        printf("scrub pass: %d corrupt blocks\n", corrupt);
+
+    } else if (strcmp("ae", command) == 0 && argc == 1) {
+        // ae - compare replicas by merkle tree now and repair what differs
+        int repaired = dfs_anti_entropy(dfs);
+        if (repaired < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("anti-entropy: %d blocks repaired\n", repaired);
+        dfs_anti_entropy_stats(dfs);
+
+    } else if (strcmp("ai", command) == 0 && argc == 2) {
+        // ai entries - run anti-entropy every this many entries, 0 turns it off
+        int interval = convert_to_int(parameters[0]);
+        if (interval < 0) {
+            printf("error\n");
+            return;
+        }
+        dfs->anti_entropy.interval = interval;
+        printf("anti-entropy every %d entries\n", interval);
+
+    } else if (strcmp("sr", command) == 0 && argc == 3) {
+        // sr replication vnodes - shard files over a consistent-hash ring
+        int replication = convert_to_int(parameters[0]);
+        int vnodes = convert_to_int(parameters[1]);
+        if (replication <= 0 || vnodes <= 0 || dfs_shard_enable(dfs, replication, vnodes) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("files sharded with replication %d and %d vnodes per node\n", replication, vnodes);
+
+    } else if (strcmp("sj", command) == 0 && argc == 2) {
+        // sj node_id - node joins the ring, files move onto it
+        int node_id = convert_to_int(parameters[0]);
+        if (node_id == -1 || dfs_shard_join(dfs, node_id) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("node %d joined\n", node_id);
+
+    } else if (strcmp("sl", command) == 0 && argc == 2) {
+        // sl node_id - node leaves the ring after handing off its files
+        int node_id = convert_to_int(parameters[0]);
+        if (node_id == -1 || dfs_shard_leave(dfs, node_id) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("node %d left\n", node_id);
+
+    } else if (strcmp("so", command) == 0 && argc == 2) {
+        // so filename - open on every replica of the file's shard
+        int h = dfs_shard_open(dfs, parameters[0]);
+        if (h < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("%s opened at %d on its shard\n", parameters[0], h);
+
+    } else if (strcmp("sx", command) == 0 && argc == 2) {
+        // sx handle
+        int h = convert_to_int(parameters[0]);
+        if (h == -1 || dfs_shard_close(dfs, h) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("%d closed on its shard\n", h);
+
+    } else if (strcmp("sh", command) == 0 && argc == 2) {
+        // sh filename - where the file lives
+        dfs_shard_show(dfs, parameters[0]);
+
+    } else if (strcmp("ss", command) == 0 && argc == 1) {
+        dfs_shard_stats(dfs);
+
+    } else if (strcmp("wb", command) == 0 && argc == 3) {
+        // wb threads ops - concurrent appends on a scratch cluster, 1 to threads producers
+        int threads = convert_to_int(parameters[0]);
+        int ops = convert_to_int(parameters[1]);
+        if (threads <= 0 || ops <= 0) {
+            printf("error\n");
+            return;
+        }
+
+        wal_bench(threads, ops);
+
+    } else if (strcmp("na", command) == 0 && argc == 1) {
+        // na - register a new node, caught up from the leader or its shards
+        int node_id = dfs_node_add(dfs);
+        if (node_id < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("node %d added\n", node_id);
+
+    } else if (strcmp("nr", command) == 0 && argc == 2) {
+        // nr node_id - release a node and its memory
+        int node_id = convert_to_int(parameters[0]);
+        if (dfs_node_remove(dfs, node_id) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("node %d removed\n", node_id);
+
+    } else if (strcmp("np", command) == 0 && argc == 2) {
+        // np node_id - stop applying entries on a node, its log keeps them
+        int node_id = convert_to_int(parameters[0]);
+        if (dfs_node_pause(dfs, node_id) < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("node %d lagging\n", node_id);
+
+    } else if (strcmp("nc", command) == 0 && (argc == 2 || argc == 3)) {
+        // nc node_id [raw] - replay what a lagging node missed, compacted unless raw
+        int node_id = convert_to_int(parameters[0]);
+        int compact = argc == 2 || strcmp(parameters[1], "raw") != 0;
+        int replayed = dfs_node_catch_up(dfs, node_id, compact);
+        if (replayed < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("node %d caught up, %d entries replayed\n", node_id, replayed);
+
+    } else if (strcmp("wv", command) == 0 && argc == 2) {
+        // wv ops - compare compacted and full replay on a scratch cluster
+        int ops = convert_to_int(parameters[0]);
+        if (ops <= 0) {
+            printf("error\n");
+            return;
+        }
+
+        wal_compact_check(ops);
+
+    } else if (strcmp("sm", command) == 0 && argc >= 5 && argc - 5 <= SIM_MAX_FAULTS) {
+        // sm seed ms heartbeat_ms timeout_ms [kind:node@at+for[xfactor] ...] - faults on a
+        // simulated scratch cluster, picked by the seed when none are given
+        int seed = convert_to_int(parameters[0]);
+        int ms = convert_to_int(parameters[1]);
+        int heartbeat_ms = convert_to_int(parameters[2]);
+        int timeout_ms = convert_to_int(parameters[3]);
+        if (seed < 0 || ms <= 0 || heartbeat_ms <= 0 || timeout_ms <= 0) {
+            printf("error\n");
+            return;
+        }
+
+        sim_fault_t faults[SIM_MAX_FAULTS];
+        for (int f = 0; f < argc - 5; f++) {
+            if (sim_parse_fault(parameters[4 + f], &faults[f]) < 0) {
+                printf("error\n");
+                return;
+            }
+        }
+
+        if (sim_run(seed, ms, heartbeat_ms, timeout_ms, faults, argc - 5) < 0) {
+            printf("error\n");
+        }
+
+    } else if (strcmp("lt", command) == 0 && argc == 2) {
+        // lt ms - lease length for client caches, 0 stops granting them
+        int ttl = convert_to_int(parameters[0]);
+        if (ttl < 0) {
+            printf("error\n");
+            return;
+        }
+        dfs->leases.ttl_ms = ttl;
+        if (ttl == 0) {
+            lease_revoke(&dfs->leases, NULL);
+        }
+        printf("leases last %d ms\n", ttl);
+
+    } else if (strcmp("lg", command) == 0 && argc == 4) {
+        // lg name offset n - read through the shell's cache client
+        int offset = convert_to_int(parameters[1]);
+        int n = convert_to_int(parameters[2]);
+        if (strlen(parameters[0]) > FILE_NAME_MAX || offset < 0 || n < 0 || n > N_BLOCKS * BLOCK_SIZE) {
+            printf("error\n");
+            return;
+        }
+
+        if (dfs->client == NULL) {
+            dfs->client = malloc(sizeof(client_t));
+            if (dfs->client == NULL || client_setup(dfs->client, dfs) < 0) {
+                free(dfs->client);
+                dfs->client = NULL;
+                printf("error\n");
+                return;
+            }
+        }
+
+        byte* buf = malloc(n > 0 ? n : 1);
+        long hits = dfs->client->hits;
+        int bytes = buf != NULL ? client_read(dfs->client, parameters[0], buf, n, offset) : -1;
+        free(buf);
+        if (bytes < 0) {
+            printf("error\n");
+            return;
+        }
+        printf("%d bytes read from %s\n", bytes, dfs->client->hits > hits ? "cache" : "the cluster");
+
+    } else if (strcmp("lm", command) == 0 && argc == 1) {
+        lease_stats(&dfs->leases);
+        if (dfs->client != NULL) {
+            client_stats(dfs->client);
+        }
+
+    } else if (strcmp("nm", command) == 0 && argc == 1) {
+        dfs_node_stats(dfs);
+
+    } else if (strcmp("dd", command) == 0 && argc == 1) {
+        // dd - turn on block dedup on every node
+        if (dfs_enable_dedup(dfs) == 0) {
+            printf("dedup enabled on all nodes\n");
+        } else {
+            printf("error\n");
+        }
 
     } else {
         printf("error\n");
@@ -291,7 +1409,7 @@ int dfs_read_operation(dfs_t * dfs, char *filename) {
     while (fgets(line, sizeof(line), fp) != NULL) {
         line[strcspn(line, "\n")] = '\0';
         
-        int argc = 0;
+        int argc = 1;  // the command counts, as dfs_process_command expects
         char *token = strtok(line, " ");
         if (token == NULL) continue;
         
@@ -299,12 +1417,14 @@ int dfs_read_operation(dfs_t * dfs, char *filename) {
         strcpy(command, token);
         
         token = strtok(NULL, " ");
-        while (token != NULL && argc < MAX_ARGC) {
-            argv[argc++] = token;
+        while (token != NULL && argc <= MAX_ARGC) {
+            argv[argc++ - 1] = token;
             token = strtok(NULL, " ");
         }
         
+        pthread_mutex_lock(&dfs->lock);
         dfs_process_command(dfs, command, argv, argc);
+        pthread_mutex_unlock(&dfs->lock);
     }
 
     fclose(fp);
@@ -312,17 +1432,60 @@ int dfs_read_operation(dfs_t * dfs, char *filename) {
 }
 
 void dfs_init (dfs_t * dfs) {
-    // initialize dfs structure 
-    for (int i = 0; i < NUM_NODES; i++) {
-        init(&dfs->file_systems[i]);
+    if (dfs->node_pool.size == 0) {
+        pool_init(&dfs->node_pool, "node", sizeof(fs_node_t), 4);
+        pool_init(&dfs->wal_slab, "wal", sizeof(wal_entry_t), WAL_SLAB_CHUNK);
+        lease_init(&dfs->leases);
     }
-    dfs->leader = 0;
+    // nothing a client cached survives a fresh cluster
+    lease_revoke(&dfs->leases, NULL);
     dfs->global_sequence_counter = 0;
-}
+    if (dfs->queue == NULL) {
+        dfs->queue = malloc(sizeof(wal_queue_t));
+    }
+    wal_queue_reset(dfs->queue, 0);
 
-int main () {
-    dfs_t * dfs = malloc(sizeof(dfs_t));
-    dfs_init(dfs);
+    // a fresh cluster is nodes 0 to NUM_NODES - 1, whatever joined since is dropped
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (i >= NUM_NODES) {
+            if (dfs->file_systems[i] != NULL) {
+                node_detach(dfs, i);
+            }
+        } else if (dfs->file_systems[i] == NULL) {
+            node_attach(dfs, i);
+        } else {
+            init(dfs->file_systems[i]);
+            wal_init(dfs->file_systems[i]);
+        }
+    }
+    dfs->leader = 0;
+    dfs->replication_bytes = 0;
+    dfs->replication_by_hash = 0;
+    compressor_init(&dfs->compressor, CODEC_LZ);
+    memset(&dfs->ring, 0, sizeof(ring_t));
+    memset(dfs->handles, 0, sizeof(dfs->handles));
+}
 
-    return 0;
-}
\ No newline at end of file
+void dfs_destroy(dfs_t* dfs) {
+    // background threads walk the nodes, so they go before any node does
+    pthread_mutex_lock(&dfs->lock);
+    dfs_scrub_stop(dfs);
+    dfs_migrate_stop(dfs);
+    dfs_defrag_stop(dfs);
+    pthread_mutex_unlock(&dfs->lock);
+    dfs_apply_stop(dfs);
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] != NULL) {
+            node_detach(dfs, i);
+        }
+    }
+    if (dfs->client != NULL) {
+        client_teardown(dfs->client);
+        free(dfs->client);
+        dfs->client = NULL;
+    }
+    pool_destroy(&dfs->node_pool);
+    pool_destroy(&dfs->wal_slab);
+    free(dfs->queue);
+    dfs->queue = NULL;
+}
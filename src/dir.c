@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <string.h>
+#include "dir.h"
+#include "efs.h"
+#include "block.h"
+
+static int node_get(const byte * p)
+{
+    return p[0] | (p[1] << BITS_PER_BYTE);
+}
+
+static void node_put(byte * p, int info)
+{
+    p[0] = info & 0xff;
+    p[1] = (info >> BITS_PER_BYTE) & 0xff;
+}
+
+#define NODE_INNER(node) ((node)[0])
+#define NODE_COUNT(node) node_get((node) + 1)
+#define NODE_FIRST(node) node_get((node) + 3)
+#define ENTRY_SIZE(node, at) ((node)[at] + 3)
+#define ENTRY_VALUE(node, at) node_get((node) + (at) + 1 + (node)[at])
+
+// blocks a split climbing from a leaf through the root can take at most
+#define DIR_SPLIT_BLOCKS(depth) ((depth) + 1)
+
+typedef struct {
+    int block[DIR_MAX_DEPTH];
+    int index[DIR_MAX_DEPTH];  // entry followed down from each inner node, -1 for FIRST
+    int depth;
+} dir_path_t;
+
+static int name_ok(const char * name)
+{
+    int len = name == NULL ? 0 : strlen(name);
+    return len > 0 && len <= FILE_NAME_MAX && strchr(name, '/') == NULL;
+}
+
+static int entry_cmp(const byte * entry, const char * name, int len)
+{
+    int n = entry[0] < len ? entry[0] : len;
+    int c = memcmp(entry + 1, name, n);
+    return c != 0 ? c : entry[0] - len;
+}
+
+// offset of entry k
+static int entry_at(const byte * node, int k)
+{
+    int at = DIR_NODE_HEADER;
+    for (int j = 0; j < k; j++) at += ENTRY_SIZE(node, at);
+    return at;
+}
+
+// bytes the header and entries take
+static int node_used(const byte * node)
+{
+    return entry_at(node, NODE_COUNT(node));
+}
+
+// last entry whose name is <= name with its offset in at, -1 if name precedes
+// them all; exact says whether it is name itself
+static int node_search(const byte * node, const char * name, int len, int * at, int * exact)
+{
+    int found = -1;
+    int off = DIR_NODE_HEADER;
+    *exact = 0;
+
+    for (int k = 0; k < NODE_COUNT(node); k++) {
+        int c = entry_cmp(node + off, name, len);
+        if (c > 0) break;
+
+        found = k;
+        *at = off;
+        *exact = c == 0;
+        off += ENTRY_SIZE(node, off);
+    }
+    return found;
+}
+
+// node has room past BLOCK_SIZE, an insert may overflow it until it is split
+static void node_insert(byte * node, int k, const char * name, int len, int value)
+{
+    int at = entry_at(node, k);
+    int used = node_used(node);
+    memmove(node + at + len + 3, node + at, used - at);
+
+    node[at] = len;
+    memcpy(node + at + 1, name, len);
+    node_put(node + at + 1 + len, value);
+    node_put(node + 1, NODE_COUNT(node) + 1);
+}
+
+static void node_delete(byte * node, int k)
+{
+    int at = entry_at(node, k);
+    int size = ENTRY_SIZE(node, at);
+    int used = node_used(node);
+
+    memmove(node + at, node + at + size, used - at - size);
+    memset(node + used - size, 0, size);
+    node_put(node + 1, NODE_COUNT(node) - 1);
+}
+
+// leaf whose range holds name, read into node; path collects the blocks
+// visited from the root down
+static int dir_descend(fs_node_t* fs, const char * name, byte * node, dir_path_t * path)
+{
+    int len = strlen(name);
+    int block = DIR_ROOT;
+
+    for (int d = 0; d < DIR_MAX_DEPTH; d++) {
+        if (block_read(fs, block, node) < 0) return -1;
+        path->block[d] = block;
+        path->depth = d + 1;
+        if (!NODE_INNER(node)) return 0;
+
+        int at, exact;
+        int k = node_search(node, name, len, &at, &exact);
+        path->index[d] = k;
+        block = k < 0 ? NODE_FIRST(node) : ENTRY_VALUE(node, at);
+        if (block <= DIR_ROOT || block >= N_BLOCKS) return -1;
+    }
+    return -1;
+}
+
+int dir_lookup(fs_node_t* fs, const char* name)
+{
+    if (!name_ok(name)) return -1;
+
+    byte node[BLOCK_SIZE];
+    dir_path_t path;
+    if (dir_descend(fs, name, node, &path) < 0) return -1;
+
+    int at, exact;
+    node_search(node, name, strlen(name), &at, &exact);
+    return exact ? ENTRY_VALUE(node, at) : -1;
+}
+
+// whether the bitmap in fs->O has count free data blocks
+static int dir_room(fs_node_t* fs, int count)
+{
+    for (int b = 8; b < N_BLOCKS && count > 0; b++) {
+        if (get_bit_map_info(fs, b) == 0) count--;
+    }
+    return count == 0;
+}
+
+// entry that starts the right half of an overflowing node, picked to even out
+// the bytes on both sides; an inner node's moves up instead of going right
+static int node_split_point(const byte * node)
+{
+    int used = node_used(node);
+    int inner = NODE_INNER(node);
+    int best = -1;
+    int best_size = 0;
+
+    int at = entry_at(node, 1);
+    for (int s = 1; s < NODE_COUNT(node) - inner; s++) {
+        int right_at = inner ? at + ENTRY_SIZE(node, at) : at;
+        int left = at;
+        int right = DIR_NODE_HEADER + used - right_at;
+        int larger = left > right ? left : right;
+
+        if (larger <= BLOCK_SIZE && (best == -1 || larger < best_size)) {
+            best = s;
+            best_size = larger;
+        }
+        at += ENTRY_SIZE(node, at);
+    }
+    return best;
+}
+
+// moves entries from s on out of node into right and the separator's name
+// into key; a leaf keeps a copy of it in right, an inner node hands its child
+// to right as FIRST
+static int node_split(byte * node, byte * right, char * key)
+{
+    int s = node_split_point(node);
+    if (s == -1) return -1;
+
+    int inner = NODE_INNER(node);
+    int used = node_used(node);
+    int at = entry_at(node, s);
+    int len = node[at];
+    memcpy(key, node + at + 1, len);
+
+    int from = inner ? at + ENTRY_SIZE(node, at) : at;
+    memset(right, 0, BLOCK_SIZE);
+    right[0] = inner;
+    node_put(right + 1, NODE_COUNT(node) - s - inner);
+    node_put(right + 3, inner ? ENTRY_VALUE(node, at) : 0);
+    memcpy(right + DIR_NODE_HEADER, node + from, used - from);
+
+    memset(node + at, 0, used - at);
+    node_put(node + 1, s);
+    return len;
+}
+
+int dir_insert(fs_node_t* fs, const char* name, int fd)
+{
+    if (!name_ok(name)) return -1;
+
+    byte node[2 * BLOCK_SIZE] = { 0 };
+    byte right[BLOCK_SIZE];
+    dir_path_t path;
+    if (dir_descend(fs, name, node, &path) < 0) return -1;
+
+    int at, exact;
+    int k = node_search(node, name, strlen(name), &at, &exact);
+    if (exact) return -1;
+
+    // a leaf that overflows may split every node up to the root; the blocks
+    // that takes are checked up front, so an insert goes all the way or
+    // changes nothing
+    int len = strlen(name);
+    if (node_used(node) + len + 3 > BLOCK_SIZE && !dir_room(fs, DIR_SPLIT_BLOCKS(path.depth))) return -1;
+
+    char key[FILE_NAME_MAX];
+    int value = fd;
+    memcpy(key, name, len);
+
+    for (int d = path.depth - 1; d >= 0; d--) {
+        node_insert(node, k + 1, key, len, value);
+        if (node_used(node) <= BLOCK_SIZE) {
+            return block_write(fs, path.block[d], node);
+        }
+
+        len = node_split(node, right, key);
+        if (len < 0) return -1;
+
+        int sibling = alloc_block(fs, path.block[d] + 1);
+        if (d == 0) {
+            // the root stays in place: its halves move down under a new root
+            int left = alloc_block(fs, DIR_ROOT + 1);
+            block_write(fs, left, node);
+            block_write(fs, sibling, right);
+
+            memset(node, 0, BLOCK_SIZE);
+            node[0] = 1;
+            node_put(node + 3, left);
+            node_insert(node, 0, key, len, sibling);
+            return block_write(fs, DIR_ROOT, node);
+        }
+
+        block_write(fs, path.block[d], node);
+        block_write(fs, sibling, right);
+
+        memset(node, 0, sizeof(node));
+        if (block_read(fs, path.block[d - 1], node) < 0) return -1;
+        k = path.index[d - 1];
+        value = sibling;
+    }
+    return -1;
+}
+
+int dir_remove(fs_node_t* fs, const char* name)
+{
+    if (!name_ok(name)) return -1;
+
+    byte node[BLOCK_SIZE];
+    dir_path_t path;
+    if (dir_descend(fs, name, node, &path) < 0) return -1;
+
+    int at, exact;
+    int k = node_search(node, name, strlen(name), &at, &exact);
+    if (!exact) return -1;
+    node_delete(node, k);
+
+    // an emptied leaf goes, and so does each inner node left without children
+    int d = path.depth - 1;
+    int gone = NODE_COUNT(node) == 0;
+    while (gone && d > 0) {
+        free_block(fs, path.block[d]);
+        d--;
+        if (block_read(fs, path.block[d], node) < 0) return -1;
+
+        k = path.index[d];
+        gone = 0;
+        if (k >= 0) {
+            node_delete(node, k);
+        } else if (NODE_COUNT(node) > 0) {
+            node_put(node + 3, ENTRY_VALUE(node, DIR_NODE_HEADER));
+            node_delete(node, 0);
+        } else {
+            gone = 1;
+        }
+    }
+    if (gone) {
+        memset(node, 0, BLOCK_SIZE);  // the root is an empty leaf again
+    }
+    if (block_write(fs, path.block[d], node) < 0) return -1;
+
+    // a root left with a single child takes the child's place, every leaf
+    // moving one level up
+    if (block_read(fs, DIR_ROOT, node) < 0) return -1;
+    while (NODE_INNER(node) && NODE_COUNT(node) == 0) {
+        int child = NODE_FIRST(node);
+        if (block_read(fs, child, node) < 0 || block_write(fs, DIR_ROOT, node) < 0) return -1;
+        free_block(fs, child);
+    }
+    return 0;
+}
+
+// first name after from, or at it too unless strict
+static int dir_scan(fs_node_t* fs, const char * from, int strict, char name[FILE_NAME_MAX + 1])
+{
+    byte node[BLOCK_SIZE];
+    dir_path_t path;
+    if (from == NULL || dir_descend(fs, from, node, &path) < 0) return -1;
+
+    int len = strlen(from);
+    int at = DIR_NODE_HEADER;
+    int k = 0;
+    while (k < NODE_COUNT(node)) {
+        int c = entry_cmp(node + at, from, len);
+        if (c > 0 || (c == 0 && !strict)) break;
+        at += ENTRY_SIZE(node, at);
+        k++;
+    }
+
+    // past the leaf's last name, the next leaf hangs off the nearest ancestor
+    // with a child right of the path
+    int d = path.depth - 1;
+    while (k == NODE_COUNT(node)) {
+        int next = -1;
+        while (next == -1 && --d >= 0) {
+            if (block_read(fs, path.block[d], node) < 0) return -1;
+            if (path.index[d] + 1 < NODE_COUNT(node)) {
+                path.index[d]++;
+                next = ENTRY_VALUE(node, entry_at(node, path.index[d]));
+            }
+        }
+        if (next == -1) return -1;
+
+        while (d < DIR_MAX_DEPTH - 1) {
+            path.block[++d] = next;
+            if (block_read(fs, next, node) < 0) return -1;
+            if (!NODE_INNER(node)) break;
+            path.index[d] = -1;
+            next = NODE_FIRST(node);
+        }
+        at = DIR_NODE_HEADER;
+        k = 0;
+    }
+
+    memcpy(name, node + at + 1, node[at]);
+    name[node[at]] = '\0';
+    return ENTRY_VALUE(node, at);
+}
+
+int dir_first(fs_node_t* fs, const char* from, char name[FILE_NAME_MAX + 1])
+{
+    return dir_scan(fs, from, 0, name);
+}
+
+int dir_next(fs_node_t* fs, const char* after, char name[FILE_NAME_MAX + 1])
+{
+    return dir_scan(fs, after, 1, name);
+}
+
+static void dir_walk(fs_node_t* fs, int block, int depth, int * counts)
+{
+    byte node[BLOCK_SIZE];
+    if (depth >= DIR_MAX_DEPTH || block_read(fs, block, node) < 0) return;
+
+    counts[1]++;
+    if (depth + 1 > counts[2]) counts[2] = depth + 1;
+    if (!NODE_INNER(node)) {
+        counts[0] += NODE_COUNT(node);
+        return;
+    }
+
+    dir_walk(fs, NODE_FIRST(node), depth + 1, counts);
+    int at = DIR_NODE_HEADER;
+    for (int k = 0; k < NODE_COUNT(node); k++) {
+        dir_walk(fs, ENTRY_VALUE(node, at), depth + 1, counts);
+        at += ENTRY_SIZE(node, at);
+    }
+}
+
+void dir_stats(fs_node_t* fs)
+{
+    int counts[3] = { 0 };  // names, blocks, depth
+    dir_walk(fs, DIR_ROOT, 0, counts);
+    printf("directory: %d names in %d blocks, %d levels\n", counts[0], counts[1], counts[2]);
+}
@@ -1,7 +1,15 @@
+#include <stdlib.h>
 #include "efs.h"
 #include "fs.h"
-
-int get_fd_info(fs_node_t* fs, int i, int section) // 4 SECTIONS (BYTES): FILE_LENGTH (4) | BLOCK 0 (4) | BLOCK 1 (4) | BLOCK 2 (4) | 
+#include "extent.h"
+#include "dir.h"
+#include "block.h"
+#include "dedup.h"
+#include "checksum.h"
+#include "merkle.h"
+#include "tier.h"
+
+int get_fd_info(fs_node_t* fs, int i, int section) // 4 SECTIONS (BYTES): FILE_LENGTH (4) | EXTENT 0 (4) | EXTENT 1 (4) | EXTENT TREE (4) | 
 {
     if (i < 0 || i >= N_FILE_DESC) return -1;
 
@@ -33,50 +41,6 @@ int write_fd_info(fs_node_t* fs, int info, int fd, int section)
     return 0;
 }
 
-int get_dir_info_name (fs_node_t* fs, int block, char name[4]) // 2 SECTIONS (BYTES): FILE_NAME (4) | DESCRIPTOR_INDEX (4)
-{
-    // OFT[0] ~ dir
-    byte *start_pos = fs->OFT[0].rw_buffer + block * 8;
-    for (int i = 0; i < 4; i++) {
-        name[i] = start_pos[i];
-    }
-    return 0;
-}
-
-int get_dir_info_desc (fs_node_t* fs, int block) // 2 SECTIONS (BYTES): FILE_NAME (4) | DESCRIPTOR_INDEX (4)
-{
-    // OFT[0] ~ dir
-    byte * start_pos = fs->OFT[0].rw_buffer + block * 8 + 4;
-    int info = 0;
-    for (int i = 0; i < 4; i++) {
-        info |= ((int) start_pos[i]) << (i * BITS_PER_BYTE);
-    }
-    
-    return info;
-}
-
-int write_dir_info(fs_node_t* fs, void * info, int block, int section) 
-{
-    if (block < 0 || block >= 64) return -1;
-
-    byte * start_pos = fs->OFT[0].rw_buffer + block * BITS_PER_BYTE + section * 4;
-
-    if (section == 0) {
-        byte * info_value = (byte *) info;
-        for (int i = 0; i < 4; i++) {
-            start_pos[i] = info_value[i];
-        }
-
-    } else {
-        int info_value = *(int *)info;
-        for (int i = 0; i < 4; i++) {
-            start_pos[i] = (info_value >> (i * BITS_PER_BYTE)) & 0xff;
-        }
-    }
-    
-    return 0;
-}
-
 int get_bit_map_info(fs_node_t* fs, int block) {
     byte byte = fs->O[BIT_MAP_BLOCK(block)];
     return (byte >> BIT_MAP_OFFSET(block)) & 0x1;
@@ -85,7 +49,7 @@ int get_bit_map_info(fs_node_t* fs, int block) {
 int write_bit_map_info(fs_node_t* fs, int info, int block) {
     if (block < 1 || block > N_BLOCKS - 1) return -1;
 
-    byte * byte = fs->O[BIT_MAP_BLOCK(block)];
+    byte * byte = &fs->O[BIT_MAP_BLOCK(block)];
     int offset = BIT_MAP_OFFSET(block);
     // turn off
     if (info == 0) {
@@ -99,37 +63,251 @@ int write_bit_map_info(fs_node_t* fs, int info, int block) {
     return 0;
 }                                       
 
-///// FILE SYS MANIP OPERATIONS /////
+// first free data block at or after goal, wrapping around, so a file that grows
+// keeps landing on the block after its last one
+// caller has the bitmap loaded in fs->O and writes it back
+int alloc_block(fs_node_t* fs, int goal)
+{
+    if (goal < 8 || goal >= N_BLOCKS) goal = 8;
+
+    for (int n = 0; n < N_BLOCKS - 8; n++) {
+        int k = 8 + (goal - 8 + n) % (N_BLOCKS - 8);
+        if (get_bit_map_info(fs, k) == 0) {
+            write_bit_map_info(fs, 1, k);
+            dedup_track(fs, k);
+            merkle_touch(fs, k);
+            return k;
+        }
+    }
+    return -1;
+}
 
-int create(fs_node_t* fs, char name[4]) {
-    int seek_err = seek(fs, 0, 0);
-    if (seek_err < 0) {
-        return -1;
+int free_block_count(fs_node_t* fs)
+{
+    int count = 0;
+    for (int b = 8; b < N_BLOCKS; b++) {
+        count += get_bit_map_info(fs, b) == 0;
     }
-    
-    // check if file_name exists
-    int free_entry = -1;
-    for (int i = 0; i < BLOCK_SIZE / 8; i++) {
-        char file_name[4];
-        get_dir_info_name(fs, i, file_name);
-        
-        if (strcmp(name, file_name) == 0) {
-            return -1;  // File already exists
+    return count;
+}
+
+// drops one owner of a data block, the bit is cleared once no file maps it
+void free_block(fs_node_t* fs, int block)
+{
+    if (fs->dedup != NULL && dedup_unref(fs, block) > 0) return;
+    write_bit_map_info(fs, 0, block);
+    checksum_forget(fs, block);
+    merkle_touch(fs, block);
+}
+
+///// OPEN FILE WINDOW /////
+// each open file keeps up to OFT_WINDOW blocks pinned in the node's block cache.
+// Sequential access reads ahead, dirty blocks are handed back to the cache for
+// write-behind when they leave the window or on close
+
+static void window_reset(OFT_entry* e)
+{
+    for (int k = 0; k < OFT_WINDOW; k++) {
+        e->window[k].data = NULL;
+        e->window[k].block = -1;
+        e->window[k].disk_block = -1;
+        e->window[k].dirty = 0;
+        e->window[k].last_use = 0;
+    }
+    e->tick = 0;
+    e->next_block = 0;
+    e->seq_run = 0;
+}
+
+static void window_release(fs_node_t* fs, oft_slot_t* slot)
+{
+    if (slot->block == -1) return;
+
+    block_unpin(fs, slot->disk_block, slot->dirty);
+    if (slot->dirty) fs->window_writebacks++;
+
+    slot->data = NULL;
+    slot->block = -1;
+    slot->disk_block = -1;
+    slot->dirty = 0;
+}
+
+static void window_flush(fs_node_t* fs, int i)
+{
+    for (int k = 0; k < OFT_WINDOW; k++) {
+        window_release(fs, &fs->OFT[i].window[k]);
+    }
+}
+
+static oft_slot_t * window_find(OFT_entry* e, int blk)
+{
+    for (int k = 0; k < OFT_WINDOW; k++) {
+        if (e->window[k].block == blk) return &e->window[k];
+    }
+    return NULL;
+}
+
+// empty slot first, otherwise the least recently used one other than keep
+static oft_slot_t * window_victim(fs_node_t* fs, OFT_entry* e, int keep)
+{
+    oft_slot_t * victim = NULL;
+    for (int k = 0; k < OFT_WINDOW; k++) {
+        oft_slot_t * slot = &e->window[k];
+        if (slot->block == -1) return slot;
+        if (slot->block == keep) continue;
+        if (victim == NULL || slot->last_use < victim->last_use) victim = slot;
+    }
+
+    window_release(fs, victim);
+    return victim;
+}
+
+// caller has the descriptor block in fs->I and, with alloc set, the bitmap in fs->O
+static oft_slot_t * window_load(fs_node_t* fs, int i, int blk, int alloc, int keep)
+{
+    OFT_entry * e = &fs->OFT[i];
+
+    int disk_block = extent_lookup(fs, e->fd, blk);
+    if (disk_block == -1) {
+        // files only grow at their end, earlier blocks and reserved ones are always mapped
+        if (!alloc || blk != extent_block_count(fs, e->fd)) return NULL;
+
+        disk_block = alloc_block(fs, extent_lookup(fs, e->fd, blk - 1) + 1);
+        if (disk_block == -1) return NULL;
+        if (extent_append(fs, e->fd, disk_block) < 0) {
+            free_block(fs, disk_block);
+            return NULL;
         }
-        
-        if (free_entry == -1 && memcmp(file_name, "\0\0\0\0", 4) == 0) {
-            free_entry = i;
+
+        oft_slot_t * slot = window_victim(fs, e, keep);
+        slot->data = block_pin(fs, disk_block);
+        if (slot->data == NULL) return NULL;
+
+        memset(slot->data, 0, BLOCK_SIZE);
+        slot->dirty = 1;
+        slot->block = blk;
+        slot->disk_block = disk_block;
+        return slot;
+    }
+
+    oft_slot_t * slot = window_victim(fs, e, keep);
+    slot->data = block_pin(fs, disk_block);
+    if (slot->data == NULL) return NULL;
+
+    // a block wholly past the end was reserved and never written, whatever
+    // it held before is zeroed here rather than when it was reserved
+    slot->dirty = 0;
+    if (alloc && blk * BLOCK_SIZE >= e->file_size) {
+        memset(slot->data, 0, BLOCK_SIZE);
+        slot->dirty = 1;
+    }
+    slot->block = blk;
+    slot->disk_block = disk_block;
+    return slot;
+}
+
+// sequential-pattern detection: each access that moves on to the next block
+// grows the readahead distance up to the window size, any jump resets it
+static void window_track(fs_node_t* fs, int i, int blk)
+{
+    OFT_entry * e = &fs->OFT[i];
+    if (blk == e->next_block - 1) return;  // still inside the same block
+
+    e->seq_run = (blk == e->next_block) ? e->seq_run + 1 : 0;
+    e->next_block = blk + 1;
+
+    int ahead = e->seq_run < OFT_WINDOW - 1 ? e->seq_run : OFT_WINDOW - 1;
+    int last_block = (e->file_size - 1) / BLOCK_SIZE;
+
+    for (int b = blk + 1; b <= blk + ahead && b <= last_block; b++) {
+        if (window_find(e, b) != NULL) continue;
+
+        // ranked past the block in use by their distance, so the blocks behind
+        // the reader go first and a later readahead never evicts an earlier one
+        oft_slot_t * slot = window_load(fs, i, b, 0, blk);
+        if (slot == NULL) break;
+        slot->last_use = e->tick + (b - blk);
+        fs->readahead_blocks++;
+    }
+}
+
+///// FORMAT /////
+// init rewrites only block 0, the directory's descriptor block and the directory
+// root. The superblock at the tail of block 0 counts formats and records the
+// format each descriptor block was last laid out in; a block left from an
+// earlier one is laid out when create first reaches it, and data blocks are
+// written in full as they are allocated, so what a format leaves behind is
+// never read
+
+static int super_get(const byte* super, int offset)
+{
+    int info = 0;
+    for (int j = 0; j < 4; j++) {
+        info |= ((int)super[offset + j]) << (j * BITS_PER_BYTE);
+    }
+    return info;
+}
+
+static void super_put(byte* super, int offset, int info)
+{
+    for (int j = 0; j < 4; j++) {
+        super[offset + j] = (info >> (j * BITS_PER_BYTE)) & 0xff;
+    }
+}
+
+// reads descriptor block b into fs->I, laying it out first if this format has not
+static int fd_block_load(fs_node_t* fs, int b)
+{
+    byte super[BLOCK_SIZE];
+    if (block_read(fs, 0, super) < 0 || block_read(fs, b, fs->I) < 0) return -1;
+
+    int generation = super_get(super, SUPER_GENERATION);
+    if (super_get(super, SUPER_FD_STAMP(b)) == generation) return 0;
+
+    // every descriptor but the directory's starts free, the directory tree is rooted in block 7
+    memset(fs->I, 0, BLOCK_SIZE);
+    for (int i = 0; i < N_FILE_DESC; i++) {
+        if (FD_BLOCK(i) != b) continue;
+
+        if (i == 0) {
+            write_fd_info(fs, EXTENT(DIR_ROOT, 1), 0, EXT_INLINE);
+        } else {
+            write_fd_info(fs, -1, i, 0);
         }
     }
+    if (block_write(fs, b, fs->I) < 0) return -1;
+
+    // a caller holding the bitmap writes the stamp back along with it
+    super_put(super, SUPER_FD_STAMP(b), generation);
+    super_put(fs->O, SUPER_FD_STAMP(b), generation);
+    return block_write(fs, 0, super);
+}
+
+int block_formatted(fs_node_t* fs, int block)
+{
+    byte super[BLOCK_SIZE];
+    if (block < 0 || block >= N_BLOCKS) return 0;
+    if (block == 0 || block == DIR_ROOT || block_read(fs, 0, super) < 0) return 1;
+
+    if (block < DIR_ROOT) {
+        return super_get(super, SUPER_FD_STAMP(block)) == super_get(super, SUPER_GENERATION);
+    }
+    return (super[BIT_MAP_BLOCK(block)] >> BIT_MAP_OFFSET(block)) & 0x1;
+}
 
-    if (free_entry == -1) return -1;  // No free directory entry
+///// FILE SYS MANIP OPERATIONS /////
+
+int create(fs_node_t* fs, const char* name) {
+    if (dir_lookup(fs, name) != -1) {
+        return -1;  // File already exists
+    }
 
     // search for free file descriptor
     int free_fd = -1;
     for (int i = 1; i < N_FILE_DESC; i++) {
         // load in new block of fd every 32 descriptors
-        if (i % 32 == 0 || i == 1) {
-            memcpy(fs->I, fs->D[1 + (i / 32)], BLOCK_SIZE);
+        if ((i % 32 == 0 || i == 1) && fd_block_load(fs, 1 + (i / 32)) < 0) {
+            return -1;
         }
 
         int file_length = get_fd_info(fs, i, 0);
@@ -142,39 +320,20 @@ int create(fs_node_t* fs, char name[4]) {
 
     if (free_fd == -1) return -1;  // No free descriptor
 
-    // Update directory
-    write_dir_info(fs, name, free_entry, 0);
-    write_dir_info(fs, &free_fd, free_entry, 1);
+    // Update directory, a split may take blocks
+    if (block_read(fs, 0, fs->O) < 0) return -1;
+    if (dir_insert(fs, name, free_fd) < 0) return -1;
 
-    // Write descriptor and directory back to disk
-    memcpy(fs->D[1 + free_fd/32], fs->I, BLOCK_SIZE);
-    memcpy(fs->D[7], fs->OFT[0].rw_buffer, BLOCK_SIZE);
+    // Write descriptor and bitmap back to disk
+    if (block_write(fs, 1 + free_fd/32, fs->I) < 0) return -1;
+    if (block_write(fs, 0, fs->O) < 0) return -1;
     
     return 0;
 }
 
-int destroy(fs_node_t* fs, char name[4]) 
+int destroy(fs_node_t* fs, const char* name) 
 {
-    int seek_err = seek(fs, 0, 0);
-    if (seek_err < 0) {
-        return -1;
-    }
-
-    // search through directory for matching filenames
-    int fd = -1;
-    int dir_index = -1;
-    
-    for (int i = 0; i < BLOCK_SIZE / 8; i++) {
-        char file_name[4];
-        get_dir_info_name(fs, i, file_name);
-
-        if (strcmp(file_name, name) == 0) {
-            fd = get_dir_info_desc(fs, i);
-            dir_index = i;
-            break;
-        }
-    }
-
+    int fd = dir_lookup(fs, name);
     if (fd == -1) return -1;  // File not found
 
     // Check if file is open
@@ -186,48 +345,26 @@ int destroy(fs_node_t* fs, char name[4])
 
     // Free the file descriptor and blocks
     int fd_block = FD_BLOCK(fd);
-    memcpy(fs->I, fs->D[fd_block], BLOCK_SIZE);
-    memcpy(fs->O, fs->D[0], BLOCK_SIZE);
+    if (block_read(fs, fd_block, fs->I) < 0) return -1;
+    if (block_read(fs, 0, fs->O) < 0) return -1;
 
     // Mark descriptor as free and free all blocks
     write_fd_info(fs, -1, fd, 0);
-    
-    for (int i = 1; i < 4; i++) {
-        int block = get_fd_info(fs, fd, i);
-
-        if (block != -1 && block > 0) {
-            write_bit_map_info(fs, 0, block);
-            write_fd_info(fs, -1, fd, i);  // FIX 2: Set to -1, not 0
-        }
-    }
+    extent_free_all(fs, fd);
 
-    // Clear directory entry
-    int zero = 0;
-    write_dir_info(fs, &zero, dir_index, 0);
-    write_dir_info(fs, &zero, dir_index, 1);  // FIX 3: Clear descriptor index too
+    // Clear directory entry, emptied nodes go back to the bitmap
+    dir_remove(fs, name);
     
     // Write changes back to disk
-    memcpy(fs->D[fd_block], fs->I, BLOCK_SIZE);
-    memcpy(fs->D[0], fs->O, BLOCK_SIZE);
-    memcpy(fs->D[7], fs->OFT[0].rw_buffer, BLOCK_SIZE);
+    if (block_write(fs, fd_block, fs->I) < 0) return -1;
+    if (block_write(fs, 0, fs->O) < 0) return -1;
 
     return 0;
 }
 
-int open(fs_node_t* fs, char name[4]) 
+int open(fs_node_t* fs, const char* name) 
 {   
-    int fd = -1;
-
-    // find file in dir, search through directory entries
-    for (int i = 0; i < BLOCK_SIZE / 8; i++) {  // 64 entries max in one block
-        char dir_name[4];
-        get_dir_info_name(fs, i, dir_name);
-        if (strcmp(name, dir_name) == 0) {
-            fd = get_dir_info_desc(fs, i);
-            break;
-        }
-    }
-
+    int fd = dir_lookup(fs, name);
     if (fd == -1) return -1;
 
     // file is already opened
@@ -240,42 +377,30 @@ int open(fs_node_t* fs, char name[4])
     int free_oft = -1;
     for (int i = 1; i < 4; i++) {
         if (fs->OFT[i].curr_pos == -1) {
-            memcpy(fs->I, fs->D[FD_BLOCK(fd)], BLOCK_SIZE);
+            block_read(fs, FD_BLOCK(fd), fs->I);
 
             free_oft = i;
             fs->OFT[i].fd = fd;
             fs->OFT[i].curr_pos = 0;
             fs->OFT[i].file_size = get_fd_info(fs, fd, 0);
             
+            window_reset(&fs->OFT[i]);
+
             // allocate properly if file_size == 0
-            if (fs->OFT[i].file_size == 0) {
-                int free_block = -1;
-                for (int j = 8; j < N_BLOCKS; j++) {
-                    if (get_bit_map_info(fs, j) == 0) {
-                        memcpy(fs->O, fs->D[0], BLOCK_SIZE);
-
-                        free_block = j;
-                        write_fd_info(fs, free_block, fd, 1);
-                        write_bit_map_info(fs, 1, free_block);
-                        
-                        memcpy(fs->D[FD_BLOCK(fd)], fs->I, BLOCK_SIZE);
-                        memset(fs->OFT[i].rw_buffer, 0, BLOCK_SIZE);
-                        memcpy(fs->D[0], fs->O, BLOCK_SIZE);
-                        break;
-                    }
-                }
-                
-                if (free_block == -1) {
+            if (fs->OFT[i].file_size == 0 && extent_block_count(fs, fd) == 0) {
+                block_read(fs, 0, fs->O);
+
+                int first_block = alloc_block(fs, 8);
+                if (first_block == -1 || extent_append(fs, fd, first_block) < 0) {
                     fs->OFT[i].fd = -1;
                     fs->OFT[i].curr_pos = -1;
                     fs->OFT[i].file_size = 0;
                     free_oft = -1;
-                }
+                } else {
+                    block_zero(fs, first_block);
 
-            } else {
-                int fd_first_block = get_fd_info(fs, fd, 1);
-                if (fd_first_block != -1) {
-                    memcpy(fs->OFT[i].rw_buffer, fs->D[fd_first_block], BLOCK_SIZE);
+                    block_write(fs, FD_BLOCK(fd), fs->I);
+                    block_write(fs, 0, fs->O);
                 }
             }
 
@@ -287,152 +412,356 @@ int open(fs_node_t* fs, char name[4])
 
 int close(fs_node_t* fs, int i) 
 {
-    if (i < 0 || i >= 4)
+    if (i < 1 || i >= 4)
         return -1;
 
     if (fs->OFT[i].curr_pos == -1)  // Check if entry is free
         return -1;
 
-    // Write current block back to disk
-    int curr_block = fs->OFT[i].curr_pos / BLOCK_SIZE;
-    int fd_section = curr_block + 1;
-    
-    memcpy(fs->I, fs->D[FD_BLOCK(fs->OFT[i].fd)], BLOCK_SIZE);
-    int disk_block = get_fd_info(fs, fs->OFT[i].fd, fd_section);
+    // Write buffered blocks back to disk
+    if (block_read(fs, FD_BLOCK(fs->OFT[i].fd), fs->I) < 0) return -1;
+    window_flush(fs, i);
 
-    if (disk_block != -1) {
-        memcpy(fs->D[disk_block], fs->OFT[i].rw_buffer, BLOCK_SIZE);
-    }
-
-    // Update file size in descriptor
+    // Update file size in descriptor, the entry stays open if that fails
     write_fd_info(fs, fs->OFT[i].file_size, fs->OFT[i].fd, 0);
-    memcpy(fs->D[FD_BLOCK(fs->OFT[i].fd)], fs->I, BLOCK_SIZE);
+    if (block_write(fs, FD_BLOCK(fs->OFT[i].fd), fs->I) < 0) return -1;
 
     // Mark OFT entry as free
     fs->OFT[i].fd = -1;
     fs->OFT[i].curr_pos = -1;
     fs->OFT[i].file_size = 0;
-    memset(fs->OFT[i].rw_buffer, 0, BLOCK_SIZE);
+    window_reset(&fs->OFT[i]);
 
     return 0;
 }
 
 int f_read(fs_node_t* fs, int i, int m, int n)
 {
-    if (i < 0 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
-    if (m < 0 || n < 0) return -1;
-    
-    memcpy(fs->I, fs->D[FD_BLOCK(fs->OFT[i].fd)], BLOCK_SIZE);
-    
-    int bytes_read = 0;
+    if (i < 1 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
+    if (m < 0 || m >= BLOCK_SIZE || n < 0) return -1;
+
+    if (n > BLOCK_SIZE - m) n = BLOCK_SIZE - m;
+
+    int bytes_read = f_pread(fs, i, &fs->M[m], n, fs->OFT[i].curr_pos);
+    if (bytes_read > 0) {
+        seek(fs, i, fs->OFT[i].curr_pos + bytes_read);
+    }
+
+    return bytes_read;
+}
+
+int f_write(fs_node_t* fs, int i, int m, int n)
+{
+    if (m < 0 || m >= BLOCK_SIZE || n < 0) return -1;
+
+    if (n > BLOCK_SIZE - m) n = BLOCK_SIZE - m;
+
+    return f_write_buf(fs, i, &fs->M[m], n);
+}
+
+int f_write_buf(fs_node_t* fs, int i, const void* buf, int n)
+{
+    if (i < 1 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
+
+    int bytes_written = f_pwrite(fs, i, buf, n, fs->OFT[i].curr_pos);
+    if (bytes_written > 0) {
+        seek(fs, i, fs->OFT[i].curr_pos + bytes_written);
+    }
+
+    return bytes_written;
+}
+
+int seek(fs_node_t* fs, int i, int p)
+{
+    if (i < 1 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
     
-    while (bytes_read < n && fs->OFT[i].curr_pos < fs->OFT[i].file_size) {
-        int buf_offset = fs->OFT[i].curr_pos % BLOCK_SIZE;
-        fs->M[m + bytes_read] = fs->OFT[i].rw_buffer[buf_offset];
+    if (p < 0 || p > fs->OFT[i].file_size) return -1;
 
-        bytes_read++;
-        fs->OFT[i].curr_pos++;
+    // blocks stay in the file's window, moving only moves the position
+    fs->OFT[i].curr_pos = p;
 
-        if (fs->OFT[i].curr_pos % BLOCK_SIZE == 0 && fs->OFT[i].curr_pos < fs->OFT[i].file_size) {
-            int next_block_section = (fs->OFT[i].curr_pos / BLOCK_SIZE) + 1;
-            int next_block = get_fd_info(fs, fs->OFT[i].fd, next_block_section);
+    return 0;
+}
 
-            if (next_block == -1) break;
+///// POSITIONAL I/O /////
 
-            memcpy(fs->OFT[i].rw_buffer, fs->D[next_block], BLOCK_SIZE);
-        }
+///// DEDUP /////
+// with dedup on, a window slot may sit on a block other files share. Writes
+// copy it first, and every block a write finishes is fingerprinted and either
+// indexed or folded onto an identical block already on the volume
+
+// gives slot a private copy of its shared block
+static int window_cow(fs_node_t* fs, int i, oft_slot_t* slot)
+{
+    int copy = alloc_block(fs, slot->disk_block + 1);
+    if (copy == -1) return -1;
+
+    byte * data = block_pin(fs, copy);
+    if (data == NULL) {
+        free_block(fs, copy);
+        return -1;
+    }
+    memcpy(data, slot->data, BLOCK_SIZE);
+
+    if (extent_remap(fs, fs->OFT[i].fd, slot->block, copy) < 0) {
+        block_unpin(fs, copy, 0);
+        free_block(fs, copy);
+        return -1;
+    }
+
+    block_unpin(fs, slot->disk_block, slot->dirty);
+    free_block(fs, slot->disk_block);
+
+    slot->data = data;
+    slot->disk_block = copy;
+    slot->dirty = 1;
+    fs->dedup->cow_copies++;
+    return 0;
+}
+
+static void dedup_block_written(fs_node_t* fs, int i, int blk)
+{
+    OFT_entry * e = &fs->OFT[i];
+    if (fs->dedup == NULL) return;
+
+    oft_slot_t * slot = window_find(e, blk);
+    if (slot == NULL) return;
+
+    fingerprint_t fp = fingerprint(slot->data, BLOCK_SIZE);
+    int match = dedup_find(fs, fp);
+    if (match == slot->disk_block) return;
+
+    if (match == -1) {
+        dedup_insert(fs, slot->disk_block, fp);
+        return;
+    }
+
+    byte * data = block_pin(fs, match);
+    if (data == NULL) return;
+
+    // the fingerprint only nominates a match, the bytes decide
+    if (memcmp(data, slot->data, BLOCK_SIZE) != 0 || extent_remap(fs, e->fd, blk, match) < 0) {
+        block_unpin(fs, match, 0);
+        return;
+    }
+    dedup_ref(fs, match);
+
+    // our copy is dropped without ever being written back
+    block_unpin(fs, slot->disk_block, 0);
+    free_block(fs, slot->disk_block);
+
+    slot->data = data;
+    slot->disk_block = match;
+    slot->dirty = 0;
+}
+
+// bytes of logical block blk of open file i from its window, with write set
+// the block is allocated if unmapped and marked dirty
+// caller has the file's descriptor block loaded in fs->I and, for writes, the bitmap in fs->O
+static byte * file_block_ptr(fs_node_t* fs, int i, int blk, int write)
+{
+    if (blk < 0) return NULL;
+
+    OFT_entry * e = &fs->OFT[i];
+
+    oft_slot_t * slot = window_find(e, blk);
+    if (slot != NULL) {
+        fs->window_hits++;
+    } else {
+        slot = window_load(fs, i, blk, write, -1);
+        if (slot == NULL) return NULL;
+        fs->window_misses++;
+    }
+
+    if (write && dedup_refs(fs, slot->disk_block) > 1 && window_cow(fs, i, slot) < 0) {
+        return NULL;
+    }
+
+    slot->last_use = ++e->tick;
+    tier_touch(fs, slot->disk_block);
+    if (write) {
+        slot->dirty = 1;
+        merkle_touch(fs, slot->disk_block);
+    }
+
+    window_track(fs, i, blk);
+
+    return slot->data;
+}
+
+int f_pread(fs_node_t* fs, int i, void* buf, int n, int offset)
+{
+    if (i < 1 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
+    if (buf == NULL || n < 0 || offset < 0) return -1;
+
+    if (offset >= fs->OFT[i].file_size) return 0;
+    if (n > fs->OFT[i].file_size - offset) {
+        n = fs->OFT[i].file_size - offset;
+    }
+
+    if (block_read(fs, FD_BLOCK(fs->OFT[i].fd), fs->I) < 0) return -1;
+
+    byte * dst = buf;
+    int bytes_read = 0;
+
+    while (bytes_read < n) {
+        int pos = offset + bytes_read;
+        int chunk = BLOCK_SIZE - pos % BLOCK_SIZE;
+        if (chunk > n - bytes_read) chunk = n - bytes_read;
+
+        // every block below the file size is mapped, so only the block layer fails here
+        byte * src = file_block_ptr(fs, i, pos / BLOCK_SIZE, 0);
+        if (src == NULL) return -1;
+
+        memcpy(dst + bytes_read, src + pos % BLOCK_SIZE, chunk);
+        bytes_read += chunk;
     }
 
     return bytes_read;
 }
 
-int f_write(fs_node_t* fs, int i, int m, int n)
+int f_pwrite(fs_node_t* fs, int i, const void* buf, int n, int offset)
 {
-    if (i < 0 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
-    
-    memcpy(fs->I, fs->D[FD_BLOCK(fs->OFT[i].fd)], BLOCK_SIZE);
-    memcpy(fs->O, fs->D[0], BLOCK_SIZE);
-    
-    int bytes_written = 0;
-    int max_file_size = 3 * BLOCK_SIZE;
+    if (i < 1 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
+    if (buf == NULL || n < 0 || offset < 0) return -1;
+
+    if (offset >= N_BLOCKS * BLOCK_SIZE) return 0;
+    if (n > N_BLOCKS * BLOCK_SIZE - offset) {
+        n = N_BLOCKS * BLOCK_SIZE - offset;  // can never fit more than the volume
+    }
 
-    while (bytes_written < n && fs->OFT[i].curr_pos < max_file_size) {
-        int buf_offset = fs->OFT[i].curr_pos % BLOCK_SIZE;
-        fs->OFT[i].rw_buffer[buf_offset] = fs->M[m + bytes_written];
-        fs->OFT[i].curr_pos++;
+    if (block_read(fs, FD_BLOCK(fs->OFT[i].fd), fs->I) < 0) return -1;
+    if (block_read(fs, 0, fs->O) < 0) return -1;
 
-        if (fs->OFT[i].curr_pos > fs->OFT[i].file_size) {
-            fs->OFT[i].file_size = fs->OFT[i].curr_pos;
+    const byte * src = buf;
+    int end = offset + n;
+    int failed = 0;
+
+    // a write past the end of file zero-fills the gap first
+    int pos = fs->OFT[i].file_size < offset ? fs->OFT[i].file_size : offset;
+
+    while (pos < end) {
+        int chunk = BLOCK_SIZE - pos % BLOCK_SIZE;
+        if (chunk > end - pos) chunk = end - pos;
+        if (pos < offset && chunk > offset - pos) chunk = offset - pos;
+
+        // a volume out of blocks ends the write short, anything else fails it
+        byte * dst = file_block_ptr(fs, i, pos / BLOCK_SIZE, 1);
+        if (dst == NULL) {
+            failed = free_block_count(fs) > 0;
+            break;
         }
 
-        if (fs->OFT[i].curr_pos % BLOCK_SIZE == 0 && bytes_written < n) {
-            int curr_fd_section = (fs->OFT[i].curr_pos / BLOCK_SIZE);
-            
-            if (curr_fd_section >= 3) {
-                break;
-            }
+        if (pos < offset) {
+            memset(dst + pos % BLOCK_SIZE, 0, chunk);
+        } else {
+            memcpy(dst + pos % BLOCK_SIZE, src + (pos - offset), chunk);
+        }
+        pos += chunk;
 
-            int curr_block = get_fd_info(fs, fs->OFT[i].fd, curr_fd_section);
-            memcpy(fs->D[curr_block], fs->OFT[i].rw_buffer, BLOCK_SIZE);
-
-            int next_block = get_fd_info(fs, fs->OFT[i].fd, curr_fd_section + 1);
-
-            if (next_block != -1) {
-                memcpy(fs->OFT[i].rw_buffer, fs->D[next_block], BLOCK_SIZE);
-            } else {
-                for (int k = 8; k < N_BLOCKS; k++) {
-                    if (get_bit_map_info(fs, k) == 0) {
-                        next_block = k;
-                        write_fd_info(fs, next_block, fs->OFT[i].fd, curr_fd_section + 1);
-                        write_bit_map_info(fs, 1, next_block);
-                        memset(fs->OFT[i].rw_buffer, 0, BLOCK_SIZE);
-                        break;
-                    }
-                }
-                
-                if (next_block == -1) {
-                    memcpy(fs->D[FD_BLOCK(fs->OFT[i].fd)], fs->I, BLOCK_SIZE);
-                    memcpy(fs->D[0], fs->O, BLOCK_SIZE);
-                    return bytes_written;
-                }
-            }
+        if (pos % BLOCK_SIZE == 0 || pos == end) {
+            dedup_block_written(fs, i, (pos - 1) / BLOCK_SIZE);
         }
+    }
 
-        bytes_written++;
+    if (pos > fs->OFT[i].file_size) {
+        fs->OFT[i].file_size = pos;
     }
 
-    memcpy(fs->D[FD_BLOCK(fs->OFT[i].fd)], fs->I, BLOCK_SIZE);
-    memcpy(fs->D[0], fs->O, BLOCK_SIZE);
+    // what did land is recorded either way
+    if (block_write(fs, FD_BLOCK(fs->OFT[i].fd), fs->I) < 0) failed = 1;
+    if (block_write(fs, 0, fs->O) < 0) failed = 1;
+    if (failed) return -1;
 
-    return bytes_written;
+    return pos > offset ? pos - offset : 0;
 }
 
-int seek(fs_node_t* fs, int i, int p)
+// first of count free blocks in a row at or after goal, wrapping around, -1 if
+// no such run is left
+// caller has the bitmap loaded in fs->O
+static int free_run_from(fs_node_t* fs, int goal, int count)
 {
-    if (i < 0 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
-    
-    if (p < 0 || p > fs->OFT[i].file_size) return -1;
+    if (goal < 8 || goal >= N_BLOCKS) goal = 8;
+
+    int run = 0;
+    for (int n = 0; n < N_BLOCKS - 8; n++) {
+        int k = 8 + (goal - 8 + n) % (N_BLOCKS - 8);
+        if (k == 8) run = 0;  // runs do not wrap
+        run = get_bit_map_info(fs, k) == 0 ? run + 1 : 0;
+        if (run == count) return k - count + 1;
+    }
+    return -1;
+}
 
-    int p_block = p / BLOCK_SIZE;
-    int curr_block = fs->OFT[i].curr_pos / BLOCK_SIZE;
-    
-    if (curr_block != p_block) {
-        memcpy(fs->I, fs->D[FD_BLOCK(fs->OFT[i].fd)], BLOCK_SIZE);
-        
-        int prev_block = get_fd_info(fs, fs->OFT[i].fd, curr_block + 1);
-
-        if (prev_block != -1) {
-            memcpy(fs->D[prev_block], fs->OFT[i].rw_buffer, BLOCK_SIZE);
-            int new_block = get_fd_info(fs, fs->OFT[i].fd, p_block + 1);
-            if (new_block != -1) {
-                memcpy(fs->OFT[i].rw_buffer, fs->D[new_block], BLOCK_SIZE);
-            }
+int f_allocate(fs_node_t* fs, int i, int size)
+{
+    if (i < 1 || i >= 4 || fs->OFT[i].curr_pos == -1) return -1;
+    if (size < 0 || size > N_BLOCKS * BLOCK_SIZE) return -1;
+
+    int fd = fs->OFT[i].fd;
+    block_read(fs, FD_BLOCK(fd), fs->I);
+    block_read(fs, 0, fs->O);
+
+    int count = extent_block_count(fs, fd);
+    int need = (size + BLOCK_SIZE - 1) / BLOCK_SIZE - count;
+    if (need <= 0) return 0;
+
+    if (free_block_count(fs) < need) return -1;
+
+    // one run right after the last block if there is room, else block by block
+    int goal = count > 0 ? extent_lookup(fs, fd, count - 1) + 1 : 8;
+    int start = free_run_from(fs, goal, need);
+
+    int reserved = 0;
+    while (reserved < need) {
+        int block = alloc_block(fs, start != -1 ? start + reserved : goal);
+        if (block == -1) break;
+        if (extent_append(fs, fd, block) < 0) {
+            free_block(fs, block);
+            break;
         }
+        goal = block + 1;
+        reserved++;
     }
 
-    fs->OFT[i].curr_pos = p;
+    block_write(fs, FD_BLOCK(fd), fs->I);
+    block_write(fs, 0, fs->O);
+    fs->blocks_reserved += reserved;
+    return reserved == need ? reserved : -1;
+}
 
-    return 0;
+int f_preadv(fs_node_t* fs, int i, const struct iovec* iov, int iovcnt, int offset)
+{
+    if (iov == NULL || iovcnt < 0) return -1;
+
+    int total = 0;
+    for (int k = 0; k < iovcnt; k++) {
+        int len = (int) iov[k].iov_len;
+        int bytes = f_pread(fs, i, iov[k].iov_base, len, offset + total);
+        if (bytes < 0) return total > 0 ? total : -1;
+
+        total += bytes;
+        if (bytes < len) break;  // end of file
+    }
+
+    return total;
+}
+
+int f_pwritev(fs_node_t* fs, int i, const struct iovec* iov, int iovcnt, int offset)
+{
+    if (iov == NULL || iovcnt < 0) return -1;
+
+    int total = 0;
+    for (int k = 0; k < iovcnt; k++) {
+        int len = (int) iov[k].iov_len;
+        int bytes = f_pwrite(fs, i, iov[k].iov_base, len, offset + total);
+        if (bytes < 0) return total > 0 ? total : -1;
+
+        total += bytes;
+        if (bytes < len) break;  // file or volume full
+    }
+
+    return total;
 }
 
 
@@ -468,80 +797,224 @@ int write_memory(fs_node_t* fs, int m, char* string) {
     return bytes_written;
 }
 
-///// INIT /////
-int init(fs_node_t* fs) {
-    memset(fs->D, 0, sizeof(fs->D));
+///// DEFRAGMENTATION /////
+// a file's blocks go wherever the bitmap had room when it grew, so files that
+// grew side by side or into holes end up scattered. Defragmenting moves every
+// block of a file into one run; the result depends only on the volume, so
+// replicas applying the same logged entry keep the same layout
 
-    fs->D[0][0] = 0xff;
+// runs the file's blocks form, an extent tree counting as one more
+// caller has the file's descriptor block loaded in fs->I
+static int fd_runs(fs_node_t* fs, int fd)
+{
+    int runs = get_fd_info(fs, fd, EXT_TREE) > 0;
+    int count = extent_block_count(fs, fd);
+    int prev = -2;
+
+    for (int b = 0; b < count; b++) {
+        int disk_block = extent_lookup(fs, fd, b);
+        if (disk_block != prev + 1) runs++;
+        prev = disk_block;
+    }
+    return runs;
+}
 
-    memcpy(fs->I, fs->D[1], BLOCK_SIZE);
-    write_fd_info(fs, 0, 0, 1);
-    memcpy(fs->D[1], fs->I, BLOCK_SIZE);
+int file_runs(fs_node_t* fs, const char* name)
+{
+    int fd = dir_lookup(fs, name);
+    if (fd == -1) return -1;
 
-    for (int i = 1; i < N_FILE_DESC; i++) {
-        int fd_block = FD_BLOCK(i);
-        int fd_offset = FD_OFFSET(i);
-        byte * fd_pos = fs->D[fd_block][fd_offset];
-        
-        for (int j = 0; j < 4; j++) {
-            *(fd_pos + j) = 0xFF;
+    block_read(fs, FD_BLOCK(fd), fs->I);
+    return fd_runs(fs, fd);
+}
+
+// first block of the run a scattered file would move into, -1 if it is one
+// run already, shares blocks with other files or no run of its length fits
+// caller has the descriptor block in fs->I and the bitmap in fs->O
+static int defrag_target(fs_node_t* fs, int fd)
+{
+    if (fd_runs(fs, fd) <= 1) return -1;
+
+    byte owned[N_BLOCKS] = { 0 };
+    extent_owned(fs, fd, owned);
+    for (int b = 0; b < N_BLOCKS; b++) {
+        if (owned[b] && dedup_refs(fs, b) > 1) return -1;
+    }
+
+    // the file's own blocks count as free, they are released before the move
+    int count = extent_block_count(fs, fd);
+    int run = 0;
+    for (int b = 8; b < N_BLOCKS; b++) {
+        run = get_bit_map_info(fs, b) == 0 || owned[b] ? run + 1 : 0;
+        if (run == count) return b - count + 1;
+    }
+    return -1;
+}
+
+int fragmented_file(fs_node_t* fs, const char* after, char name[FILE_NAME_MAX + 1])
+{
+    block_read(fs, 0, fs->O);
+    for (int fd = dir_next(fs, after, name); fd != -1; fd = dir_next(fs, name, name)) {
+        block_read(fs, FD_BLOCK(fd), fs->I);
+        if (defrag_target(fs, fd) != -1) return 0;
+    }
+    return -1;
+}
+
+int defragment(fs_node_t* fs, const char* name)
+{
+    int fd = dir_lookup(fs, name);
+    if (fd == -1) return -1;
+
+    // an open file's window holds its old blocks, they go back first
+    for (int i = 1; i < 4; i++) {
+        if (fs->OFT[i].curr_pos != -1 && fs->OFT[i].fd == fd) window_flush(fs, i);
+    }
+
+    block_read(fs, FD_BLOCK(fd), fs->I);
+    block_read(fs, 0, fs->O);
+    int start = defrag_target(fs, fd);
+    if (start == -1) return 0;
+
+    int count = extent_block_count(fs, fd);
+    int * old = malloc(count * sizeof(int));
+    byte * data = malloc((size_t) count * BLOCK_SIZE);
+    int failed = data == NULL || old == NULL;
+    for (int b = 0; !failed && b < count; b++) {
+        old[b] = extent_lookup(fs, fd, b);
+        failed = block_read(fs, old[b], data + b * BLOCK_SIZE) < 0;
+    }
+    if (failed) {
+        free(old);
+        free(data);
+        return -1;
+    }
+
+    // the old blocks are free again by the time the run is taken
+    extent_free_all(fs, fd);
+    int moved = 0;
+    int b = 0;
+    for (; b < count; b++) {
+        int block = alloc_block(fs, start + b);
+        if (block != start + b) {
+            if (block != -1) free_block(fs, block);
+            break;
         }
+        if (extent_append(fs, fd, block) < 0) {
+            free_block(fs, block);
+            break;
+        }
+
+        // blocks that stay put are written too, freeing them dropped their sums
+        block_write(fs, block, data + b * BLOCK_SIZE);
+        moved += old[b] != block;
     }
 
+    // the run could not be taken whole, the file goes back where it was; its
+    // old blocks are free again, only its tree may land somewhere new
+    if (b < count) {
+        extent_free_all(fs, fd);
+        moved = -1;
+        for (b = 0; b < count; b++) {
+            int block = alloc_block(fs, old[b]);
+            if (block == -1 || extent_append(fs, fd, block) < 0) break;
+            block_write(fs, block, data + b * BLOCK_SIZE);
+        }
+    }
+    free(old);
+    free(data);
+
+    block_write(fs, FD_BLOCK(fd), fs->I);
+    block_write(fs, 0, fs->O);
+    if (moved > 0) fs->blocks_defragmented += moved;
+    return moved;
+}
+
+///// INIT /////
+int init(fs_node_t* fs) {
+    if (fs->cache == NULL && fs->tier == NULL && block_open_memory(fs) < 0) return -1;
+
+    // sums and hashes of what was there no longer apply
+    if (fs->sums != NULL) {
+        memset(fs->sums->state, 0, sizeof(fs->sums->state));
+    }
+    if (fs->merkle != NULL) {
+        memset(fs->merkle->dirty, 1, sizeof(fs->merkle->dirty));
+    }
+
+    // the next format of a volume that has one, the first of one that does not
+    int generation = 1;
+    if (block_read(fs, 0, fs->O) == 0 && super_get(fs->O, SUPER_OFFSET) == SUPER_MAGIC) {
+        generation = super_get(fs->O, SUPER_GENERATION) + 1;
+    }
+
+    // blocks 0-7 hold the bitmap, descriptors and directory; every descriptor
+    // block is stamped with format 0, which none is ever in
+    memset(fs->O, 0, BLOCK_SIZE);
+    fs->O[0] = 0xff;
+    super_put(fs->O, SUPER_OFFSET, SUPER_MAGIC);
+    super_put(fs->O, SUPER_GENERATION, generation);
+    block_write(fs, 0, fs->O);
+
+    // the directory's descriptor is needed at once, a zeroed root is an empty leaf
+    if (fd_block_load(fs, FD_BLOCK(0)) < 0) return -1;
+    block_zero(fs, DIR_ROOT);
+
     memset(fs->I, 0, sizeof(fs->I));
     memset(fs->O, 0, sizeof(fs->O));
     memset(fs->M, 0, sizeof(fs->M));
 
-    fs->OFT[0].file_size = 0;
-    fs->OFT[0].curr_pos = 0;
-    fs->OFT[0].fd = 0;
-    memset(fs->OFT[0].rw_buffer, 0, BLOCK_SIZE);
-    memcpy(fs->O, fs->D[0], BLOCK_SIZE);
+    block_read(fs, 0, fs->O);
 
-    memcpy(fs->I, fs->D[1], BLOCK_SIZE);
-    write_fd_info(fs, 7, 0, 1);
-    memcpy(fs->D[1], fs->I, BLOCK_SIZE);
-
-    for (int i = 1; i < 4; i++) {
+    // slot 0 stays reserved and never opens, the directory lives in its tree
+    for (int i = 0; i < 4; i++) {
         fs->OFT[i].fd = -1;
         fs->OFT[i].curr_pos = -1;
         fs->OFT[i].file_size = 0;
-        memset(fs->OFT[i].rw_buffer, 0, BLOCK_SIZE);
-    } 
+        window_reset(&fs->OFT[i]);
+    }
+
+    fs->window_hits = 0;
+    fs->window_misses = 0;
+    fs->readahead_blocks = 0;
+    fs->window_writebacks = 0;
+    fs->blocks_reserved = 0;
+
+    // a fresh volume starts a fresh index
+    if (fs->dedup != NULL) {
+        dedup_disable(fs);
+        dedup_enable(fs);
+    }
     
     return 0; 
 }
 
-int directory(fs_node_t* fs)
+int directory(fs_node_t* fs, const char* prefix)
 {
-    int seek_err = seek(fs, 0, 0);
-    if (seek_err < 0) return -1;
-    
-    for (int i = 0; i < BLOCK_SIZE / 8; i++) {
-        char file_name[4];
-        get_dir_info_name(fs, i, file_name);
-
-        if (memcmp(file_name, "\0\0\0\0", 4) != 0) {
-            int fd = get_dir_info_desc(fs, i);
-        
-            int file_size = -1;
-            int found_in_oft = 0;
-            
-            for (int j = 1; j < 4; j++) {
-                if (fs->OFT[j].fd == fd && fs->OFT[j].curr_pos != -1) {
-                    file_size = fs->OFT[j].file_size;
-                    found_in_oft = 1;
-                    break;
-                }
-            }
-            
-            if (!found_in_oft) {
-                memcpy(fs->I, fs->D[1 + (fd / 32)], BLOCK_SIZE);
-                file_size = get_fd_info(fs, fd, 0);
+    int prefix_len = strlen(prefix);
+    char file_name[FILE_NAME_MAX + 1];
+
+    // the names sharing a prefix sit together, starting at the prefix itself
+    for (int fd = dir_first(fs, prefix, file_name); fd != -1; fd = dir_next(fs, file_name, file_name)) {
+        if (strncmp(file_name, prefix, prefix_len) != 0) break;
+
+        int file_size = -1;
+        int found_in_oft = 0;
+
+        for (int j = 1; j < 4; j++) {
+            if (fs->OFT[j].fd == fd && fs->OFT[j].curr_pos != -1) {
+                file_size = fs->OFT[j].file_size;
+                found_in_oft = 1;
+                break;
             }
-            
-            printf("%s %d\n", file_name, file_size);
         }
+
+        if (!found_in_oft) {
+            block_read(fs, 1 + (fd / 32), fs->I);
+            file_size = get_fd_info(fs, fd, 0);
+        }
+
+        printf("%s %d\n", file_name, file_size);
     }
     
     return 0;
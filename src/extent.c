@@ -0,0 +1,615 @@
+#include "extent.h"
+#include "efs.h"
+#include "block.h"
+
+#define EXT_MAX_DEPTH 8
+
+static int node_get(byte * node, int offset)
+{
+    int info = 0;
+    for (int j = 0; j < 4; j++) {
+        info |= ((int)node[offset + j]) << (j * BITS_PER_BYTE);
+    }
+    return info;
+}
+
+static void node_put(byte * node, int offset, int info)
+{
+    for (int j = 0; j < 4; j++) {
+        node[offset + j] = (info >> (j * BITS_PER_BYTE)) & 0xff;
+    }
+}
+
+#define NODE_DEPTH(node) node_get(node, 0)
+#define NODE_COUNT(node) node_get(node, 4)
+#define NODE_KEY(node, k) node_get(node, EXT_NODE_HEADER + (k) * 8)
+#define NODE_VALUE(node, k) node_get(node, EXT_NODE_HEADER + (k) * 8 + 4)
+
+static void node_init(byte * node, int depth)
+{
+    memset(node, 0, BLOCK_SIZE);
+    node_put(node, 0, depth);
+}
+
+static void node_add(byte * node, int key, int value)
+{
+    int count = NODE_COUNT(node);
+    node_put(node, EXT_NODE_HEADER + count * 8, key);
+    node_put(node, EXT_NODE_HEADER + count * 8 + 4, value);
+    node_put(node, 4, count + 1);
+}
+
+// last entry whose logical key is <= blk, -1 if blk precedes them all
+static int node_search(byte * node, int blk)
+{
+    int lo = 0;
+    int hi = NODE_COUNT(node) - 1;
+    int found = -1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (NODE_KEY(node, mid) <= blk) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+// leaf reached from root by following blk, or the rightmost path when blk < 0;
+// path collects the blocks visited from the root down
+static int find_leaf(fs_node_t* fs, int root, int blk, int * path, int * depth)
+{
+    int block = root;
+    int d = 0;
+
+    while (d < EXT_MAX_DEPTH) {
+        if (path != NULL) path[d] = block;
+        d++;
+
+        byte * node = block_pin(fs, block);
+        if (node == NULL) return -1;
+
+        if (NODE_DEPTH(node) == 0) {
+            block_unpin(fs, block, 0);
+            if (depth != NULL) *depth = d;
+            return block;
+        }
+
+        int k = blk < 0 ? NODE_COUNT(node) - 1 : node_search(node, blk);
+        int child = k < 0 ? -1 : NODE_VALUE(node, k);
+        block_unpin(fs, block, 0);
+
+        if (child <= 0) return -1;
+        block = child;
+    }
+    return -1;
+}
+
+int extent_lookup(fs_node_t* fs, int fd, int blk)
+{
+    if (blk < 0) return -1;
+
+    int root = get_fd_info(fs, fd, EXT_TREE);
+    if (root <= 0) {
+        int logical = 0;
+        for (int s = EXT_INLINE; s < EXT_INLINE + EXT_INLINE_COUNT; s++) {
+            int ext = get_fd_info(fs, fd, s);
+            if (EXTENT_EMPTY(ext)) break;
+
+            if (blk < logical + EXTENT_LEN(ext)) {
+                return EXTENT_START(ext) + (blk - logical);
+            }
+            logical += EXTENT_LEN(ext);
+        }
+        return -1;
+    }
+
+    int leaf = find_leaf(fs, root, blk, NULL, NULL);
+    byte * node = block_pin(fs, leaf);
+    if (node == NULL) return -1;
+
+    int result = -1;
+    int k = node_search(node, blk);
+    if (k >= 0) {
+        int ext = NODE_VALUE(node, k);
+        int offset = blk - NODE_KEY(node, k);
+        if (offset < EXTENT_LEN(ext)) result = EXTENT_START(ext) + offset;
+    }
+
+    block_unpin(fs, leaf, 0);
+    return result;
+}
+
+int extent_block_count(fs_node_t* fs, int fd)
+{
+    int root = get_fd_info(fs, fd, EXT_TREE);
+    if (root <= 0) {
+        int count = 0;
+        for (int s = EXT_INLINE; s < EXT_INLINE + EXT_INLINE_COUNT; s++) {
+            int ext = get_fd_info(fs, fd, s);
+            if (EXTENT_EMPTY(ext)) break;
+            count += EXTENT_LEN(ext);
+        }
+        return count;
+    }
+
+    // the last entry of the rightmost leaf ends the file
+    int leaf = find_leaf(fs, root, -1, NULL, NULL);
+    byte * node = block_pin(fs, leaf);
+    if (node == NULL) return 0;
+
+    int count = 0;
+    int last = NODE_COUNT(node) - 1;
+    if (last >= 0) {
+        count = NODE_KEY(node, last) + EXTENT_LEN(NODE_VALUE(node, last));
+    }
+
+    block_unpin(fs, leaf, 0);
+    return count;
+}
+
+// moves the two inline extents into a fresh leaf that becomes the tree root
+static int extent_make_tree(fs_node_t* fs, int fd)
+{
+    int root = alloc_block(fs, 8);
+    if (root == -1) return -1;
+
+    byte * leaf = block_pin(fs, root);
+    if (leaf == NULL) {
+        free_block(fs, root);
+        return -1;
+    }
+    node_init(leaf, 0);
+
+    int logical = 0;
+    for (int s = EXT_INLINE; s < EXT_INLINE + EXT_INLINE_COUNT; s++) {
+        int ext = get_fd_info(fs, fd, s);
+        node_add(leaf, logical, ext);
+        logical += EXTENT_LEN(ext);
+        write_fd_info(fs, 0, fd, s);
+    }
+    block_unpin(fs, root, 1);
+
+    write_fd_info(fs, root, fd, EXT_TREE);
+    return 0;
+}
+
+// a fresh node holding a single entry
+static int new_node(fs_node_t* fs, int depth, int key, int value)
+{
+    int block = alloc_block(fs, 8);
+    if (block == -1) return -1;
+
+    byte * node = block_pin(fs, block);
+    if (node == NULL) {
+        free_block(fs, block);
+        return -1;
+    }
+
+    node_init(node, depth);
+    node_add(node, key, value);
+    block_unpin(fs, block, 1);
+    return block;
+}
+
+static int extent_tree_append(fs_node_t* fs, int fd, int disk_block)
+{
+    int path[EXT_MAX_DEPTH];
+    int depth = 0;
+
+    int block = find_leaf(fs, get_fd_info(fs, fd, EXT_TREE), -1, path, &depth);
+    byte * leaf = block_pin(fs, block);
+    if (leaf == NULL) return -1;
+
+    int last = NODE_COUNT(leaf) - 1;
+    int last_ext = NODE_VALUE(leaf, last);
+    int logical = NODE_KEY(leaf, last) + EXTENT_LEN(last_ext);
+
+    // the new block continues the last run
+    if (EXTENT_START(last_ext) + EXTENT_LEN(last_ext) == disk_block && EXTENT_LEN(last_ext) < EXT_MAX_LEN) {
+        node_put(leaf, EXT_NODE_HEADER + last * 8 + 4, EXTENT(EXTENT_START(last_ext), EXTENT_LEN(last_ext) + 1));
+        block_unpin(fs, block, 1);
+        return 0;
+    }
+
+    if (NODE_COUNT(leaf) < EXT_NODE_ENTRIES) {
+        node_add(leaf, logical, EXTENT(disk_block, 1));
+        block_unpin(fs, block, 1);
+        return 0;
+    }
+    block_unpin(fs, block, 0);
+
+    // appends only ever fill the rightmost leaf, so a full node is never split
+    // in half: a new sibling starts with the new entry and is linked upward
+    int child = new_node(fs, 0, logical, EXTENT(disk_block, 1));
+    if (child == -1) return -1;
+
+    for (int level = depth - 2; level >= 0; level--) {
+        byte * parent = block_pin(fs, path[level]);
+        if (parent == NULL) return -1;
+
+        int parent_depth = NODE_DEPTH(parent);
+        if (NODE_COUNT(parent) < EXT_NODE_ENTRIES) {
+            node_add(parent, logical, child);
+            block_unpin(fs, path[level], 1);
+            return 0;
+        }
+        block_unpin(fs, path[level], 0);
+
+        child = new_node(fs, parent_depth, logical, child);
+        if (child == -1) return -1;
+    }
+
+    // the root itself was full: grow the tree by one level
+    int old_root = path[0];
+    byte * root = block_pin(fs, old_root);
+    if (root == NULL) return -1;
+    int root_depth = NODE_DEPTH(root);
+    block_unpin(fs, old_root, 0);
+
+    int new_root = new_node(fs, root_depth + 1, 0, old_root);
+    if (new_root == -1) return -1;
+
+    byte * node = block_pin(fs, new_root);
+    if (node == NULL) return -1;
+    node_add(node, logical, child);
+    block_unpin(fs, new_root, 1);
+
+    write_fd_info(fs, new_root, fd, EXT_TREE);
+    return 0;
+}
+
+typedef struct {
+    int key;
+    int ext;
+} run_t;
+
+// replaces the run holding blk with the pieces left around blk -> disk_block
+static int split_run(run_t run, int blk, int disk_block, run_t pieces[3])
+{
+    int offset = blk - run.key;
+    int start = EXTENT_START(run.ext);
+    int len = EXTENT_LEN(run.ext);
+    int n = 0;
+
+    if (offset > 0) {
+        pieces[n].key = run.key;
+        pieces[n++].ext = EXTENT(start, offset);
+    }
+
+    pieces[n].key = blk;
+    pieces[n++].ext = EXTENT(disk_block, 1);
+
+    if (offset < len - 1) {
+        pieces[n].key = blk + 1;
+        pieces[n++].ext = EXTENT(start + offset + 1, len - offset - 1);
+    }
+    return n;
+}
+
+// inserts (key, value) at pos in node path[level], splitting full nodes in half
+// and carrying the new sibling up to the parent
+static int tree_insert(fs_node_t* fs, int fd, int * path, int level, int pos, int key, int value)
+{
+    int block = path[level];
+    byte * node = block_pin(fs, block);
+    if (node == NULL) return -1;
+
+    int keys[EXT_NODE_ENTRIES + 1];
+    int values[EXT_NODE_ENTRIES + 1];
+    int count = 0;
+
+    for (int k = 0; k < NODE_COUNT(node); k++) {
+        if (k == pos) {
+            keys[count] = key;
+            values[count++] = value;
+        }
+        keys[count] = NODE_KEY(node, k);
+        values[count++] = NODE_VALUE(node, k);
+    }
+    if (pos >= NODE_COUNT(node)) {
+        keys[count] = key;
+        values[count++] = value;
+    }
+
+    int depth = NODE_DEPTH(node);
+    if (count <= EXT_NODE_ENTRIES) {
+        node_init(node, depth);
+        for (int k = 0; k < count; k++) {
+            node_add(node, keys[k], values[k]);
+        }
+        block_unpin(fs, block, 1);
+        return 0;
+    }
+    block_unpin(fs, block, 0);
+
+    // the sibling is filled and linked above before the node gives up its
+    // upper half, so a volume too full to split leaves the node as it was
+    int keep = count / 2;
+    int right = new_node(fs, depth, keys[keep], values[keep]);
+    if (right == -1) return -1;
+
+    byte * sibling = block_pin(fs, right);
+    if (sibling == NULL) {
+        free_block(fs, right);
+        return -1;
+    }
+    for (int k = keep + 1; k < count; k++) {
+        node_add(sibling, keys[k], values[k]);
+    }
+    block_unpin(fs, right, 1);
+
+    int new_root = -1;
+    if (level == 0) {
+        new_root = new_node(fs, depth + 1, keys[0], block);
+        if (new_root == -1) {
+            free_block(fs, right);
+            return -1;
+        }
+
+        byte * root = block_pin(fs, new_root);
+        if (root == NULL) {
+            free_block(fs, new_root);
+            free_block(fs, right);
+            return -1;
+        }
+        node_add(root, keys[keep], right);
+        block_unpin(fs, new_root, 1);
+    } else {
+        byte * parent = block_pin(fs, path[level - 1]);
+        if (parent == NULL) {
+            free_block(fs, right);
+            return -1;
+        }
+
+        int parent_pos = 0;
+        while (parent_pos < NODE_COUNT(parent) && NODE_VALUE(parent, parent_pos) != block) {
+            parent_pos++;
+        }
+        block_unpin(fs, path[level - 1], 0);
+
+        if (tree_insert(fs, fd, path, level - 1, parent_pos + 1, keys[keep], right) < 0) {
+            free_block(fs, right);
+            return -1;
+        }
+    }
+
+    node = block_pin(fs, block);
+    if (node == NULL) return -1;
+    node_init(node, depth);
+    for (int k = 0; k < keep; k++) {
+        node_add(node, keys[k], values[k]);
+    }
+    block_unpin(fs, block, 1);
+
+    if (new_root != -1) {
+        write_fd_info(fs, new_root, fd, EXT_TREE);
+    }
+    return 0;
+}
+
+static int extent_tree_insert(fs_node_t* fs, int fd, run_t run)
+{
+    int path[EXT_MAX_DEPTH];
+    int depth = 0;
+
+    int leaf = find_leaf(fs, get_fd_info(fs, fd, EXT_TREE), run.key, path, &depth);
+    byte * node = block_pin(fs, leaf);
+    if (node == NULL) return -1;
+    int pos = node_search(node, run.key) + 1;
+    block_unpin(fs, leaf, 0);
+
+    return tree_insert(fs, fd, path, depth - 1, pos, run.key, run.ext);
+}
+
+// points logical block blk of the file at disk_block, splitting the run that held it
+int extent_remap(fs_node_t* fs, int fd, int blk, int disk_block)
+{
+    run_t pieces[3];
+    int root = get_fd_info(fs, fd, EXT_TREE);
+
+    if (root <= 0) {
+        run_t runs[EXT_INLINE_COUNT + 2];
+        int n = 0;
+        int logical = 0;
+        int found = -1;
+
+        for (int s = EXT_INLINE; s < EXT_INLINE + EXT_INLINE_COUNT; s++) {
+            int ext = get_fd_info(fs, fd, s);
+            if (EXTENT_EMPTY(ext)) break;
+
+            if (blk >= logical && blk < logical + EXTENT_LEN(ext)) {
+                run_t run = { logical, ext };
+                int np = split_run(run, blk, disk_block, pieces);
+                for (int p = 0; p < np; p++) runs[n++] = pieces[p];
+                found = 1;
+            } else {
+                runs[n].key = logical;
+                runs[n++].ext = ext;
+            }
+            logical += EXTENT_LEN(ext);
+        }
+        if (found == -1) return -1;
+
+        // a piece that continues the run before it on disk joins that run, so
+        // a file folded onto a contiguous copy stays one run
+        int merged = 0;
+        for (int k = 0; k < n; k++) {
+            if (merged > 0) {
+                int prev = runs[merged - 1].ext;
+                int len = EXTENT_LEN(prev) + EXTENT_LEN(runs[k].ext);
+                if (EXTENT_START(prev) + EXTENT_LEN(prev) == EXTENT_START(runs[k].ext) && len <= EXT_MAX_LEN) {
+                    runs[merged - 1].ext = EXTENT(EXTENT_START(prev), len);
+                    continue;
+                }
+            }
+            runs[merged++] = runs[k];
+        }
+        n = merged;
+
+        if (n <= EXT_INLINE_COUNT) {
+            for (int s = 0; s < EXT_INLINE_COUNT; s++) {
+                write_fd_info(fs, s < n ? runs[s].ext : 0, fd, EXT_INLINE + s);
+            }
+            return 0;
+        }
+
+        // too many runs to stay inline
+        int leaf = new_node(fs, 0, runs[0].key, runs[0].ext);
+        if (leaf == -1) return -1;
+
+        byte * node = block_pin(fs, leaf);
+        if (node == NULL) return -1;
+        for (int k = 1; k < n; k++) {
+            node_add(node, runs[k].key, runs[k].ext);
+        }
+        block_unpin(fs, leaf, 1);
+
+        for (int s = EXT_INLINE; s < EXT_INLINE + EXT_INLINE_COUNT; s++) {
+            write_fd_info(fs, 0, fd, s);
+        }
+        write_fd_info(fs, leaf, fd, EXT_TREE);
+        return 0;
+    }
+
+    int depth = 0;
+    int leaf = find_leaf(fs, root, blk, NULL, &depth);
+    byte * node = block_pin(fs, leaf);
+    if (node == NULL) return -1;
+
+    int k = node_search(node, blk);
+    if (k < 0 || blk - NODE_KEY(node, k) >= EXTENT_LEN(NODE_VALUE(node, k))) {
+        block_unpin(fs, leaf, 0);
+        return -1;
+    }
+
+    run_t run = { NODE_KEY(node, k), NODE_VALUE(node, k) };
+    int np = split_run(run, blk, disk_block, pieces);
+
+    // the run is cut down before its other pieces go in. Each insert may split
+    // every level and add a root, and the first may have added a level for the
+    // second: without room for all of that nothing changes
+    if (free_block_count(fs) < (np - 1) * (depth + 2)) {
+        block_unpin(fs, leaf, 0);
+        return -1;
+    }
+
+    node_put(node, EXT_NODE_HEADER + k * 8, pieces[0].key);
+    node_put(node, EXT_NODE_HEADER + k * 8 + 4, pieces[0].ext);
+    block_unpin(fs, leaf, 1);
+
+    for (int p = 1; p < np; p++) {
+        if (extent_tree_insert(fs, fd, pieces[p]) < 0) return -1;
+    }
+    return 0;
+}
+
+// maps disk_block as the next logical block of the file
+int extent_append(fs_node_t* fs, int fd, int disk_block)
+{
+    if (get_fd_info(fs, fd, EXT_TREE) <= 0) {
+        for (int s = EXT_INLINE; s < EXT_INLINE + EXT_INLINE_COUNT; s++) {
+            int ext = get_fd_info(fs, fd, s);
+
+            if (EXTENT_EMPTY(ext)) {
+                write_fd_info(fs, EXTENT(disk_block, 1), fd, s);
+                return 0;
+            }
+
+            int next = s + 1 < EXT_INLINE + EXT_INLINE_COUNT ? get_fd_info(fs, fd, s + 1) : 0;
+            if (!EXTENT_EMPTY(next)) continue;
+
+            if (EXTENT_START(ext) + EXTENT_LEN(ext) == disk_block && EXTENT_LEN(ext) < EXT_MAX_LEN) {
+                write_fd_info(fs, EXTENT(EXTENT_START(ext), EXTENT_LEN(ext) + 1), fd, s);
+                return 0;
+            }
+        }
+
+        if (extent_make_tree(fs, fd) < 0) return -1;
+    }
+
+    return extent_tree_append(fs, fd, disk_block);
+}
+
+static void free_run(fs_node_t* fs, int ext)
+{
+    for (int b = 0; b < EXTENT_LEN(ext); b++) {
+        free_block(fs, EXTENT_START(ext) + b);
+    }
+}
+
+static void free_node(fs_node_t* fs, int block)
+{
+    byte * node = block_pin(fs, block);
+    if (node != NULL) {
+        for (int k = 0; k < NODE_COUNT(node); k++) {
+            if (NODE_DEPTH(node) > 0) {
+                free_node(fs, NODE_VALUE(node, k));
+            } else {
+                free_run(fs, NODE_VALUE(node, k));
+            }
+        }
+        block_unpin(fs, block, 0);
+    }
+    free_block(fs, block);
+}
+
+// releases every data and tree block of the file and clears its extents
+void extent_free_all(fs_node_t* fs, int fd)
+{
+    int root = get_fd_info(fs, fd, EXT_TREE);
+    if (root > 0) {
+        free_node(fs, root);
+    }
+
+    for (int s = EXT_INLINE; s < EXT_INLINE + EXT_INLINE_COUNT; s++) {
+        int ext = get_fd_info(fs, fd, s);
+        if (!EXTENT_EMPTY(ext)) {
+            free_run(fs, ext);
+        }
+    }
+
+    for (int s = EXT_INLINE; s <= EXT_TREE; s++) {
+        write_fd_info(fs, 0, fd, s);
+    }
+}
+
+static void mark_run(int ext, byte * owned)
+{
+    for (int b = 0; b < EXTENT_LEN(ext) && EXTENT_START(ext) + b < N_BLOCKS; b++) {
+        owned[EXTENT_START(ext) + b] = 1;
+    }
+}
+
+static void mark_node(fs_node_t* fs, int block, byte * owned)
+{
+    if (block <= 0 || block >= N_BLOCKS) return;
+    owned[block] = 1;
+
+    byte * node = block_pin(fs, block);
+    if (node == NULL) return;
+    for (int k = 0; k < NODE_COUNT(node); k++) {
+        if (NODE_DEPTH(node) > 0) {
+            mark_node(fs, NODE_VALUE(node, k), owned);
+        } else {
+            mark_run(NODE_VALUE(node, k), owned);
+        }
+    }
+    block_unpin(fs, block, 0);
+}
+
+// sets owned[b] for every data and tree block of the file
+void extent_owned(fs_node_t* fs, int fd, byte * owned)
+{
+    mark_node(fs, get_fd_info(fs, fd, EXT_TREE), owned);
+
+    for (int s = EXT_INLINE; s < EXT_INLINE + EXT_INLINE_COUNT; s++) {
+        int ext = get_fd_info(fs, fd, s);
+        if (!EXTENT_EMPTY(ext)) {
+            mark_run(ext, owned);
+        }
+    }
+}
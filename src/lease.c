@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "lease.h"
+
+long lease_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+void lease_init(lease_table_t* table) {
+    memset(table, 0, sizeof(lease_table_t));
+    for (int k = 0; k < LEASE_MAX; k++) {
+        table->leases[k].client = -1;
+    }
+    table->ttl_ms = LEASE_TTL_MS;
+}
+
+int lease_register(lease_table_t* table, lease_revoke_fn revoke, void* arg) {
+    for (int id = 0; id < LEASE_CLIENTS; id++) {
+        if (table->revoke[id] == NULL) {
+            table->revoke[id] = revoke;
+            table->arg[id] = arg;
+            return id;
+        }
+    }
+    return -1;
+}
+
+void lease_unregister(lease_table_t* table, int client) {
+    if (client < 0 || client >= LEASE_CLIENTS) {
+        return;
+    }
+    for (int k = 0; k < LEASE_MAX; k++) {
+        if (table->leases[k].client == client) {
+            table->leases[k].client = -1;
+        }
+    }
+    table->revoke[client] = NULL;
+    table->arg[client] = NULL;
+}
+
+long lease_grant(lease_table_t* table, int client, const char* name) {
+    if (table->ttl_ms <= 0 || strlen(name) > FILE_NAME_MAX || client < 0 || client >= LEASE_CLIENTS || table->revoke[client] == NULL) {
+        table->refused++;
+        return -1;
+    }
+
+    long now = lease_now();
+    lease_t* free_lease = NULL;
+    for (int k = 0; k < LEASE_MAX; k++) {
+        lease_t* lease = &table->leases[k];
+        if (lease->client != -1 && lease->expires <= now) {
+            lease->client = -1;
+            table->expired++;
+        }
+        if (lease->client == client && strcmp(lease->name, name) == 0) {
+            free_lease = lease;  // a renewal
+            break;
+        }
+        if (lease->client == -1 && free_lease == NULL) {
+            free_lease = lease;
+        }
+    }
+    if (free_lease == NULL) {
+        table->refused++;
+        return -1;
+    }
+
+    free_lease->client = client;
+    strcpy(free_lease->name, name);
+    free_lease->expires = now + table->ttl_ms;
+    table->granted++;
+    return free_lease->expires;
+}
+
+void lease_release(lease_table_t* table, int client, const char* name) {
+    for (int k = 0; k < LEASE_MAX; k++) {
+        lease_t* lease = &table->leases[k];
+        if (lease->client == client && strcmp(lease->name, name) == 0) {
+            lease->client = -1;
+        }
+    }
+}
+
+void lease_revoke(lease_table_t* table, const char* name) {
+    int every = name == NULL || name[0] == '\0';
+    long now = lease_now();
+
+    for (int k = 0; k < LEASE_MAX; k++) {
+        lease_t* lease = &table->leases[k];
+        if (lease->client == -1 || (!every && strcmp(lease->name, name) != 0)) {
+            continue;
+        }
+
+        int client = lease->client;
+        lease->client = -1;
+        if (lease->expires <= now) {
+            table->expired++;  // the holder already stopped trusting its copy
+            continue;
+        }
+        table->revoked++;
+        table->revoke[client](table->arg[client], lease->name);
+    }
+}
+
+void lease_stats(lease_table_t* table) {
+    int held = 0;
+    int clients = 0;
+    long now = lease_now();
+    for (int k = 0; k < LEASE_MAX; k++) {
+        held += table->leases[k].client != -1 && table->leases[k].expires > now;
+    }
+    for (int id = 0; id < LEASE_CLIENTS; id++) {
+        clients += table->revoke[id] != NULL;
+    }
+
+    printf("leases of %d ms: %d held by %d clients, %ld granted, %ld revoked, %ld expired, %ld refused\n",
+           table->ttl_ms, held, clients, table->granted, table->revoked, table->expired, table->refused);
+}
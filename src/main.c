@@ -0,0 +1,14 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "dfs.h"
+
+int main () {
+    dfs_t * dfs = calloc(1, sizeof(dfs_t));
+    pthread_mutex_init(&dfs->lock, NULL);
+    dfs_init(dfs);
+
+    dfs_destroy(dfs);
+    pthread_mutex_destroy(&dfs->lock);
+    free(dfs);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+#include "merkle.h"
+#include "block.h"
+#include "efs.h"
+
+int merkle_enable(fs_node_t* fs) {
+    if (fs->merkle != NULL) {
+        return 0;
+    }
+
+    merkle_t* merkle = calloc(1, sizeof(merkle_t));
+    if (merkle == NULL) {
+        return -1;
+    }
+
+    // nothing hashed yet, the first comparison builds the whole tree
+    memset(merkle->dirty, 1, sizeof(merkle->dirty));
+    fs->merkle = merkle;
+    return 0;
+}
+
+void merkle_disable(fs_node_t* fs) {
+    free(fs->merkle);
+    fs->merkle = NULL;
+}
+
+void merkle_touch(fs_node_t* fs, int block) {
+    merkle_t* merkle = fs->merkle;
+    if (merkle == NULL || block < 0 || block >= N_BLOCKS) {
+        return;
+    }
+
+    // a dirty node already has a dirty path above it
+    for (int i = MERKLE_LEAF(block); i >= MERKLE_ROOT && !merkle->dirty[i]; i /= 2) {
+        merkle->dirty[i] = 1;
+    }
+}
+
+fingerprint_t merkle_node(fs_node_t* fs, int index) {
+    merkle_t* merkle = fs->merkle;
+    if (!merkle->dirty[index]) {
+        return merkle->node[index];
+    }
+
+    if (MERKLE_IS_LEAF(index)) {
+        int block = index - N_BLOCKS;
+        static const byte unformatted[BLOCK_SIZE];
+        byte* data;
+        if (!block_formatted(fs, block)) {
+            // whatever an earlier format left, replicas agree it reads as nothing
+            merkle->node[index] = fingerprint(unformatted, BLOCK_SIZE);
+        } else if ((data = block_pin(fs, block)) != NULL) {
+            merkle->node[index] = fingerprint(data, BLOCK_SIZE);
+            block_unpin(fs, block, 0);
+        } else {
+            // unreadable, never matches a readable copy until a repair touches it
+            merkle->node[index].lo = ~0ULL;
+            merkle->node[index].hi = ~0ULL;
+        }
+    } else {
+        fingerprint_t children[2] = { merkle_node(fs, 2 * index), merkle_node(fs, 2 * index + 1) };
+        merkle->node[index] = fingerprint(children, sizeof(children));
+    }
+
+    merkle->dirty[index] = 0;
+    merkle->rehashed++;
+    return merkle->node[index];
+}
@@ -0,0 +1,33 @@
+#include <stdlib.h>
+#include "payload.h"
+#include "compress.h"
+
+payload_t* payload_alloc(int len) {
+    if (len < 0) {
+        return NULL;
+    }
+
+    payload_t* p = malloc(sizeof(payload_t) + len);
+    if (p == NULL) {
+        return NULL;
+    }
+
+    p->refcount = 1;
+    p->len = len;
+    p->raw_len = len;
+    p->codec = CODEC_NONE;
+    return p;
+}
+
+payload_t* payload_ref(payload_t* p) {
+    if (p != NULL) {
+        __atomic_add_fetch(&p->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return p;
+}
+
+void payload_release(payload_t* p) {
+    if (p != NULL && __atomic_sub_fetch(&p->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(p);
+    }
+}
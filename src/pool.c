@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+
+#define POOL_ALIGN 16
+
+struct pool_chunk_s {
+    pool_chunk_t* next;       // partial list
+    pool_chunk_t* prev;
+    pool_chunk_t* all_next;   // every chunk of the pool
+    pool_chunk_t* all_prev;
+    void* free;               // free objects, linked through their first word
+    int live;
+    int on_partial;
+};
+
+// each object is preceded by the chunk it came from
+typedef union {
+    pool_chunk_t* chunk;
+    char align[POOL_ALIGN];
+} pool_header_t;
+
+#define CHUNK_HEADER ((sizeof(pool_chunk_t) + POOL_ALIGN - 1) & ~(size_t) (POOL_ALIGN - 1))
+#define CHUNK_OBJECTS(c) ((char*) (c) + CHUNK_HEADER)
+
+static void partial_push(pool_t* pool, pool_chunk_t* chunk) {
+    chunk->prev = NULL;
+    chunk->next = pool->partial;
+    if (pool->partial != NULL) {
+        pool->partial->prev = chunk;
+    }
+    pool->partial = chunk;
+    chunk->on_partial = 1;
+}
+
+static void partial_remove(pool_t* pool, pool_chunk_t* chunk) {
+    if (chunk->prev != NULL) {
+        chunk->prev->next = chunk->next;
+    } else {
+        pool->partial = chunk->next;
+    }
+    if (chunk->next != NULL) {
+        chunk->next->prev = chunk->prev;
+    }
+    chunk->on_partial = 0;
+}
+
+static size_t chunk_bytes(const pool_t* pool) {
+    return CHUNK_HEADER + pool->stride * pool->per_chunk;
+}
+
+static pool_chunk_t* chunk_new(pool_t* pool) {
+    pool_chunk_t* chunk = malloc(chunk_bytes(pool));
+    if (chunk == NULL) {
+        return NULL;
+    }
+    memset(chunk, 0, sizeof(pool_chunk_t));
+
+    // thread the free list back to front so objects go out in address order
+    char* base = CHUNK_OBJECTS(chunk);
+    for (int k = pool->per_chunk - 1; k >= 0; k--) {
+        pool_header_t* header = (pool_header_t*) (base + k * pool->stride);
+        header->chunk = chunk;
+        void** obj = (void**) (header + 1);
+        *obj = chunk->free;
+        chunk->free = obj;
+    }
+
+    chunk->all_next = pool->all;
+    if (pool->all != NULL) {
+        pool->all->all_prev = chunk;
+    }
+    pool->all = chunk;
+    pool->chunks++;
+    return chunk;
+}
+
+static void chunk_release(pool_t* pool, pool_chunk_t* chunk) {
+    if (chunk->on_partial) {
+        partial_remove(pool, chunk);
+    }
+    if (chunk->all_prev != NULL) {
+        chunk->all_prev->all_next = chunk->all_next;
+    } else {
+        pool->all = chunk->all_next;
+    }
+    if (chunk->all_next != NULL) {
+        chunk->all_next->all_prev = chunk->all_prev;
+    }
+    pool->chunks--;
+    free(chunk);
+}
+
+void pool_init(pool_t* pool, const char* name, size_t size, int per_chunk) {
+    memset(pool, 0, sizeof(pool_t));
+    if (size < sizeof(void*)) {
+        size = sizeof(void*);
+    }
+    pool->name = name;
+    pool->size = size;
+    pool->stride = (sizeof(pool_header_t) + size + POOL_ALIGN - 1) & ~(size_t) (POOL_ALIGN - 1);
+    pool->per_chunk = per_chunk > 0 ? per_chunk : 1;
+}
+
+void pool_destroy(pool_t* pool) {
+    while (pool->all != NULL) {
+        chunk_release(pool, pool->all);
+    }
+    pool->partial = NULL;
+    pool->empty_chunks = 0;
+    pool->live = 0;
+}
+
+void* pool_alloc(pool_t* pool) {
+    pool_chunk_t* chunk = pool->partial;
+
+    // a chunk already in use before a spare empty one
+    while (chunk != NULL && chunk->live == 0 && chunk->next != NULL) {
+        chunk = chunk->next;
+    }
+    if (chunk == NULL) {
+        chunk = chunk_new(pool);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        partial_push(pool, chunk);
+        pool->empty_chunks++;
+    }
+
+    void** obj = chunk->free;
+    chunk->free = *obj;
+    if (chunk->live++ == 0) {
+        pool->empty_chunks--;
+    }
+    if (chunk->free == NULL) {
+        partial_remove(pool, chunk);
+    }
+
+    pool->allocs++;
+    if (++pool->live > pool->peak) {
+        pool->peak = pool->live;
+    }
+    return obj;
+}
+
+void pool_free(pool_t* pool, void* obj) {
+    if (obj == NULL) {
+        return;
+    }
+
+    pool_chunk_t* chunk = ((pool_header_t*) obj - 1)->chunk;
+    *(void**) obj = chunk->free;
+    chunk->free = obj;
+    pool->live--;
+
+    if (!chunk->on_partial) {
+        partial_push(pool, chunk);
+    }
+    if (--chunk->live > 0) {
+        return;
+    }
+
+    // one empty chunk is kept for the next burst, the rest go back
+    if (pool->empty_chunks > 0) {
+        chunk_release(pool, chunk);
+    } else {
+        pool->empty_chunks++;
+    }
+}
+
+size_t pool_footprint(const pool_t* pool) {
+    return pool->chunks * chunk_bytes(pool);
+}
+
+void pool_stats(const pool_t* pool) {
+    printf("%s pool: %ld live (peak %ld), %ld chunks of %d, %zu bytes held, %ld allocations\n",
+           pool->name, pool->live, pool->peak, pool->chunks, pool->per_chunk,
+           pool_footprint(pool), pool->allocs);
+}
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+#include "hash.h"
+
+static uint64_t vnode_pos(int node, int vnode) {
+    int key[2] = { node, vnode };
+    return fingerprint(key, sizeof(key)).lo;
+}
+
+static int point_cmp(const void* a, const void* b) {
+    const ring_point_t* x = a;
+    const ring_point_t* y = b;
+    if (x->pos != y->pos) {
+        return x->pos < y->pos ? -1 : 1;
+    }
+    return x->node - y->node;
+}
+
+static void ring_build(ring_t* ring) {
+    ring->n_points = 0;
+    for (int node = 0; node < RING_MAX_NODES; node++) {
+        if (!ring->member[node]) {
+            continue;
+        }
+        for (int v = 0; v < ring->vnodes; v++) {
+            ring->points[ring->n_points].pos = vnode_pos(node, v);
+            ring->points[ring->n_points].node = node;
+            ring->n_points++;
+        }
+    }
+    qsort(ring->points, ring->n_points, sizeof(ring_point_t), point_cmp);
+}
+
+int ring_init(ring_t* ring, int n_nodes, int replication, int vnodes) {
+    if (n_nodes < 1 || n_nodes > RING_MAX_NODES || replication < 1 || vnodes < 1 || vnodes > RING_MAX_VNODES) {
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(ring_t));
+    ring->enabled = 1;
+    ring->replication = replication;
+    ring->vnodes = vnodes;
+    for (int node = 0; node < n_nodes; node++) {
+        ring->member[node] = 1;
+    }
+
+    ring_build(ring);
+    return 0;
+}
+
+int ring_join(ring_t* ring, int node) {
+    if (node < 0 || node >= RING_MAX_NODES || ring->member[node]) {
+        return -1;
+    }
+    ring->member[node] = 1;
+    ring_build(ring);
+    return 0;
+}
+
+int ring_leave(ring_t* ring, int node) {
+    if (node < 0 || node >= RING_MAX_NODES || !ring->member[node]) {
+        return -1;
+    }
+    ring->member[node] = 0;
+    ring_build(ring);
+    return 0;
+}
+
+int ring_replicas(const ring_t* ring, const char* name, int* out) {
+    if (ring->n_points == 0) {
+        return 0;
+    }
+
+    uint64_t h = fingerprint(name, strlen(name)).lo;
+
+    // first point at or after h, wrapping past the top of the ring
+    int lo = 0;
+    int hi = ring->n_points;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ring->points[mid].pos < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    int count = 0;
+    for (int k = 0; k < ring->n_points && count < ring->replication; k++) {
+        int node = ring->points[(lo + k) % ring->n_points].node;
+
+        int seen = 0;
+        for (int c = 0; c < count; c++) {
+            seen |= out[c] == node;
+        }
+        if (!seen) {
+            out[count++] = node;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <time.h>
+#include "dfs.h"
+#include "block.h"
+#include "checksum.h"
+#include "merkle.h"
+
+int dfs_enable_checksums(dfs_t* dfs) {
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        if (checksum_enable(dfs->file_systems[i]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int dfs_scrub_block(dfs_t* dfs, int node_id, int block) {
+    fs_node_t* fs = dfs_node(dfs, node_id);
+    byte data[BLOCK_SIZE];
+    if (fs == NULL) {
+        return -1;
+    }
+
+    dfs->scrub.scanned++;
+    int intact = block_scrub(fs, block, data);
+    if (intact != 0) {
+        return intact;
+    }
+
+    dfs->scrub.corrupt++;
+    printf("scrub: node %d block %d checksum mismatch\n", node_id, block);
+
+    // sharded nodes hold different files, block numbers no longer line up
+    if (dfs->ring.enabled) {
+        dfs->scrub.unrepaired++;
+        return 0;
+    }
+
+    // every node applies the same log in the same order, so replicas lay out
+    // blocks identically; a copy that passes its own check under the same sum
+    // holds the bytes this node lost
+    for (int j = 0; j < MAX_NODES; j++) {
+        if (dfs->file_systems[j] == NULL) continue;
+        fs_node_t* replica = dfs->file_systems[j];
+        if (j == node_id || replica->sums == NULL || replica->sums->crc[block] != fs->sums->crc[block]) {
+            continue;
+        }
+        if (block_scrub(replica, block, data) != 1) {
+            continue;
+        }
+
+        if (block_repair(fs, block, data) == 0) {
+            dfs->scrub.repaired++;
+            printf("scrub: node %d block %d repaired from node %d\n", node_id, block, j);
+            return 0;
+        }
+    }
+
+    dfs->scrub.unrepaired++;
+    return 0;
+}
+
+int dfs_scrub_pass(dfs_t* dfs) {
+    int corrupt = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        for (int b = 0; b < N_BLOCKS; b++) {
+            corrupt += dfs_scrub_block(dfs, i, b) == 0;
+        }
+    }
+    return corrupt;
+}
+
+// one block per step, the lock is only held for that block
+static void* scrub_main(void* arg) {
+    dfs_t* dfs = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&dfs->lock);
+        scrubber_t* scrub = &dfs->scrub;
+        if (scrub->stop) {
+            pthread_mutex_unlock(&dfs->lock);
+            return NULL;
+        }
+
+        // ids without a node are skipped without a pause
+        if (dfs->file_systems[scrub->node] == NULL) {
+            scrub->block = 0;
+            scrub->node = (scrub->node + 1) % MAX_NODES;
+            pthread_mutex_unlock(&dfs->lock);
+            continue;
+        }
+
+        dfs_scrub_block(dfs, scrub->node, scrub->block);
+        if (++scrub->block == N_BLOCKS) {
+            scrub->block = 0;
+            scrub->node = (scrub->node + 1) % MAX_NODES;
+        }
+
+        long pause_ns = 1000000000L / scrub->rate;
+        pthread_mutex_unlock(&dfs->lock);
+
+        struct timespec pause = { pause_ns / 1000000000L, pause_ns % 1000000000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+// caller holds dfs->lock
+int dfs_scrub_start(dfs_t* dfs, int rate) {
+    if (rate < 1) {
+        return -1;
+    }
+
+    if (dfs->scrub.stop) {
+        return -1;  // another caller is still waiting for it to exit
+    }
+
+    dfs->scrub.rate = rate;
+    if (dfs->scrub.running) {
+        return 0;  // still going, picks up the new rate
+    }
+
+    if (pthread_create(&dfs->scrub.thread, NULL, scrub_main, dfs) != 0) {
+        return -1;
+    }
+    dfs->scrub.running = 1;
+    return 0;
+}
+
+// caller holds dfs->lock, which is let go while the thread finishes its step
+void dfs_scrub_stop(dfs_t* dfs) {
+    if (!dfs->scrub.running || dfs->scrub.stop) {
+        return;
+    }
+
+    dfs->scrub.stop = 1;
+    pthread_mutex_unlock(&dfs->lock);
+    pthread_join(dfs->scrub.thread, NULL);
+    pthread_mutex_lock(&dfs->lock);
+    dfs->scrub.running = 0;
+    dfs->scrub.stop = 0;
+}
+
+void dfs_scrub_stats(dfs_t* dfs) {
+    scrubber_t* scrub = &dfs->scrub;
+    printf("scrub %s at %d blocks/s: %ld scanned, %ld corrupt, %ld repaired, %ld unrepaired\n",
+           scrub->running && !scrub->stop ? "running" : "stopped", scrub->rate,
+           scrub->scanned, scrub->corrupt, scrub->repaired, scrub->unrepaired);
+}
+
+///// ANTI-ENTROPY /////
+
+static int fingerprints_agree(fingerprint_t* h, int n) {
+    for (int k = 1; k < n; k++) {
+        if (!fingerprint_equal(h[0], h[k])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// copy more than half the replicas share, -1 if none
+static int majority(fingerprint_t* h, int n) {
+    for (int k = 0; k < n; k++) {
+        int votes = 0;
+        for (int j = 0; j < n; j++) {
+            votes += fingerprint_equal(h[k], h[j]);
+        }
+        if (2 * votes > n) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+static int anti_entropy_descend(dfs_t* dfs, int index) {
+    int ids[MAX_NODES];
+    fingerprint_t h[MAX_NODES];
+    int n = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        // a lagging node is behind, not corrupt, and catches up from its log
+        if (dfs->file_systems[i] != NULL && dfs->nodes[i].status != LAGGING) {
+            ids[n] = i;
+            h[n++] = merkle_node(dfs->file_systems[i], index);
+        }
+    }
+    dfs->anti_entropy.compared++;
+
+    if (fingerprints_agree(h, n)) {
+        return 0;
+    }
+    if (!MERKLE_IS_LEAF(index)) {
+        return anti_entropy_descend(dfs, 2 * index) + anti_entropy_descend(dfs, 2 * index + 1);
+    }
+
+    int block = index - N_BLOCKS;
+    int good = majority(h, n);
+    byte data[BLOCK_SIZE];
+    if (good == -1 || block_read(dfs->file_systems[ids[good]], block, data) < 0) {
+        dfs->anti_entropy.unresolved++;
+        printf("anti-entropy: block %d has no majority copy\n", block);
+        return 0;
+    }
+
+    int repaired = 0;
+    for (int k = 0; k < n; k++) {
+        if (!fingerprint_equal(h[k], h[good]) && block_repair(dfs->file_systems[ids[k]], block, data) == 0) {
+            printf("anti-entropy: node %d block %d rewritten from node %d\n", ids[k], block, ids[good]);
+            repaired++;
+        }
+    }
+    dfs->anti_entropy.repaired += repaired;
+    return repaired;
+}
+
+int dfs_anti_entropy(dfs_t* dfs) {
+    // only full replicas share a block layout to compare
+    if (dfs->ring.enabled) {
+        return -1;
+    }
+
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        if (merkle_enable(dfs->file_systems[i]) < 0) {
+            return -1;
+        }
+    }
+
+    dfs->anti_entropy.passes++;
+    return anti_entropy_descend(dfs, MERKLE_ROOT);
+}
+
+void dfs_anti_entropy_stats(dfs_t* dfs) {
+    anti_entropy_t* ae = &dfs->anti_entropy;
+    printf("anti-entropy every %d entries: %ld passes, %ld tree nodes compared, %ld blocks repaired, %ld unresolved\n",
+           ae->interval, ae->passes, ae->compared, ae->repaired, ae->unresolved);
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        merkle_t* merkle = dfs->file_systems[i]->merkle;
+        printf("node %d: %ld tree nodes rehashed\n", i, merkle != NULL ? merkle->rehashed : 0);
+    }
+}
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "dfs.h"
+#include "efs.h"
+#include "wal.h"
+#include "dir.h"
+
+///// PLACEMENT /////
+
+int dfs_entry_nodes(dfs_t* dfs, wal_entry_t* entry, int* nodes) {
+    if (!dfs->ring.enabled) {
+        int count = 0;
+        for (int i = 0; i < MAX_NODES; i++) {
+            if (dfs->file_systems[i] != NULL) {
+                nodes[count++] = i;
+            }
+        }
+        return count;
+    }
+    return ring_replicas(&dfs->ring, entry->key, nodes);
+}
+
+int dfs_node_oft(dfs_t* dfs, int node_id, int oft_idx) {
+    if (!dfs->ring.enabled) {
+        return oft_idx;
+    }
+    if (oft_idx < 0 || oft_idx >= DFS_MAX_OPEN || !dfs->handles[oft_idx].in_use) {
+        return -1;
+    }
+    return dfs->handles[oft_idx].oft[node_id];
+}
+
+int dfs_entry_local(dfs_t* dfs, wal_entry_t* entry, int node_id, wal_entry_t* local) {
+    *local = *entry;
+
+    int* oft = NULL;
+    switch (entry->op_type) {
+        case OP_WRITE:
+            oft = &local->params.write_params.oft_idx;
+            break;
+        case OP_SEEK:
+            oft = &local->params.seek_params.oft_idx;
+            break;
+        case OP_PWRITE:
+            oft = &local->params.pwrite_params.oft_idx;
+            break;
+        case OP_FALLOCATE:
+            oft = &local->params.fallocate_params.oft_idx;
+            break;
+        default:
+            return 0;
+    }
+
+    *oft = dfs_node_oft(dfs, node_id, *oft);
+    return *oft < 0 ? -1 : 0;
+}
+
+///// OPEN FILES /////
+
+int dfs_shard_open(dfs_t* dfs, const char* name) {
+    if (!dfs->ring.enabled || strlen(name) > FILE_NAME_MAX) {
+        return -1;
+    }
+
+    int h = 0;
+    while (h < DFS_MAX_OPEN && dfs->handles[h].in_use) {
+        h++;
+    }
+    if (h == DFS_MAX_OPEN) {
+        return -1;
+    }
+
+    shard_handle_t* handle = &dfs->handles[h];
+    strcpy(handle->name, name);
+    for (int i = 0; i < MAX_NODES; i++) {
+        handle->oft[i] = -1;
+    }
+
+    int nodes[MAX_NODES];
+    int count = ring_replicas(&dfs->ring, handle->name, nodes);
+    for (int k = 0; k < count; k++) {
+        handle->oft[nodes[k]] = open(dfs->file_systems[nodes[k]], handle->name);
+        if (handle->oft[nodes[k]] < 0) {
+            for (int j = 0; j < k; j++) {
+                close(dfs->file_systems[nodes[j]], handle->oft[nodes[j]]);
+            }
+            return -1;
+        }
+    }
+
+    handle->in_use = 1;
+    return h;
+}
+
+int dfs_shard_close(dfs_t* dfs, int h) {
+    if (h < 0 || h >= DFS_MAX_OPEN || !dfs->handles[h].in_use) {
+        return -1;
+    }
+
+    shard_handle_t* handle = &dfs->handles[h];
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (handle->oft[i] >= 0) {
+            close(dfs->file_systems[i], handle->oft[i]);
+        }
+    }
+    handle->in_use = 0;
+    return 0;
+}
+
+static int handles_open(dfs_t* dfs) {
+    for (int h = 0; h < DFS_MAX_OPEN; h++) {
+        if (dfs->handles[h].in_use) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+///// REBALANCING /////
+
+// whether node fs has name in its directory
+static int node_has_file(fs_node_t* fs, const char* name) {
+    return dir_lookup(fs, name) != -1;
+}
+
+static int copy_file(dfs_t* dfs, int from, int to, const char* name) {
+    fs_node_t* src = dfs->file_systems[from];
+    fs_node_t* dst = dfs->file_systems[to];
+
+    int s = open(src, name);
+    if (s < 0) {
+        return -1;
+    }
+
+    int size = src->OFT[s].file_size;
+    byte* buf = malloc(size > 0 ? size : 1);
+    int got = buf != NULL ? f_pread(src, s, buf, size, 0) : -1;
+    close(src, s);
+
+    int result = -1;
+    if (got == size && create(dst, name) == 0) {
+        int d = open(dst, name);
+        if (d >= 0) {
+            result = f_pwrite(dst, d, buf, size, 0) == size ? 0 : -1;
+            close(dst, d);
+        }
+    }
+
+    free(buf);
+    if (result == 0) {
+        dfs->rebalance.bytes_moved += size;
+    }
+    return result;
+}
+
+// brings every file's holders in line with the ring: nodes that gained a file
+// copy it from a node that still has it, nodes that lost one drop it. Files
+// whose replica set did not change are not touched. The walk goes by name, so
+// the copies and drops along the way do not disturb it
+static void rebalance(dfs_t* dfs) {
+    char name[FILE_NAME_MAX + 1] = "";
+    while (dfs_next_file(dfs, name, name) == 0) {
+        int want[MAX_NODES] = { 0 };
+        int has[MAX_NODES];
+        int nodes[MAX_NODES];
+
+        int n = ring_replicas(&dfs->ring, name, nodes);
+        for (int k = 0; k < n; k++) {
+            want[nodes[k]] = 1;
+        }
+
+        int source = -1;
+        for (int i = 0; i < MAX_NODES; i++) {
+            if (dfs->file_systems[i] == NULL) continue;
+            has[i] = node_has_file(dfs->file_systems[i], name);
+            if (has[i] && source == -1) source = i;
+        }
+
+        for (int i = 0; i < MAX_NODES; i++) {
+            if (dfs->file_systems[i] == NULL) continue;
+            if (want[i] && !has[i]) {
+                if (copy_file(dfs, source, i, name) == 0) {
+                    dfs->rebalance.files_moved++;
+                } else {
+                    dfs->rebalance.move_failures++;
+                    want[source] = 1;  // keep the only good copy around
+                }
+            }
+        }
+        for (int i = 0; i < MAX_NODES; i++) {
+            if (dfs->file_systems[i] == NULL) continue;
+            if (has[i] && !want[i] && destroy(dfs->file_systems[i], name) == 0) {
+                dfs->rebalance.files_dropped++;
+            }
+        }
+    }
+}
+
+int dfs_shard_enable(dfs_t* dfs, int replication, int vnodes) {
+    if (handles_open(dfs) || replication > dfs->node_count || dfs_lagging(dfs) > 0) {
+        return -1;
+    }
+    if (ring_init(&dfs->ring, MAX_NODES, replication, vnodes) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) {
+            ring_leave(&dfs->ring, i);
+        }
+    }
+
+    // every node held every file until now
+    rebalance(dfs);
+    return 0;
+}
+
+int dfs_shard_join(dfs_t* dfs, int node_id) {
+    if (!dfs->ring.enabled || handles_open(dfs) || dfs_node(dfs, node_id) == NULL) {
+        return -1;
+    }
+    if (ring_join(&dfs->ring, node_id) < 0) {
+        return -1;
+    }
+
+    dfs->nodes[node_id].status = ACTIVE;
+    rebalance(dfs);
+    return 0;
+}
+
+// the node hands its files to their new replicas before it drops them; the
+// ring keeps at least as many members as each file has replicas
+int dfs_shard_leave(dfs_t* dfs, int node_id) {
+    if (!dfs->ring.enabled || handles_open(dfs) || dfs_node(dfs, node_id) == NULL) {
+        return -1;
+    }
+
+    // nodes that left before are still attached, only members count
+    int members = 0;
+    for (int i = 0; i < RING_MAX_NODES; i++) {
+        members += dfs->ring.member[i];
+    }
+    if (members - 1 < dfs->ring.replication) {
+        return -1;
+    }
+    if (ring_leave(&dfs->ring, node_id) < 0) {
+        return -1;
+    }
+
+    rebalance(dfs);
+    dfs->nodes[node_id].status = FAILED;
+    return 0;
+}
+
+void dfs_shard_show(dfs_t* dfs, const char* name) {
+    if (!dfs->ring.enabled) {
+        printf("%s: not sharded, on all %d nodes\n", name, dfs->node_count);
+        return;
+    }
+
+    if (strlen(name) > FILE_NAME_MAX) {
+        printf("error\n");
+        return;
+    }
+
+    int nodes[MAX_NODES];
+    int count = ring_replicas(&dfs->ring, name, nodes);
+    printf("%s: leader node %d, replicas", name, count > 0 ? nodes[0] : -1);
+    for (int k = 0; k < count; k++) {
+        printf(" %d", nodes[k]);
+    }
+    printf("\n");
+}
+
+void dfs_shard_stats(dfs_t* dfs) {
+    ring_t* ring = &dfs->ring;
+    if (!ring->enabled) {
+        printf("sharding off, %d full replicas\n", dfs->node_count);
+        return;
+    }
+
+    char name[FILE_NAME_MAX + 1] = "";
+    int count = 0;
+    while (dfs_next_file(dfs, name, name) == 0) {
+        count++;
+    }
+
+    printf("ring: replication %d, %d vnodes per node, %d files\n", ring->replication, ring->vnodes, count);
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        int held = 0;
+        name[0] = '\0';
+        while (dir_next(dfs->file_systems[i], name, name) != -1) {
+            held++;
+        }
+        printf("node %d: %s, %d files\n", i, ring->member[i] ? "member" : "out", held);
+    }
+    printf("rebalance: %ld files moved (%ld bytes), %ld dropped, %ld failed\n",
+           dfs->rebalance.files_moved, dfs->rebalance.bytes_moved,
+           dfs->rebalance.files_dropped, dfs->rebalance.move_failures);
+}
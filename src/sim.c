@@ -0,0 +1,683 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "dfs.h"
+#include "wal.h"
+#include "block.h"
+
+#define SIM_NET_US 500      // mean one-way message delay, jittered by half either way
+#define SIM_APPLY_US 200    // one entry applied at full speed
+#define SIM_WRITE_US 5000   // between client writes
+#define SIM_WRITE_SIZE 64
+#define SIM_FILE_SPAN 2048  // writes land anywhere in the file's first bytes
+#define SIM_EVENTS 4096
+
+typedef enum {
+    EV_WRITE,
+    EV_HEARTBEAT,  // arg: term of the leader sending it
+    EV_TIMER,      // node's election timer, stale unless it is the one queued
+    EV_ELECTED,    // arg: term the candidate ran in
+    EV_FAULT,      // arg: fault index
+    EV_HEAL
+} sim_event_kind_t;
+
+typedef struct {
+    long at;
+    long order;  // ties go in the order events were scheduled
+    sim_event_kind_t kind;
+    int node;
+    long arg;
+} sim_event_t;
+
+typedef struct {
+    int down;       // crashed, paused or cut off: sends and receives nothing
+    int fault;      // the fault holding it down, -1 if none
+    int slow;       // apply cost multiplier
+    int campaigns;  // elections called while cut off
+    long ready;     // when its queued applies are done
+    long acked;     // last time the leader heard from it
+    long deadline;  // election timer
+    long timer_at;  // when its timer event is due, -1 if none is queued
+} sim_node_t;
+
+typedef struct {
+    dfs_t* dfs;
+    unsigned seed;
+    long now;
+    long end;
+    long heartbeat;
+    long timeout;
+    int handle;
+
+    int leader;         // -1 while none is established
+    int term;
+    int candidate;      // node whose votes are pending, -1 if none
+    long vote_at;
+    int lost_fault;     // the fault that cost the cluster its leader, -1 if none
+    long lost_since;    // when the cluster knew it had no leader
+
+    sim_node_t nodes[MAX_NODES];
+    sim_event_t events[SIM_EVENTS];  // min-heap on at, then order
+    int n_events;
+    long order;
+    int overflow;
+
+    sim_fault_t* faults;
+    int n_faults;
+
+    long issued;        // write k is issued at k * SIM_WRITE_US
+    long next_write;    // first write not yet sent
+    long committed;
+    long refused;
+    long* latency;
+    long window;        // start of the stall writes are in, -1 while they flow
+    int windows;
+    long unavailable;
+    long longest;
+    int elections;
+    int splits;
+} sim_t;
+
+///// EVENT QUEUE /////
+
+static int event_before(const sim_event_t* a, const sim_event_t* b) {
+    return a->at < b->at || (a->at == b->at && a->order < b->order);
+}
+
+static void sim_push(sim_t* sim, long at, sim_event_kind_t kind, int node, long arg) {
+    if (sim->n_events == SIM_EVENTS) {
+        sim->overflow = 1;
+        return;
+    }
+
+    int k = sim->n_events++;
+    sim_event_t event = { at, sim->order++, kind, node, arg };
+    while (k > 0 && event_before(&event, &sim->events[(k - 1) / 2])) {
+        sim->events[k] = sim->events[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    sim->events[k] = event;
+}
+
+static sim_event_t sim_pop(sim_t* sim) {
+    sim_event_t top = sim->events[0];
+    sim_event_t last = sim->events[--sim->n_events];
+
+    int k = 0;
+    for (;;) {
+        int child = 2 * k + 1;
+        if (child >= sim->n_events) break;
+        if (child + 1 < sim->n_events && event_before(&sim->events[child + 1], &sim->events[child])) {
+            child++;
+        }
+        if (!event_before(&sim->events[child], &last)) break;
+        sim->events[k] = sim->events[child];
+        k = child;
+    }
+    sim->events[k] = last;
+    return top;
+}
+
+///// CLUSTER /////
+
+static long sim_net(sim_t* sim) {
+    return SIM_NET_US / 2 + rand_r(&sim->seed) % SIM_NET_US;
+}
+
+static int sim_majority(sim_t* sim) {
+    return sim->dfs->node_count / 2 + 1;
+}
+
+static int sim_up(sim_t* sim) {
+    int up = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        up += sim->dfs->file_systems[i] != NULL && !sim->nodes[i].down;
+    }
+    return up;
+}
+
+// a follower waits timeout to twice that of silence before calling an election;
+// a later deadline reuses the queued event, which moves itself on when it fires
+static void sim_arm(sim_t* sim, int i, long from) {
+    sim_node_t* node = &sim->nodes[i];
+    node->deadline = from + sim->timeout + rand_r(&sim->seed) % sim->timeout;
+    if (node->timer_at < 0 || node->deadline < node->timer_at) {
+        node->timer_at = node->deadline;
+        sim_push(sim, node->deadline, EV_TIMER, i, 0);
+    }
+}
+
+static int sim_available(sim_t* sim) {
+    return sim->leader >= 0 && !sim->nodes[sim->leader].down && sim_up(sim) >= sim_majority(sim);
+}
+
+// the client's write reaches the leader, which applies it and answers once
+// a majority counting itself has it applied; returns when the answer arrives
+static long sim_commit(sim_t* sim) {
+    long start = sim->now + sim_net(sim);
+    sim_node_t* leader = &sim->nodes[sim->leader];
+    leader->ready = (leader->ready > start ? leader->ready : start) + SIM_APPLY_US * leader->slow;
+
+    long acks[MAX_NODES];
+    int n = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        sim_node_t* node = &sim->nodes[i];
+        if (sim->dfs->file_systems[i] == NULL || i == sim->leader || node->down) continue;
+
+        long arrive = start + sim_net(sim);
+        node->ready = (node->ready > arrive ? node->ready : arrive) + SIM_APPLY_US * node->slow;
+        node->acked = node->ready + sim_net(sim);
+
+        int k = n++;
+        while (k > 0 && acks[k - 1] > node->acked) {
+            acks[k] = acks[k - 1];
+            k--;
+        }
+        acks[k] = node->acked;
+    }
+
+    int need = sim_majority(sim) - 1;
+    long commit = need > 0 ? acks[need - 1] : start;
+    if (commit < leader->ready) {
+        commit = leader->ready;
+    }
+    return commit + sim_net(sim);
+}
+
+// sends the writes held back while the cluster could not take them
+static void sim_flush(sim_t* sim) {
+    while (sim->next_write < sim->issued && sim_available(sim)) {
+        if (sim->window >= 0) {
+            long stall = sim->now - sim->window;
+            sim->unavailable += stall;
+            if (stall > sim->longest) {
+                sim->longest = stall;
+            }
+            sim->window = -1;
+        }
+
+        byte data[SIM_WRITE_SIZE];
+        for (int k = 0; k < SIM_WRITE_SIZE; k++) {
+            data[k] = 'a' + rand_r(&sim->seed) % 26;
+        }
+        int offset = rand_r(&sim->seed) % (SIM_FILE_SPAN - SIM_WRITE_SIZE);
+
+        long issue = sim->next_write++ * SIM_WRITE_US;
+        if (dfs_pwrite(sim->dfs, sim->handle, data, SIM_WRITE_SIZE, offset) < 0) {
+            sim->refused++;  // a lagging node's log is full
+            continue;
+        }
+        sim->latency[sim->committed++] = sim_commit(sim) - issue;
+    }
+
+    if (sim->next_write < sim->issued && sim->window < 0) {
+        sim->window = sim->next_write * SIM_WRITE_US;
+        sim->windows++;
+    }
+}
+
+static void sim_leader_lost(sim_t* sim, int fault) {
+    if (sim->lost_fault < 0) {
+        sim->lost_fault = fault;
+        sim->lost_since = sim->now;
+    }
+}
+
+///// EVENTS /////
+
+static void on_heartbeat(sim_t* sim, long term) {
+    if (term != sim->term) {
+        return;  // sent by a deposed leader
+    }
+    sim_push(sim, sim->now + sim->heartbeat, EV_HEARTBEAT, -1, term);
+    if (sim->nodes[sim->leader].down) {
+        return;
+    }
+
+    for (int i = 0; i < MAX_NODES; i++) {
+        sim_node_t* node = &sim->nodes[i];
+        if (sim->dfs->file_systems[i] == NULL || i == sim->leader) continue;
+
+        if (!node->down) {
+            long arrive = sim->now + sim_net(sim);
+            node->acked = arrive + sim_net(sim);
+            sim_arm(sim, i, arrive);
+        } else if (node->fault >= 0 && sim->faults[node->fault].detect_us < 0 &&
+                   sim->now - node->acked >= sim->timeout) {
+            // the leader gives up on a follower as the follower would on it
+            sim->faults[node->fault].detect_us = sim->now - sim->faults[node->fault].start_ms * 1000L;
+        }
+    }
+}
+
+static void on_timer(sim_t* sim, int i) {
+    sim_node_t* node = &sim->nodes[i];
+    if (sim->now != node->timer_at) {
+        return;
+    }
+    node->timer_at = -1;
+    if (sim->now < node->deadline) {
+        node->timer_at = node->deadline;
+        sim_push(sim, node->deadline, EV_TIMER, i, 0);
+        return;
+    }
+    if (i == sim->leader) {
+        return;
+    }
+    if (node->down) {
+        // alone on its side of a partition, it calls elections nobody answers
+        if (node->fault >= 0 && sim->faults[node->fault].kind == SIM_PARTITION) {
+            node->campaigns++;
+            sim_arm(sim, i, sim->now);
+        }
+        return;
+    }
+
+    // heartbeats stopped: the leader is down, or the cluster has none
+    if (sim->lost_fault < 0 && sim->leader >= 0) {
+        sim_leader_lost(sim, sim->nodes[sim->leader].fault);
+    }
+    if (sim->lost_fault >= 0 && sim->faults[sim->lost_fault].detect_us < 0) {
+        sim_fault_t* fault = &sim->faults[sim->lost_fault];
+        fault->detect_us = sim->now - fault->start_ms * 1000L;
+        sim->lost_since = sim->now;
+    }
+
+    if (sim->candidate >= 0 && sim->now < sim->vote_at) {
+        // two candidates split the votes, both wait out a fresh timeout
+        sim->splits++;
+        sim->term++;
+        sim_arm(sim, sim->candidate, sim->now);
+        sim->candidate = -1;
+        sim_arm(sim, i, sim->now);
+        return;
+    }
+
+    if (sim_up(sim) < sim_majority(sim)) {
+        sim_arm(sim, i, sim->now);
+        return;
+    }
+    sim->term++;
+    sim->candidate = i;
+    sim->vote_at = sim->now + 2 * sim_net(sim);
+    sim_push(sim, sim->vote_at, EV_ELECTED, i, sim->term);
+}
+
+static void on_elected(sim_t* sim, int i, long term) {
+    if (term != sim->term || sim->candidate != i) {
+        return;
+    }
+    sim->candidate = -1;
+    if (sim->nodes[i].down) {
+        return;  // the others' timers run on
+    }
+
+    int old = sim->dfs->leader;
+    if (dfs_node_elect(sim->dfs, i) < 0) {
+        sim_arm(sim, i, sim->now);
+        return;
+    }
+    // the deposed leader was held back by leading, it lags like any follower
+    if (old != i && sim->nodes[old].down && sim->dfs->nodes[old].status == ACTIVE) {
+        dfs_node_pause(sim->dfs, old);
+    }
+
+    sim->leader = i;
+    sim->elections++;
+    if (sim->lost_fault >= 0) {
+        sim->faults[sim->lost_fault].elect_us = sim->now - sim->lost_since;
+        sim->lost_fault = -1;
+    }
+    on_heartbeat(sim, term);
+    sim_flush(sim);
+}
+
+static void on_fault(sim_t* sim, int f) {
+    sim_fault_t* fault = &sim->faults[f];
+    if (fault->node < 0) {
+        fault->node = sim->leader;
+    }
+    int i = fault->node;
+    if (i < 0 || sim->dfs->file_systems[i] == NULL || (fault->kind != SIM_SLOW && sim->nodes[i].down)) {
+        fault->skipped = 1;
+        return;
+    }
+    fault->led = i == sim->leader;
+    sim_push(sim, sim->now + fault->length_ms * 1000L, EV_HEAL, i, f);
+
+    sim_node_t* node = &sim->nodes[i];
+    if (fault->kind == SIM_SLOW) {
+        node->slow = fault->factor;
+        return;
+    }
+
+    node->down = 1;
+    node->fault = f;
+    node->campaigns = 0;
+    if (i != sim->dfs->leader) {
+        dfs_node_pause(sim->dfs, i);
+    }
+    sim_flush(sim);
+}
+
+static void on_heal(sim_t* sim, int i, int f) {
+    sim_fault_t* fault = &sim->faults[f];
+    sim_node_t* node = &sim->nodes[i];
+
+    if (fault->kind == SIM_SLOW) {
+        node->slow = 1;
+        fault->catch_up_us = node->ready > sim->now ? node->ready - sim->now : 0;
+        return;
+    }
+
+    node->down = 0;
+    node->fault = -1;
+    long replay = 0;
+    if (sim->dfs->nodes[i].status == LAGGING) {
+        fault->replayed = dfs_node_catch_up(sim->dfs, i, 1);
+        replay = fault->replayed > 0 ? fault->replayed * SIM_APPLY_US * node->slow : 0;
+    }
+    node->ready = sim->now + replay;
+    fault->catch_up_us = replay;
+
+    if (i == sim->leader && fault->kind == SIM_CRASH) {
+        // a restarted leader has lost its term and waits for an election
+        sim_leader_lost(sim, f);
+        sim->leader = -1;
+        sim->term++;
+    } else if (i != sim->leader && node->campaigns > 0 && sim->leader >= 0) {
+        // its higher term makes the leader step down
+        sim->leader = -1;
+        sim->term++;
+        sim_leader_lost(sim, f);
+        if (fault->detect_us < 0) {
+            fault->detect_us = sim->now - fault->start_ms * 1000L;
+        }
+    }
+    if (i != sim->leader) {
+        sim_arm(sim, i, sim->now);
+    }
+    sim_flush(sim);
+}
+
+///// REPORT /////
+
+static const char* sim_kind_name(sim_fault_kind_t kind) {
+    static const char* names[] = { "crash", "pause", "part", "slow" };
+    return names[kind];
+}
+
+static char* sim_ms(char* buf, long us) {
+    if (us < 0) {
+        strcpy(buf, "-");
+    } else {
+        sprintf(buf, "%.1f", us / 1000.0);
+    }
+    return buf;
+}
+
+static int sim_cmp_long(const void* a, const void* b) {
+    long x = *(const long*) a;
+    long y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+static int sim_replicas_match(dfs_t* dfs) {
+    fs_node_t* leader = dfs->file_systems[dfs->leader];
+    byte data_a[BLOCK_SIZE];
+    byte data_b[BLOCK_SIZE];
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL || dfs->file_systems[i] == leader) continue;
+        for (int b = 0; b < N_BLOCKS; b++) {
+            if (block_read(leader, b, data_a) < 0 || block_read(dfs->file_systems[i], b, data_b) < 0 ||
+                memcmp(data_a, data_b, BLOCK_SIZE) != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void sim_report(sim_t* sim, unsigned seed, int ms) {
+    char a[16], b[16], c[16];
+    printf("seed %u: %d nodes, %d ms, heartbeat %ld ms, election timeout %ld-%ld ms\n",
+           seed, sim->dfs->node_count, ms, sim->heartbeat / 1000, sim->timeout / 1000, 2 * sim->timeout / 1000);
+    printf("fault  node    at ms  for ms  detect ms  elect ms  catch-up ms  replayed\n");
+    for (int f = 0; f < sim->n_faults; f++) {
+        sim_fault_t* fault = &sim->faults[f];
+        if (fault->skipped) {
+            printf("%-5s  %4s  %7d  skipped\n", sim_kind_name(fault->kind), "-", fault->start_ms);
+            continue;
+        }
+        char node[8];
+        sprintf(node, "%d%s", fault->node, fault->led ? "L" : "");
+        printf("%-5s  %4s  %7d  %6d  %9s  %8s  %11s  %8d\n", sim_kind_name(fault->kind), node,
+               fault->start_ms, fault->length_ms, sim_ms(a, fault->detect_us), sim_ms(b, fault->elect_us),
+               sim_ms(c, fault->catch_up_us), fault->replayed > 0 ? fault->replayed : 0);
+    }
+
+    long sum = 0;
+    for (long k = 0; k < sim->committed; k++) {
+        sum += sim->latency[k];
+    }
+    qsort(sim->latency, sim->committed, sizeof(long), sim_cmp_long);
+    long p99 = sim->committed > 0 ? sim->latency[sim->committed * 99 / 100] : -1;
+    long max = sim->committed > 0 ? sim->latency[sim->committed - 1] : -1;
+    printf("writes: %ld issued, %ld committed, %ld refused, latency mean %s ms, p99 %s ms, max %s ms\n",
+           sim->issued, sim->committed, sim->refused, sim_ms(a, sim->committed > 0 ? sum / sim->committed : -1),
+           sim_ms(b, p99), sim_ms(c, max));
+    printf("unavailable: %d windows, %s ms in all, longest %s ms; %d elections, %d split votes\n",
+           sim->windows, sim_ms(a, sim->unavailable), sim_ms(b, sim->longest), sim->elections, sim->splits);
+}
+
+///// RUN /////
+
+int sim_parse_fault(const char* text, sim_fault_t* fault) {
+    memset(fault, 0, sizeof(sim_fault_t));
+    const char* colon = strchr(text, ':');
+    if (colon == NULL) {
+        return -1;
+    }
+
+    int kind = -1;
+    for (int k = SIM_CRASH; k <= SIM_SLOW; k++) {
+        if ((int) strlen(sim_kind_name(k)) == colon - text && strncmp(text, sim_kind_name(k), colon - text) == 0) {
+            kind = k;
+        }
+    }
+    if (kind < 0) {
+        return -1;
+    }
+    fault->kind = kind;
+
+    const char* rest = colon + 1;
+    if (*rest == 'L') {
+        fault->node = -1;
+        rest++;
+    } else {
+        char* end;
+        long node = strtol(rest, &end, 10);
+        if (end == rest || node < 0 || node >= NUM_NODES) {
+            return -1;
+        }
+        fault->node = node;
+        rest = end;
+    }
+
+    int used = 0;
+    if (sscanf(rest, "@%d+%d%n", &fault->start_ms, &fault->length_ms, &used) != 2 ||
+        fault->start_ms < 0 || fault->length_ms <= 0) {
+        return -1;
+    }
+    rest += used;
+
+    if (kind == SIM_SLOW) {
+        if (sscanf(rest, "x%d%n", &fault->factor, &used) != 1 || fault->factor < 1) {
+            return -1;
+        }
+        rest += used;
+    }
+    return *rest == '\0' ? 0 : -1;
+}
+
+// a few faults of every kind spread over the run, half of them on the leader
+static int sim_random_faults(sim_t* sim, int ms, sim_fault_t* faults) {
+    int n = 1 + ms / 2000;
+    if (n > SIM_MAX_FAULTS) {
+        n = SIM_MAX_FAULTS;
+    }
+    long timeout_ms = sim->timeout / 1000;
+    for (int f = 0; f < n; f++) {
+        memset(&faults[f], 0, sizeof(sim_fault_t));
+        faults[f].kind = rand_r(&sim->seed) % (SIM_SLOW + 1);
+        faults[f].node = rand_r(&sim->seed) % 2 ? -1 : (int) (rand_r(&sim->seed) % NUM_NODES);
+        faults[f].start_ms = rand_r(&sim->seed) % (ms * 3 / 4 + 1);
+        faults[f].length_ms = timeout_ms / 2 + rand_r(&sim->seed) % (4 * timeout_ms + 1);
+        faults[f].factor = 2 + rand_r(&sim->seed) % 15;
+    }
+
+    // reported in the order they strike
+    for (int f = 1; f < n; f++) {
+        sim_fault_t fault = faults[f];
+        int k = f;
+        while (k > 0 && faults[k - 1].start_ms > fault.start_ms) {
+            faults[k] = faults[k - 1];
+            k--;
+        }
+        faults[k] = fault;
+    }
+    return n;
+}
+
+static int sim_setup(sim_t* sim) {
+    dfs_t* dfs = calloc(1, sizeof(dfs_t));
+    if (dfs == NULL) {
+        return -1;
+    }
+    pthread_mutex_init(&dfs->lock, NULL);
+    dfs_init(dfs);
+    sim->dfs = dfs;
+
+    wal_entry_t entry = wal_log_create(dfs, "sim");
+    if (dfs_replicate_operation(dfs, &entry) < 0) {
+        return -1;
+    }
+    sim->handle = dfs_open(dfs, "sim");
+    return sim->handle < 0 ? -1 : 0;
+}
+
+static void sim_teardown(sim_t* sim) {
+    if (sim->dfs != NULL) {
+        dfs_destroy(sim->dfs);
+        pthread_mutex_destroy(&sim->dfs->lock);
+        free(sim->dfs);
+    }
+    free(sim->latency);
+}
+
+int sim_run(unsigned seed, int ms, int heartbeat_ms, int timeout_ms, sim_fault_t* faults, int n_faults) {
+    if (ms <= 0 || heartbeat_ms <= 0 || timeout_ms <= 0 || n_faults < 0 || n_faults > SIM_MAX_FAULTS) {
+        return -1;
+    }
+
+    sim_t* sim = calloc(1, sizeof(sim_t));
+    if (sim == NULL) {
+        return -1;
+    }
+    sim->seed = seed;
+    sim->end = ms * 1000L;
+    sim->heartbeat = heartbeat_ms * 1000L;
+    sim->timeout = timeout_ms * 1000L;
+    sim->candidate = -1;
+    sim->lost_fault = -1;
+    sim->window = -1;
+    sim->latency = malloc((sim->end / SIM_WRITE_US + 1) * sizeof(long));
+    if (sim->latency == NULL || sim_setup(sim) < 0) {
+        sim_teardown(sim);
+        free(sim);
+        return -1;
+    }
+
+    if (n_faults == 0) {
+        n_faults = sim_random_faults(sim, ms, faults);
+    }
+    sim->faults = faults;
+    sim->n_faults = n_faults;
+    for (int f = 0; f < n_faults; f++) {
+        faults[f].skipped = 0;
+        faults[f].led = 0;
+        faults[f].detect_us = -1;
+        faults[f].elect_us = -1;
+        faults[f].catch_up_us = -1;
+        faults[f].replayed = -1;
+        sim_push(sim, faults[f].start_ms * 1000L, EV_FAULT, -1, f);
+    }
+
+    for (int i = 0; i < MAX_NODES; i++) {
+        sim->nodes[i].fault = -1;
+        sim->nodes[i].slow = 1;
+        sim->nodes[i].timer_at = -1;
+        if (sim->dfs->file_systems[i] != NULL && i != sim->dfs->leader) {
+            sim_arm(sim, i, 0);
+        }
+    }
+    sim->leader = sim->dfs->leader;
+    sim_push(sim, 0, EV_HEARTBEAT, -1, sim->term);
+    sim_push(sim, 0, EV_WRITE, -1, 0);
+
+    while (sim->n_events > 0 && sim->events[0].at < sim->end) {
+        sim_event_t event = sim_pop(sim);
+        sim->now = event.at;
+
+        switch (event.kind) {
+            case EV_WRITE:
+                sim->issued++;
+                sim_push(sim, sim->now + SIM_WRITE_US, EV_WRITE, -1, 0);
+                sim_flush(sim);
+                break;
+            case EV_HEARTBEAT:
+                on_heartbeat(sim, event.arg);
+                break;
+            case EV_TIMER:
+                on_timer(sim, event.node);
+                break;
+            case EV_ELECTED:
+                on_elected(sim, event.node, event.arg);
+                break;
+            case EV_FAULT:
+                on_fault(sim, event.arg);
+                break;
+            case EV_HEAL:
+                on_heal(sim, event.node, event.arg);
+                break;
+        }
+    }
+
+    // a stall still going counts up to the end
+    sim->now = sim->end;
+    if (sim->window >= 0) {
+        long stall = sim->now - sim->window;
+        sim->unavailable += stall;
+        if (stall > sim->longest) {
+            sim->longest = stall;
+        }
+    }
+    sim_report(sim, seed, ms);
+
+    // nodes still down replay what they missed, then every replica must be the leader's
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (sim->dfs->file_systems[i] != NULL && sim->dfs->nodes[i].status == LAGGING) {
+            dfs_node_catch_up(sim->dfs, i, 1);
+        }
+    }
+    dfs_close(sim->dfs, sim->handle);
+    if (sim->overflow) {
+        printf("event queue overflowed, the run is incomplete\n");
+    }
+    printf("replicas match leader: %s\n", sim_replicas_match(sim->dfs) ? "yes" : "no");
+
+    sim_teardown(sim);
+    free(sim);
+    return 0;
+}
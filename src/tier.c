@@ -0,0 +1,327 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "tier.h"
+#include "dfs.h"
+#include "block.h"
+#include "checksum.h"
+
+int tier_open(fs_node_t* fs, const char* path, int n_hot) {
+    if (path == NULL || n_hot < TIER_MIN_HOT || n_hot > N_BLOCKS) {
+        return -1;
+    }
+
+    // stdio rather than open(2): the efs API claims open and close for itself
+    FILE* file = fopen(path, "w+b");
+    if (file == NULL) {
+        return -1;
+    }
+    if (ftruncate(fileno(file), (off_t) N_BLOCKS * BLOCK_SIZE) < 0) {
+        fclose(file);
+        return -1;
+    }
+
+    tier_t* tier = calloc(1, sizeof(tier_t));
+    if (tier == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    tier->hot = calloc(n_hot, BLOCK_SIZE);
+    tier->owner = calloc(n_hot, sizeof(int));
+    tier->pins = calloc(n_hot, sizeof(int));
+    tier->dirty = calloc(n_hot, sizeof(int));
+    if (tier->hot == NULL || tier->owner == NULL || tier->pins == NULL || tier->dirty == NULL) {
+        free(tier->hot);
+        free(tier->owner);
+        free(tier->pins);
+        free(tier->dirty);
+        free(tier);
+        fclose(file);
+        return -1;
+    }
+
+    tier->file = file;
+    tier->n_hot = n_hot;
+    for (int b = 0; b < N_BLOCKS; b++) {
+        tier->frame[b] = -1;
+    }
+    for (int f = 0; f < n_hot; f++) {
+        tier->owner[f] = -1;
+    }
+
+    block_close(fs);
+    fs->tier = tier;
+    return 0;
+}
+
+void tier_close(fs_node_t* fs) {
+    tier_t* tier = fs->tier;
+    if (tier == NULL) {
+        return;
+    }
+
+    fclose(tier->file);
+    free(tier->hot);
+    free(tier->owner);
+    free(tier->pins);
+    free(tier->dirty);
+    free(tier);
+    fs->tier = NULL;
+}
+
+static int tier_demote(tier_t* tier, int f) {
+    int block = tier->owner[f];
+    if (tier->dirty[f]) {
+        if (pwrite(fileno(tier->file), tier->hot[f], BLOCK_SIZE, (off_t) block * BLOCK_SIZE) != BLOCK_SIZE) {
+            return -1;
+        }
+        tier->dirty[f] = 0;
+        tier->writebacks++;
+    }
+
+    tier->frame[block] = -1;
+    tier->owner[f] = -1;
+    tier->demotions++;
+    return 0;
+}
+
+// a free frame, otherwise the coldest one a promotion may take over
+static int tier_victim(tier_t* tier) {
+    int victim = -1;
+    for (int f = 0; f < tier->n_hot; f++) {
+        int block = tier->owner[f];
+        if (block == -1) {
+            return f;
+        }
+        if (block < TIER_RESIDENT || tier->pins[f] > 0) {
+            continue;
+        }
+        if (victim == -1 || tier->heat[block] < tier->heat[tier->owner[victim]]) {
+            victim = f;
+        }
+    }
+    return victim;
+}
+
+byte * tier_pin(fs_node_t* fs, int block) {
+    tier_t* tier = fs->tier;
+    int f = tier->frame[block];
+    if (f != -1) {
+        tier->pins[f]++;
+        return tier->hot[f];
+    }
+
+    f = tier_victim(tier);
+    if (f == -1) {
+        return NULL;  // everything is pinned
+    }
+    if (tier->owner[f] != -1) {
+        if (tier_demote(tier, f) < 0) {
+            return NULL;
+        }
+        tier->forced++;
+    }
+
+    ssize_t got = pread(fileno(tier->file), tier->hot[f], BLOCK_SIZE, (off_t) block * BLOCK_SIZE);
+    if (got < 0) {
+        return NULL;
+    }
+    if (got < BLOCK_SIZE) {
+        memset(tier->hot[f] + got, 0, BLOCK_SIZE - got);
+    }
+    if (checksum_loaded(fs, block, tier->hot[f]) < 0) {
+        return NULL;
+    }
+
+    tier->frame[block] = f;
+    tier->owner[f] = block;
+    tier->pins[f] = 1;
+    tier->dirty[f] = 0;
+    tier->promotions++;
+    return tier->hot[f];
+}
+
+void tier_unpin(fs_node_t* fs, int block, int dirty) {
+    tier_t* tier = fs->tier;
+    int f = tier->frame[block];
+    if (f == -1) {
+        return;
+    }
+
+    if (tier->pins[f] > 0) {
+        tier->pins[f]--;
+    }
+    if (dirty) {
+        tier->dirty[f] = 1;
+    }
+}
+
+void tier_touch(fs_node_t* fs, int block) {
+    if (fs->tier != NULL && block >= 0 && block < N_BLOCKS && fs->tier->heat[block] < UINT_MAX) {
+        fs->tier->heat[block]++;
+    }
+}
+
+int tier_peek(fs_node_t* fs, int block, byte* out) {
+    tier_t* tier = fs->tier;
+    int f = tier->frame[block];
+    if (f != -1) {
+        memcpy(out, tier->hot[f], BLOCK_SIZE);
+        return 0;
+    }
+    if (pread(fileno(tier->file), out, BLOCK_SIZE, (off_t) block * BLOCK_SIZE) != BLOCK_SIZE) {
+        return -1;
+    }
+    return 0;
+}
+
+// replaces the block wherever it sits, a cold block stays cold
+int tier_store(fs_node_t* fs, int block, const byte* data) {
+    tier_t* tier = fs->tier;
+    int f = tier->frame[block];
+    if (f != -1) {
+        memcpy(tier->hot[f], data, BLOCK_SIZE);
+        tier->dirty[f] = 1;
+        return 0;
+    }
+    if (pwrite(fileno(tier->file), data, BLOCK_SIZE, (off_t) block * BLOCK_SIZE) != BLOCK_SIZE) {
+        return -1;
+    }
+    return 0;
+}
+
+// writes dirty frames through so demoting them later costs nothing
+int tier_sync(fs_node_t* fs) {
+    tier_t* tier = fs->tier;
+    int result = 0;
+    for (int f = 0; f < tier->n_hot; f++) {
+        int block = tier->owner[f];
+        if (block == -1 || !tier->dirty[f]) {
+            continue;
+        }
+        if (pwrite(fileno(tier->file), tier->hot[f], BLOCK_SIZE, (off_t) block * BLOCK_SIZE) != BLOCK_SIZE) {
+            result = -1;
+            continue;
+        }
+        tier->dirty[f] = 0;
+        tier->writebacks++;
+    }
+    return result;
+}
+
+int tier_migrate(fs_node_t* fs) {
+    tier_t* tier = fs->tier;
+    if (tier == NULL) {
+        return 0;
+    }
+
+    // a block whose heat decayed to nothing went a whole pass untouched
+    int demoted = 0;
+    for (int f = 0; f < tier->n_hot; f++) {
+        int block = tier->owner[f];
+        if (block < TIER_RESIDENT || tier->pins[f] > 0 || tier->heat[block] > 0) {
+            continue;
+        }
+        if (tier_demote(tier, f) == 0) {
+            demoted++;
+        }
+    }
+
+    for (int b = 0; b < N_BLOCKS; b++) {
+        tier->heat[b] /= 2;
+    }
+    return demoted;
+}
+
+void tier_stats(fs_node_t* fs) {
+    tier_t* tier = fs->tier;
+    int hot = 0;
+    for (int f = 0; f < tier->n_hot; f++) {
+        hot += tier->owner[f] != -1;
+    }
+
+    printf("tiers: %d of %d frames hot, %d blocks cold, %ld promotions %ld demotions (%ld forced) %ld writebacks\n",
+           hot, tier->n_hot, N_BLOCKS - hot, tier->promotions, tier->demotions, tier->forced, tier->writebacks);
+}
+
+///// MIGRATION /////
+
+int dfs_migrate_pass(dfs_t* dfs) {
+    int demoted = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dfs->file_systems[i] == NULL) continue;
+        demoted += tier_migrate(dfs->file_systems[i]);
+    }
+
+    dfs->migrator.passes++;
+    dfs->migrator.demoted += demoted;
+    return demoted;
+}
+
+// one pass per step, the lock is only held for that pass
+static void* migrate_main(void* arg) {
+    dfs_t* dfs = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&dfs->lock);
+        migrator_t* migrator = &dfs->migrator;
+        if (migrator->stop) {
+            pthread_mutex_unlock(&dfs->lock);
+            return NULL;
+        }
+
+        dfs_migrate_pass(dfs);
+
+        long pause_ns = migrator->interval_ms * 1000000L;
+        pthread_mutex_unlock(&dfs->lock);
+
+        struct timespec pause = { pause_ns / 1000000000L, pause_ns % 1000000000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+// caller holds dfs->lock
+int dfs_migrate_start(dfs_t* dfs, int interval_ms) {
+    if (interval_ms < 1) {
+        return -1;
+    }
+
+    if (dfs->migrator.stop) {
+        return -1;  // another caller is still waiting for it to exit
+    }
+
+    dfs->migrator.interval_ms = interval_ms;
+    if (dfs->migrator.running) {
+        return 0;  // still going, picks up the new interval
+    }
+
+    if (pthread_create(&dfs->migrator.thread, NULL, migrate_main, dfs) != 0) {
+        return -1;
+    }
+    dfs->migrator.running = 1;
+    return 0;
+}
+
+// caller holds dfs->lock, which is let go while the thread finishes its pass
+void dfs_migrate_stop(dfs_t* dfs) {
+    if (!dfs->migrator.running || dfs->migrator.stop) {
+        return;
+    }
+
+    dfs->migrator.stop = 1;
+    pthread_mutex_unlock(&dfs->lock);
+    pthread_join(dfs->migrator.thread, NULL);
+    pthread_mutex_lock(&dfs->lock);
+    dfs->migrator.running = 0;
+    dfs->migrator.stop = 0;
+}
+
+void dfs_migrate_stats(dfs_t* dfs) {
+    migrator_t* migrator = &dfs->migrator;
+    printf("migrator %s every %d ms: %ld passes, %ld blocks demoted\n",
+           migrator->running && !migrator->stop ? "running" : "stopped", migrator->interval_ms,
+           migrator->passes, migrator->demoted);
+}
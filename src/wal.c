@@ -1,38 +1,77 @@
 #include "wal.h"
+#include "efs.h"
+#include "compress.h"
+#include "pool.h"
+#include "block.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
 
 void wal_init(fs_node_t* fs) {
-    fs->wal_head = 0;
-    fs->wal_tail = 0;
-    fs->wal_count = 0;
+    wal_truncate(fs, INT_MAX);
+    fs->applied_sequence = -1;
     fs->operations_applied = 0;
     fs->operations_failed = 0;
     fs->log_replays = 0;
     fs->last_checkpoint = time(NULL);
+    fs->payloads_unpacked = 0;
+    fs->unpack_clock = 0;
+}
+
+// bytes of a logged payload; packed ones are unpacked into *scratch, which
+// the caller frees
+static const byte* wal_payload_bytes(fs_node_t* fs, payload_t* data, byte** scratch) {
+    *scratch = NULL;
+    if (data->codec == CODEC_NONE) {
+        return data->data;
+    }
+
+    clock_t start = clock();
+    *scratch = malloc(data->raw_len);
+    if (*scratch == NULL || payload_unpack(data, *scratch) < 0) {
+        free(*scratch);
+        *scratch = NULL;
+        return NULL;
+    }
+    fs->unpack_clock += clock() - start;
+    fs->payloads_unpacked++;
 
-    memset(fs->wal, 0, sizeof(wal_entry_t) * WAL_SIZE);
+    return *scratch;
 }
 
-static int wal_apply_entry(fs_node_t* fs, int node_id, wal_entry_t* entry) {
+// a create or destroy, noting whether block 0, the bitmap and format stamps,
+// came out of it as it went in
+static int wal_apply_name(fs_node_t* fs, wal_entry_t* entry) {
+    byte before[BLOCK_SIZE];
+    byte after[BLOCK_SIZE];
+    int known = block_read(fs, 0, before) == 0;
+
+    int result = entry->op_type == OP_CREATE ? create(fs, entry->key) : destroy(fs, entry->key);
+    entry->in_place = known && result == 0 && block_read(fs, 0, after) == 0 &&
+                      memcmp(before, after, BLOCK_SIZE) == 0;
+    return result;
+}
+
+int wal_apply_entry(fs_node_t* fs, int node_id, wal_entry_t* entry) {
     int result = 0;
+    byte* scratch = NULL;
+    const byte* bytes = NULL;
+    entry->in_place = 0;
     
     switch(entry->op_type) {
         case OP_CREATE:
-            result = create(fs, entry->params.create_params.name);
-            break;
-            
         case OP_DESTROY:
-            result = destroy(fs, entry->params.destroy_params.name);
+            result = wal_apply_name(fs, entry);
             break;
             
         case OP_WRITE:
-            // Restore the data to memory buffer first
-            memcpy(&fs->M[entry->params.write_params.m], 
-                   entry->params.write_params.data, 
-                   entry->params.write_params.n);
-            result = f_write(fs, 
-                           entry->params.write_params.oft_idx,
-                           entry->params.write_params.m,
-                           entry->params.write_params.n);
+            // apply straight from the shared payload, M is left alone
+            bytes = wal_payload_bytes(fs, entry->params.write_params.data, &scratch);
+            result = bytes == NULL ? -1 : f_write_buf(fs,
+                               entry->params.write_params.oft_idx,
+                               bytes,
+                               entry->params.write_params.n);
             break;
             
         case OP_SEEK:
@@ -40,12 +79,34 @@ static int wal_apply_entry(fs_node_t* fs, int node_id, wal_entry_t* entry) {
                          entry->params.seek_params.oft_idx,
                          entry->params.seek_params.position);
             break;
+
+        case OP_PWRITE:
+            bytes = wal_payload_bytes(fs, entry->params.pwrite_params.data, &scratch);
+            result = bytes == NULL ? -1 : f_pwrite(fs,
+                            entry->params.pwrite_params.oft_idx,
+                            bytes,
+                            entry->params.pwrite_params.data->raw_len,
+                            entry->params.pwrite_params.offset);
+            break;
+
+        case OP_DEFRAG:
+            result = defragment(fs, entry->key);
+            break;
+
+        case OP_FALLOCATE:
+            result = f_allocate(fs,
+                                entry->params.fallocate_params.oft_idx,
+                                entry->params.fallocate_params.size);
+            break;
             
         default:
             printf("ERROR: Unknown operation type %d\n", entry->op_type);
             return -1;
     }
     
+    free(scratch);
+    fs->applied_sequence = entry->sequence_number;
+
     if (result < 0) {
         fs->operations_failed++;
     } else {
@@ -55,84 +116,310 @@ static int wal_apply_entry(fs_node_t* fs, int node_id, wal_entry_t* entry) {
     return result;
 }
 
+static payload_t* wal_entry_payload(wal_entry_t* entry) {
+    switch (entry->op_type) {
+        case OP_WRITE:
+            return entry->params.write_params.data;
+        case OP_PWRITE:
+            return entry->params.pwrite_params.data;
+        default:
+            return NULL;
+    }
+}
+
 static int wal_add_entry(fs_node_t* fs, wal_entry_t* entry, int global_seq) {
     if (fs->wal_count >= WAL_SIZE) {
         return -1;
     }
+
+    wal_entry_t* logged = pool_alloc(fs->wal_slab);
+    if (logged == NULL) {
+        return -1;
+    }
     
     entry->sequence_number = global_seq;
     entry->time_stamp = time(NULL);
     
-    fs->wal[fs->wal_tail] = *entry;
-    fs->wal_tail = (fs->wal_tail + 1) % WAL_SIZE;
+    // every node's log shares the entry's payload rather than copying it
+    *logged = *entry;
+    logged->failed = 0;
+    logged->in_place = 0;
+    logged->next = NULL;
+    payload_ref(wal_entry_payload(entry));
+    if (fs->wal_tail != NULL) {
+        fs->wal_tail->next = logged;
+    } else {
+        fs->wal_head = logged;
+    }
+    fs->wal_tail = logged;
     fs->wal_count++;
     
     return 0;
 }
 
-wal_entry_t wal_log_create(dfs_t* dfs, char name[4]) {
+///// APPEND QUEUE /////
+
+#define SLOT(q, seq) (&(q)->slots[(seq) & (WAL_QUEUE_SIZE - 1)])
+#define STAMP(slot) __atomic_load_n(&(slot)->stamp, __ATOMIC_ACQUIRE)
+#define SET_STAMP(slot, v) __atomic_store_n(&(slot)->stamp, (v), __ATOMIC_RELEASE)
+
+void wal_queue_reset(wal_queue_t* q, int seq) {
+    memset(q, 0, sizeof(wal_queue_t));
+    for (int k = 0; k < WAL_QUEUE_SIZE; k++) {
+        SLOT(q, seq + k)->stamp = seq + k;
+    }
+    q->next = seq;
+}
+
+// gives entry the next sequence number and publishes it to the queue without
+// taking a lock. A producer only waits when the slot a lap back is still
+// uncollected, which takes more than WAL_QUEUE_SIZE entries in flight
+static void wal_log_entry(dfs_t* dfs, wal_entry_t* entry) {
+    wal_queue_t* q = dfs->queue;
+    int seq = __atomic_fetch_add(&dfs->global_sequence_counter, 1, __ATOMIC_RELAXED);
+    wal_slot_t* slot = SLOT(q, seq);
+
+    if (STAMP(slot) != seq) {
+        __atomic_fetch_add(&q->waits, 1, __ATOMIC_RELAXED);
+        while (STAMP(slot) != seq) {
+            sched_yield();
+        }
+    }
+
+    entry->sequence_number = seq;
+    entry->time_stamp = time(NULL);
+    slot->entry = *entry;
+    payload_ref(wal_entry_payload(entry));
+    SET_STAMP(slot, seq + 1);
+}
+
+wal_entry_t* wal_queue_peek(wal_queue_t* q, int seq) {
+    wal_slot_t* slot = SLOT(q, seq);
+    return STAMP(slot) == seq + 1 ? &slot->entry : NULL;
+}
+
+void wal_queue_done(wal_queue_t* q, int seq, int result) {
+    wal_slot_t* slot = SLOT(q, seq);
+    payload_release(wal_entry_payload(&slot->entry));
+    slot->result = result;
+    SET_STAMP(slot, seq + 2);
+}
+
+int wal_queue_collect(wal_queue_t* q, int seq, int* result) {
+    wal_slot_t* slot = SLOT(q, seq);
+    if (STAMP(slot) != seq + 2) {
+        return -1;
+    }
+
+    *result = slot->result;
+    SET_STAMP(slot, seq + WAL_QUEUE_SIZE);
+    return 0;
+}
+
+// logs entry on every node that holds its file, each copy naming that node's
+// own open file slot; write payloads are packed once here and the logs share
+// the packed copy
+int wal_log_nodes(dfs_t* dfs, wal_entry_t* entry) {
+    payload_t** data = NULL;
+    if (entry->op_type == OP_WRITE) {
+        data = &entry->params.write_params.data;
+    } else if (entry->op_type == OP_PWRITE) {
+        data = &entry->params.pwrite_params.data;
+    }
+    if (data != NULL) {
+        payload_t* packed = compressor_pack(&dfs->compressor, *data);
+        if (packed == NULL) {
+            return -1;
+        }
+        payload_release(*data);
+        *data = packed;
+    }
+
+    int nodes[MAX_NODES];
+    int count = dfs_entry_nodes(dfs, entry, nodes);
+    if (count == 0) {
+        return -1;
+    }
+
+    for (int k = 0; k < count; k++) {
+        wal_entry_t local;
+        if (dfs_entry_local(dfs, entry, nodes[k], &local) < 0 ||
+            wal_add_entry(dfs->file_systems[nodes[k]], &local, entry->sequence_number) < 0) {
+            // never applied anywhere, the copies already logged must not replay
+            for (int j = 0; j < k; j++) {
+                wal_mark_failed(dfs->file_systems[nodes[j]], entry->sequence_number);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// key of entries addressed by open file: the handle's file name. It places
+// the entry with sharding on and tells lease holders which file changed;
+// slots opened on each node directly leave it empty
+static int wal_key_for(dfs_t* dfs, int oft_idx, char key[FILE_NAME_MAX + 1]) {
+    memset(key, 0, FILE_NAME_MAX + 1);
+    int named = oft_idx >= 0 && oft_idx < DFS_MAX_OPEN && dfs->handles[oft_idx].in_use;
+    if (named) {
+        strcpy(key, dfs->handles[oft_idx].name);
+    }
+    return named || !dfs->ring.enabled ? 0 : -1;
+}
+
+// key of entries addressed by name, -1 for names no directory takes
+static int wal_key_name(const char* name, char key[FILE_NAME_MAX + 1]) {
+    memset(key, 0, FILE_NAME_MAX + 1);
+    if (name == NULL || name[0] == '\0' || strlen(name) > FILE_NAME_MAX ||
+        strchr(name, '/') != NULL) {
+        return -1;
+    }
+    strcpy(key, name);
+    return 0;
+}
+
+wal_entry_t wal_log_create(dfs_t* dfs, const char* name) {
     wal_entry_t entry;
     entry.op_type = OP_CREATE;
-    memcpy(entry.params.create_params.name, name, 4);
-    
-    int seq = dfs->global_sequence_counter++;
-    
-    for (int i = 0; i < NUM_NODES; i++) {
-        if (wal_add_entry(&dfs->file_systems[i], &entry, seq) < 0) {
-            return entry;
-        }
+    entry.sequence_number = -1;
+    if (wal_key_name(name, entry.key) < 0) {
+        return entry;
     }
+
+    wal_log_entry(dfs, &entry);
     return entry;
 }
 
-wal_entry_t wal_log_destroy(dfs_t* dfs, char name[4]) {
+wal_entry_t wal_log_destroy(dfs_t* dfs, const char* name) {
     wal_entry_t entry;
     entry.op_type = OP_DESTROY;
-    memcpy(entry.params.destroy_params.name, name, 4);
-
-    int seq = dfs->global_sequence_counter++;
-    for (int i = 0; i < NUM_NODES; i++) {
-        if (wal_add_entry(&dfs->file_systems[i], &entry, seq) < 0) {
-            return entry;
-        }
+    entry.sequence_number = -1;
+    if (wal_key_name(name, entry.key) < 0) {
+        return entry;
     }
+
+    wal_log_entry(dfs, &entry);
     return entry;
 }
 
-wal_entry_t wal_log_write(dfs_t* dfs, int oft_idx, int m, int n, byte data[512]) {
+wal_entry_t wal_log_write(dfs_t* dfs, int oft_idx, int m, int n, payload_t* data) {
     wal_entry_t entry;
     entry.op_type = OP_WRITE;
+    entry.sequence_number = -1;
+    if (data == NULL || n < 0 || n > data->raw_len || wal_key_for(dfs, oft_idx, entry.key) < 0) {
+        return entry;
+    }
+
+    // the queue holds its own reference, the caller keeps its raw payload
     entry.params.write_params.oft_idx = oft_idx;
     entry.params.write_params.m = m;
     entry.params.write_params.n = n;
-    memcpy(entry.params.write_params.data, data, sizeof(data));
+    entry.params.write_params.data = data;
 
-    int seq = dfs->global_sequence_counter++;
-    
-    for (int i = 0; i < NUM_NODES; i++) {
-        if (wal_add_entry(&dfs->file_systems[i], &entry, seq) < 0) {
-            return entry;
-        }
-    }
+    wal_log_entry(dfs, &entry);
     return entry;
 }
 
 wal_entry_t wal_log_seek(dfs_t* dfs, int oft_idx, int position) {
     wal_entry_t entry;
     entry.op_type = OP_SEEK;
+    entry.sequence_number = -1;
+    if (wal_key_for(dfs, oft_idx, entry.key) < 0) {
+        return entry;
+    }
+
     entry.params.seek_params.oft_idx = oft_idx;
     entry.params.seek_params.position = position;
 
-    int seq = dfs->global_sequence_counter++;
-    
-    for (int i = 0; i < NUM_NODES; i++) {
-        if (wal_add_entry(&dfs->file_systems[i], &entry, seq) < 0) {
-            return entry;
-        }
+    wal_log_entry(dfs, &entry);
+    return entry;
+}
+
+wal_entry_t wal_log_pwrite(dfs_t* dfs, int oft_idx, int offset, payload_t* data) {
+    wal_entry_t entry;
+    entry.op_type = OP_PWRITE;
+    entry.sequence_number = -1;
+    if (data == NULL || wal_key_for(dfs, oft_idx, entry.key) < 0) {
+        return entry;
     }
+
+    entry.params.pwrite_params.oft_idx = oft_idx;
+    entry.params.pwrite_params.offset = offset;
+    entry.params.pwrite_params.data = data;
+
+    wal_log_entry(dfs, &entry);
+    return entry;
+}
+
+wal_entry_t wal_log_defrag(dfs_t* dfs, const char* name) {
+    wal_entry_t entry;
+    entry.op_type = OP_DEFRAG;
+    entry.sequence_number = -1;
+    if (wal_key_name(name, entry.key) < 0) {
+        return entry;
+    }
+
+    wal_log_entry(dfs, &entry);
+    return entry;
+}
+
+wal_entry_t wal_log_fallocate(dfs_t* dfs, int oft_idx, int size) {
+    wal_entry_t entry;
+    entry.op_type = OP_FALLOCATE;
+    entry.sequence_number = -1;
+    if (size < 0 || wal_key_for(dfs, oft_idx, entry.key) < 0) {
+        return entry;
+    }
+
+    entry.params.fallocate_params.oft_idx = oft_idx;
+    entry.params.fallocate_params.size = size;
+
+    wal_log_entry(dfs, &entry);
     return entry;
 }
 
+// drop entries up to and including sequence_number, releasing their payloads
+void wal_truncate(fs_node_t* fs, int sequence_number) {
+    while (fs->wal_head != NULL && fs->wal_head->sequence_number <= sequence_number) {
+        wal_entry_t* done = fs->wal_head;
+        fs->wal_head = done->next;
+        fs->wal_count--;
+
+        payload_release(wal_entry_payload(done));
+        pool_free(fs->wal_slab, done);
+    }
+    if (fs->wal_head == NULL) {
+        fs->wal_tail = NULL;
+    }
+}
+
+static wal_entry_t* wal_find(fs_node_t* fs, int sequence_number) {
+    if (fs->wal_tail != NULL && fs->wal_tail->sequence_number == sequence_number) {
+        return fs->wal_tail;
+    }
+
+    // a follower's copy applied by a worker fails after later entries are logged
+    for (wal_entry_t* e = fs->wal_head; e != NULL; e = e->next) {
+        if (e->sequence_number == sequence_number) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+void wal_mark_failed(fs_node_t* fs, int sequence_number) {
+    wal_entry_t* e = wal_find(fs, sequence_number);
+    if (e != NULL) {
+        e->failed = 1;
+    }
+}
+
+void wal_mark_in_place(fs_node_t* fs, int sequence_number) {
+    wal_entry_t* e = wal_find(fs, sequence_number);
+    if (e != NULL) {
+        e->in_place = 1;
+    }
+}
 
 // void wal_print(dfs_t* dfs);
 
@@ -140,4 +427,576 @@ wal_entry_t wal_log_seek(dfs_t* dfs, int oft_idx, int position) {
 
 // void wal_stats(dfs_t* dfs);
 
-// int wal_replay(dfs_t* dfs);
\ No newline at end of file
+// int wal_replay(dfs_t* dfs);
+
+///// COMPACTION /////
+
+typedef struct {
+    wal_entry_t* e[WAL_SIZE];  // NULL once dropped
+    int grows[WAL_SIZE];       // the entry takes new blocks when applied
+    int n;
+} wal_segment_t;
+
+// node slot an entry addresses, -1 for creates and destroys
+static int wal_entry_slot(wal_entry_t* entry) {
+    switch (entry->op_type) {
+        case OP_WRITE:
+            return entry->params.write_params.oft_idx;
+        case OP_SEEK:
+            return entry->params.seek_params.oft_idx;
+        case OP_PWRITE:
+            return entry->params.pwrite_params.oft_idx;
+        case OP_FALLOCATE:
+            return entry->params.fallocate_params.oft_idx;
+        default:
+            return -1;
+    }
+}
+
+static void wal_segment_drop(fs_node_t* fs, wal_segment_t* seg, int k) {
+    payload_release(wal_entry_payload(seg->e[k]));
+    pool_free(fs->wal_slab, seg->e[k]);
+    seg->e[k] = NULL;
+    fs->wal_count--;
+}
+
+// blocks behind a file of size bytes; open gives even an empty one a block
+static int wal_blocks(int size) {
+    return size == 0 ? 1 : (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+// which entries grow their file into new blocks, following each slot's size
+// and position from where the replay will start. With dedup on any write may
+// copy a shared block, so every write counts
+static void wal_segment_growth(fs_node_t* fs, wal_segment_t* seg) {
+    int size[4];
+    int pos[4];
+    for (int i = 0; i < 4; i++) {
+        size[i] = fs->OFT[i].file_size;
+        pos[i] = fs->OFT[i].curr_pos;
+    }
+
+    for (int k = 0; k < seg->n; k++) {
+        wal_entry_t* entry = seg->e[k];
+        seg->grows[k] = 0;
+        if (entry == NULL || wal_entry_slot(entry) < 1 || wal_entry_slot(entry) >= 4) {
+            continue;
+        }
+        int slot = wal_entry_slot(entry);
+
+        int end;
+        if (entry->op_type == OP_SEEK) {
+            pos[slot] = entry->params.seek_params.position;
+            continue;
+        } else if (entry->op_type == OP_FALLOCATE) {
+            // reserved blocks only make later writes take fewer, which the
+            // sizes followed here already allow for
+            seg->grows[k] = 1;
+            continue;
+        } else if (entry->op_type == OP_WRITE) {
+            end = pos[slot] + entry->params.write_params.n;
+        } else {
+            end = entry->params.pwrite_params.offset + entry->params.pwrite_params.data->raw_len;
+        }
+        if (end > N_BLOCKS * BLOCK_SIZE) {
+            end = N_BLOCKS * BLOCK_SIZE;
+        }
+        if (entry->op_type == OP_WRITE) {
+            pos[slot] = end;
+        }
+
+        seg->grows[k] = fs->dedup != NULL || wal_blocks(end) > wal_blocks(size[slot]);
+        if (end > size[slot]) {
+            size[slot] = end;
+        }
+    }
+}
+
+// nearest live entry before b on b's slot, looking past entries of type skip
+static int wal_segment_prev(wal_segment_t* seg, int b, int skip) {
+    int slot = wal_entry_slot(seg->e[b]);
+    for (int k = b - 1; k >= 0; k--) {
+        if (seg->e[k] == NULL || wal_entry_slot(seg->e[k]) != slot) {
+            continue;
+        }
+        if ((int) seg->e[k]->op_type != skip) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// whether entry a can be applied at b's place instead: one that takes new
+// blocks must not pass another allocation, a create or destroy splitting or
+// freeing directory blocks or a defragmentation moving blocks, or the node
+// would lay its blocks out unlike the replicas that applied in order
+static int wal_segment_movable(wal_segment_t* seg, int a, int b) {
+    if (!seg->grows[a]) {
+        return 1;
+    }
+    for (int k = a + 1; k < b; k++) {
+        if (seg->e[k] != NULL && (seg->grows[k] || seg->e[k]->op_type == OP_CREATE ||
+                                  seg->e[k]->op_type == OP_DESTROY || seg->e[k]->op_type == OP_DEFRAG)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// raw bytes of a logged payload in a buffer the caller frees
+static byte* wal_payload_raw(payload_t* data) {
+    byte* raw = malloc(data->raw_len > 0 ? data->raw_len : 1);
+    if (raw == NULL) {
+        return NULL;
+    }
+    if (data->codec == CODEC_NONE) {
+        memcpy(raw, data->data, data->raw_len);
+    } else if (payload_unpack(data, raw) < 0) {
+        free(raw);
+        return NULL;
+    }
+    return raw;
+}
+
+// len bytes with n_a of a at a_at and then n_b of b at b_at over them, packed
+// as the log packs payloads
+static payload_t* wal_payload_overlay(dfs_t* dfs, int len, payload_t* a, int a_at, int n_a,
+                                      payload_t* b, int b_at, int n_b) {
+    payload_t* raw = payload_alloc(len);
+    byte* bytes_a = wal_payload_raw(a);
+    byte* bytes_b = wal_payload_raw(b);
+    payload_t* packed = NULL;
+
+    if (raw != NULL && bytes_a != NULL && bytes_b != NULL) {
+        memcpy(raw->data + a_at, bytes_a, n_a);
+        memcpy(raw->data + b_at, bytes_b, n_b);
+        packed = compressor_pack(&dfs->compressor, raw);
+    }
+
+    free(bytes_a);
+    free(bytes_b);
+    payload_release(raw);
+    return packed;
+}
+
+// folds write a into the write right after it on the same slot
+static int wal_merge_write(dfs_t* dfs, wal_entry_t* a, wal_entry_t* b) {
+    int n_a = a->params.write_params.n;
+    int n_b = b->params.write_params.n;
+    payload_t* data = wal_payload_overlay(dfs, n_a + n_b, a->params.write_params.data, 0, n_a,
+                                          b->params.write_params.data, n_a, n_b);
+    if (data == NULL) {
+        return -1;
+    }
+
+    payload_release(b->params.write_params.data);
+    b->params.write_params.data = data;
+    b->params.write_params.m = 0;
+    b->params.write_params.n = n_a + n_b;
+    return 0;
+}
+
+// folds pwrite a into a later one whose range overlaps or touches it, the
+// later bytes winning where they overlap
+static int wal_merge_pwrite(dfs_t* dfs, wal_entry_t* a, wal_entry_t* b) {
+    int off_a = a->params.pwrite_params.offset;
+    int off_b = b->params.pwrite_params.offset;
+    int end_a = off_a + a->params.pwrite_params.data->raw_len;
+    int end_b = off_b + b->params.pwrite_params.data->raw_len;
+    if (off_b > end_a || off_a > end_b) {
+        return -1;
+    }
+
+    int lo = off_a < off_b ? off_a : off_b;
+    int hi = end_a > end_b ? end_a : end_b;
+    payload_t* data = wal_payload_overlay(dfs, hi - lo, a->params.pwrite_params.data, off_a - lo, end_a - off_a,
+                                          b->params.pwrite_params.data, off_b - lo, end_b - off_b);
+    if (data == NULL) {
+        return -1;
+    }
+
+    payload_release(b->params.pwrite_params.data);
+    b->params.pwrite_params.data = data;
+    b->params.pwrite_params.offset = lo;
+    return 0;
+}
+
+// create of the file b destroys, if both were applied in place, no other
+// create comes between to take a descriptor the pair would have shifted and
+// nothing between names the file
+static int wal_segment_created(wal_segment_t* seg, int b) {
+    if (!seg->e[b]->in_place) {
+        return -1;
+    }
+    for (int k = b - 1; k >= 0; k--) {
+        wal_entry_t* entry = seg->e[k];
+        if (entry == NULL) {
+            continue;
+        }
+        if (entry->op_type == OP_CREATE) {
+            return entry->in_place && strcmp(entry->key, seg->e[b]->key) == 0 ? k : -1;
+        }
+        if (strcmp(entry->key, seg->e[b]->key) == 0) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+int wal_compact(dfs_t* dfs, fs_node_t* fs, int after) {
+    wal_segment_t seg;
+    wal_entry_t* before = NULL;
+    seg.n = 0;
+    for (wal_entry_t* entry = fs->wal_head; entry != NULL; entry = entry->next) {
+        if (entry->sequence_number <= after) {
+            before = entry;
+        } else {
+            seg.e[seg.n++] = entry;
+        }
+    }
+    int count = fs->wal_count;
+
+    for (int k = 0; k < seg.n; k++) {
+        if (seg.e[k]->failed) {
+            wal_segment_drop(fs, &seg, k);
+        }
+    }
+    wal_segment_growth(fs, &seg);
+
+    // each entry absorbs the one before it that it supersedes, so runs fold
+    // into their last entry one step at a time
+    for (int b = 0; b < seg.n; b++) {
+        wal_entry_t* entry = seg.e[b];
+        int a = -1;
+        if (entry == NULL) {
+            continue;
+        }
+
+        switch (entry->op_type) {
+            case OP_SEEK:
+                // positional writes leave the position alone
+                a = wal_segment_prev(&seg, b, OP_PWRITE);
+                if (a >= 0 && seg.e[a]->op_type != OP_SEEK) {
+                    a = -1;
+                }
+                break;
+
+            case OP_WRITE:
+                a = wal_segment_prev(&seg, b, -1);
+                if (a >= 0 && (seg.e[a]->op_type != OP_WRITE || !wal_segment_movable(&seg, a, b) ||
+                               wal_merge_write(dfs, seg.e[a], entry) < 0)) {
+                    a = -1;
+                }
+                break;
+
+            case OP_PWRITE:
+                a = wal_segment_prev(&seg, b, OP_SEEK);
+                if (a >= 0 && (seg.e[a]->op_type != OP_PWRITE || !wal_segment_movable(&seg, a, b) ||
+                               wal_merge_pwrite(dfs, seg.e[a], entry) < 0)) {
+                    a = -1;
+                }
+                break;
+
+            case OP_DESTROY:
+                a = wal_segment_created(&seg, b);
+                if (a >= 0) {
+                    wal_segment_drop(fs, &seg, b);
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        if (a >= 0) {
+            seg.grows[b] |= seg.grows[a];
+            wal_segment_drop(fs, &seg, a);
+        }
+    }
+
+    wal_entry_t* prev = before;
+    for (int k = 0; k < seg.n; k++) {
+        if (seg.e[k] == NULL) {
+            continue;
+        }
+        if (prev != NULL) {
+            prev->next = seg.e[k];
+        } else {
+            fs->wal_head = seg.e[k];
+        }
+        prev = seg.e[k];
+    }
+    if (prev != NULL) {
+        prev->next = NULL;
+    } else {
+        fs->wal_head = NULL;
+    }
+    fs->wal_tail = prev;
+
+    return count - fs->wal_count;
+}
+
+///// BENCHMARK /////
+
+#define BENCH_WRITE 64
+
+typedef struct {
+    dfs_t* dfs;
+    int handle;
+    int ops;
+    int offset;
+    int locked;     // every append under the one mutex instead of the queue
+    int* finished;  // producers whose writes have all come back
+} bench_producer_t;
+
+// queued writes are only published here, the one drainer applies them
+static int bench_publish(bench_producer_t* p, const byte* data) {
+    payload_t* payload = payload_alloc(BENCH_WRITE);
+    if (payload == NULL) {
+        return -1;
+    }
+    memcpy(payload->data, data, BENCH_WRITE);
+
+    wal_entry_t entry = wal_log_pwrite(p->dfs, p->handle, p->offset, payload);
+    payload_release(payload);
+    if (entry.sequence_number < 0) {
+        return -1;
+    }
+
+    int result;
+    while (wal_queue_collect(p->dfs->queue, entry.sequence_number, &result) < 0) {
+        sched_yield();
+    }
+    return result;
+}
+
+static void* bench_producer(void* arg) {
+    bench_producer_t* p = arg;
+    byte data[BENCH_WRITE];
+    memset(data, 'a' + p->offset / BENCH_WRITE % 26, BENCH_WRITE);
+
+    for (int k = 0; k < p->ops; k++) {
+        if (p->locked) {
+            pthread_mutex_lock(&p->dfs->lock);
+            dfs_pwrite(p->dfs, p->handle, data, BENCH_WRITE, p->offset);
+            pthread_mutex_unlock(&p->dfs->lock);
+        } else {
+            bench_publish(p, data);
+        }
+    }
+    __atomic_fetch_add(p->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// ops per second on a scratch cluster, one file, each producer its own range.
+// Queued producers publish side by side while this thread alone drains, so
+// per_drain is how many entries each pass of the lock holder found waiting
+static double bench_run(int threads, int ops, int locked, double* per_drain) {
+    *per_drain = 0;
+    dfs_t* dfs = calloc(1, sizeof(dfs_t));
+    if (dfs == NULL) {
+        return 0;
+    }
+    pthread_mutex_init(&dfs->lock, NULL);
+    dfs_init(dfs);
+    compressor_init(&dfs->compressor, CODEC_NONE);
+
+    char name[4] = "wb";
+    wal_entry_t entry = wal_log_create(dfs, name);
+    int handle = dfs_replicate_operation(dfs, &entry) == 0 ? dfs_open(dfs, name) : -1;
+
+    bench_producer_t producers[threads];
+    pthread_t ids[threads];
+    int finished = 0;
+    long drained = dfs->queue->drained;
+    long drains = dfs->queue->drains;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int started = 0;
+    for (int t = 0; handle >= 0 && t < threads; t++) {
+        producers[t] = (bench_producer_t) { dfs, handle, ops, t * BENCH_WRITE, locked, &finished };
+        if (pthread_create(&ids[started], NULL, bench_producer, &producers[t]) == 0) {
+            started++;
+        }
+    }
+    while (!locked && __atomic_load_n(&finished, __ATOMIC_ACQUIRE) < started) {
+        pthread_mutex_lock(&dfs->lock);
+        dfs_drain_published(dfs);
+        pthread_mutex_unlock(&dfs->lock);
+        sched_yield();
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    drained = dfs->queue->drained - drained;
+    drains = dfs->queue->drains - drains;
+    if (drains > 0) {
+        *per_drain = (double) drained / drains;
+    }
+
+    dfs_close(dfs, handle);
+    dfs_destroy(dfs);
+    pthread_mutex_destroy(&dfs->lock);
+    free(dfs);
+    return sec > 0 ? (double) started * ops / sec : 0;
+}
+
+void wal_bench(int max_threads, int ops) {
+    printf("producers  mutex ops/s  queue ops/s  entries per drain\n");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double per_drain;
+        double locked = bench_run(threads, ops, 1, &per_drain);
+        double shared = bench_run(threads, ops, 0, &per_drain);
+        printf("%9d  %11.0f  %11.0f  %17.1f\n", threads, locked, shared, per_drain);
+    }
+}
+
+///// COMPACTION CHECK /////
+
+#define CHECK_FILES 3  // one per open file slot
+#define CHECK_TEMPS 4  // names created and destroyed along the way
+
+static payload_t* check_payload(int n, unsigned* seed) {
+    payload_t* data = payload_alloc(n);
+    for (int k = 0; data != NULL && k < n; k++) {
+        data->data[k] = 'a' + rand_r(seed) % 4;
+    }
+    return data;
+}
+
+static void check_log(dfs_t* dfs, wal_entry_t entry) {
+    if (entry.sequence_number >= 0) {
+        dfs_replicate_operation(dfs, &entry);
+    }
+}
+
+// one random logged operation; some are refused on purpose, seeks past the
+// end and creates or destroys that find the name in the other state. A run
+// creates a scratch file, writes to an open one and destroys the scratch
+// file again, a pair compaction can drop
+static void check_op(dfs_t* dfs, int* handles, unsigned* seed) {
+    int handle = handles[rand_r(seed) % CHECK_FILES];
+    int kind = rand_r(seed) % 12;
+    payload_t* data = NULL;
+    wal_entry_t entry;
+
+    if (kind == 11) {
+        char name[4] = { 'r', '0' + rand_r(seed) % CHECK_TEMPS };
+        check_log(dfs, wal_log_create(dfs, name));
+        data = check_payload(rand_r(seed) % 300 + 1, seed);
+        check_log(dfs, wal_log_pwrite(dfs, handle, rand_r(seed) % 1024, data));
+        payload_release(data);
+        check_log(dfs, wal_log_destroy(dfs, name));
+        return;
+    }
+
+    if (kind < 4) {
+        data = check_payload(rand_r(seed) % 300 + 1, seed);
+        entry = wal_log_pwrite(dfs, handle, rand_r(seed) % 1024, data);
+    } else if (kind < 6) {
+        int n = rand_r(seed) % 200 + 1;
+        data = check_payload(n, seed);
+        entry = wal_log_write(dfs, handle, 0, n, data);
+    } else if (kind < 8) {
+        entry = wal_log_seek(dfs, handle, rand_r(seed) % 1200);
+    } else if (kind < 10) {
+        char name[4] = { 't', '0' + rand_r(seed) % CHECK_TEMPS };
+        entry = kind == 8 ? wal_log_create(dfs, name) : wal_log_destroy(dfs, name);
+    } else {
+        char name[4] = { 'c', 'a' + rand_r(seed) % CHECK_FILES };
+        entry = wal_log_defrag(dfs, name);
+    }
+
+    check_log(dfs, entry);
+    payload_release(data);
+}
+
+// open slots, then every block once the slots are flushed by closing
+static int check_same_slots(fs_node_t* a, fs_node_t* b) {
+    for (int i = 1; i < 4; i++) {
+        if (a->OFT[i].curr_pos != b->OFT[i].curr_pos || a->OFT[i].file_size != b->OFT[i].file_size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int check_same_blocks(fs_node_t* a, fs_node_t* b) {
+    byte data_a[BLOCK_SIZE];
+    byte data_b[BLOCK_SIZE];
+    for (int k = 0; k < N_BLOCKS; k++) {
+        if (block_read(a, k, data_a) < 0 || block_read(b, k, data_b) < 0 ||
+            memcmp(data_a, data_b, BLOCK_SIZE) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int wal_compact_check(int ops) {
+    int result = -1;
+    dfs_t* dfs = calloc(1, sizeof(dfs_t));
+    if (dfs == NULL) {
+        return -1;
+    }
+    pthread_mutex_init(&dfs->lock, NULL);
+    dfs_init(dfs);
+    compressor_init(&dfs->compressor, CODEC_LZ);
+
+    // node 1 replays its log as it stands, node 2 compacted
+    fs_node_t* leader = dfs->file_systems[0];
+    fs_node_t* raw = dfs->file_systems[1];
+    fs_node_t* compacted = dfs->file_systems[2];
+    int handles[CHECK_FILES];
+    int ready = dfs->node_count >= 3;
+    for (int f = 0; ready && f < CHECK_FILES; f++) {
+        char name[4] = { 'c', 'a' + f };
+        wal_entry_t entry = wal_log_create(dfs, name);
+        handles[f] = dfs_replicate_operation(dfs, &entry) == 0 ? dfs_open(dfs, name) : -1;
+        ready = handles[f] >= 0;
+    }
+    if (!ready || dfs_node_pause(dfs, 1) < 0 || dfs_node_pause(dfs, 2) < 0) {
+        printf("error\n");
+        goto done;
+    }
+
+    // the lagging logs have to hold the whole span, a run logs three entries
+    int first = dfs->global_sequence_counter;
+    unsigned seed = 1;
+    for (int k = 0; k < ops && raw->wal_count <= WAL_SIZE - 3; k++) {
+        check_op(dfs, handles, &seed);
+    }
+    int logged = dfs->global_sequence_counter - first;
+
+    long before = dfs->replication_bytes;
+    int raw_entries = dfs_node_catch_up(dfs, 1, 0);
+    long raw_bytes = dfs->replication_bytes - before;
+
+    before = dfs->replication_bytes;
+    int compacted_entries = dfs_node_catch_up(dfs, 2, 1);
+    long compacted_bytes = dfs->replication_bytes - before;
+
+    int raw_same = raw_entries >= 0 && check_same_slots(leader, raw);
+    int compacted_same = compacted_entries >= 0 && check_same_slots(leader, compacted);
+    for (int f = 0; f < CHECK_FILES; f++) {
+        dfs_close(dfs, handles[f]);
+    }
+    raw_same = raw_same && check_same_blocks(leader, raw);
+    compacted_same = compacted_same && check_same_blocks(leader, compacted);
+
+    printf("%d entries logged while nodes 1 and 2 lagged\n", logged);
+    printf("replay     entries  bytes shipped  matches leader\n");
+    printf("full       %7d  %13ld  %s\n", raw_entries, raw_bytes, raw_same ? "yes" : "no");
+    printf("compacted  %7d  %13ld  %s\n", compacted_entries, compacted_bytes, compacted_same ? "yes" : "no");
+    result = raw_same && compacted_same ? 0 : -1;
+
+done:
+    dfs_destroy(dfs);
+    pthread_mutex_destroy(&dfs->lock);
+    free(dfs);
+    return result;
+}
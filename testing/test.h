@@ -0,0 +1,133 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dfs.h"
+#include "efs.h"
+#include "wal.h"
+#include "block.h"
+
+// regression drivers: each test_*.c links against the library objects, runs
+// its checks on scratch clusters and exits non-zero if any failed. Commands
+// print as they would in the shell, so a failure's log shows what led to it
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+static inline dfs_t* test_cluster(void) {
+    dfs_t* dfs = calloc(1, sizeof(dfs_t));
+    pthread_mutex_init(&dfs->lock, NULL);
+    dfs_init(dfs);
+    return dfs;
+}
+
+static inline void test_teardown(dfs_t* dfs) {
+    dfs_destroy(dfs);
+    pthread_mutex_destroy(&dfs->lock);
+    free(dfs);
+}
+
+// one shell line through the command driver
+static inline void test_cmd(dfs_t* dfs, const char* line) {
+    char buf[1024];
+    char* parameters[MAX_ARGC];
+    int argc = 1;
+
+    snprintf(buf, sizeof(buf), "%s", line);
+    char* command = strtok(buf, " ");
+    for (char* t = strtok(NULL, " "); t != NULL && argc <= MAX_ARGC; t = strtok(NULL, " ")) {
+        parameters[argc++ - 1] = t;
+    }
+
+    printf("> %s\n", line);
+    dfs_process_command(dfs, command, parameters, argc);
+    fflush(stdout);
+}
+
+static inline int test_create(dfs_t* dfs, const char* name) {
+    wal_entry_t entry = wal_log_create(dfs, name);
+    return entry.sequence_number < 0 ? -1 : dfs_replicate_operation(dfs, &entry);
+}
+
+static inline int test_destroy(dfs_t* dfs, const char* name) {
+    wal_entry_t entry = wal_log_destroy(dfs, name);
+    return entry.sequence_number < 0 ? -1 : dfs_replicate_operation(dfs, &entry);
+}
+
+// creates name, opens it and writes size bytes of fill
+static inline int test_file(dfs_t* dfs, const char* name, int size, char fill) {
+    if (test_create(dfs, name) < 0) {
+        return -1;
+    }
+    int handle = dfs_open(dfs, name);
+    if (handle < 0) {
+        return -1;
+    }
+
+    char* buf = malloc(size > 0 ? size : 1);
+    memset(buf, fill, size);
+    int written = dfs_pwrite(dfs, handle, buf, size, 0);
+    free(buf);
+    dfs_close(dfs, handle);
+    return written == size ? 0 : -1;
+}
+
+// whether the named file reads back as size bytes of fill from its serving node
+static inline int test_file_is(dfs_t* dfs, const char* name, int size, char fill) {
+    int got;
+    byte* data = dfs_read_file(dfs, name, &got);
+    if (data == NULL) {
+        return 0;
+    }
+
+    int same = got == size;
+    for (int k = 0; same && k < got; k++) {
+        same = data[k] == (byte) fill;
+    }
+    free(data);
+    return same;
+}
+
+// blocks the current format put there that differ between any two full replicas
+static inline int test_replica_diffs(dfs_t* dfs) {
+    byte a[BLOCK_SIZE];
+    byte b[BLOCK_SIZE];
+    int diffs = 0;
+
+    fs_node_t* first = NULL;
+    for (int i = 0; i < MAX_NODES; i++) {
+        fs_node_t* fs = dfs->file_systems[i];
+        if (fs == NULL) continue;
+        if (first == NULL) {
+            first = fs;
+            continue;
+        }
+        for (int k = 0; k < N_BLOCKS; k++) {
+            if (!block_formatted(first, k)) continue;
+            block_read(first, k, a);
+            block_read(fs, k, b);
+            diffs += memcmp(a, b, BLOCK_SIZE) != 0;
+        }
+    }
+    return diffs;
+}
+
+static inline int test_done(void) {
+    if (test_failures == 0) {
+        printf("ok\n");
+    } else {
+        printf("%d checks failed\n", test_failures);
+    }
+    return test_failures != 0;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include <poll.h>
+#include "test.h"
+#include "aio.h"
+
+#define CHUNK 700
+#define CHUNKS 4
+
+// waits for the next completion, checks it is tag's and returns its result
+static int reap(aio_t* aio, uint64_t tag) {
+    aio_cqe_t cqe;
+    if (aio_wait_cqe(aio, &cqe) < 0) {
+        return -2;
+    }
+    aio_cqe_seen(aio);
+    CHECK(cqe.user_data == tag);
+    return cqe.result;
+}
+
+// submission and completion rings: batches of entries go in with
+// one submit, complete in order with their tags, and the event fd wakes a
+// poller when they do
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    aio_t aio;
+    CHECK(aio_setup(&aio, dfs, 6) == 0);
+
+    // six rounds up to eight, and a full ring hands out no more
+    int free_entries = 0;
+    while (aio_get_sqe(&aio) != NULL) {
+        free_entries++;
+    }
+    CHECK(free_entries == 8);
+    aio_teardown(&aio);
+
+    CHECK(aio_setup(&aio, dfs, 8) == 0);
+    aio_prep_create(aio_get_sqe(&aio), "async", 1);
+    aio_prep_open(aio_get_sqe(&aio), "async", 2);
+    aio_prep_create(aio_get_sqe(&aio), "async", 3);
+    CHECK(aio_submit(&aio) == 3);
+    CHECK(reap(&aio, 1) == 0);
+    int handle = reap(&aio, 2);
+    CHECK(handle >= 0);
+    CHECK(reap(&aio, 3) == -1);
+
+    char out[CHUNKS][CHUNK];
+    for (int c = 0; c < CHUNKS; c++) {
+        memset(out[c], 'a' + c, CHUNK);
+        aio_prep_write(aio_get_sqe(&aio), handle, out[c], CHUNK, c * CHUNK, 10 + c);
+    }
+    CHECK(aio_submit(&aio) == CHUNKS);
+
+    // the poller sleeps on the event fd until the batch is in
+    struct pollfd pfd = { aio_event_fd(&aio), POLLIN, 0 };
+    CHECK(poll(&pfd, 1, 5000) == 1 && (pfd.revents & POLLIN));
+    for (int c = 0; c < CHUNKS; c++) {
+        CHECK(reap(&aio, 10 + c) == CHUNK);
+    }
+
+    char in[CHUNKS][CHUNK];
+    for (int c = 0; c < CHUNKS; c++) {
+        aio_prep_read(aio_get_sqe(&aio), handle, in[c], CHUNK, c * CHUNK, 20 + c);
+    }
+    aio_prep_close(aio_get_sqe(&aio), handle, 30);
+    CHECK(aio_submit(&aio) == CHUNKS + 1);
+    for (int c = 0; c < CHUNKS; c++) {
+        CHECK(reap(&aio, 20 + c) == CHUNK);
+        CHECK(memcmp(in[c], out[c], CHUNK) == 0);
+    }
+    CHECK(reap(&aio, 30) == 0);
+
+    aio_cqe_t cqe;
+    CHECK(aio_peek_cqe(&aio, &cqe) == -1);
+    CHECK(aio.submitted == aio.completed && aio.completed == 3 + 2 * CHUNKS + 1);
+    aio_teardown(&aio);
+
+    CHECK(test_replica_diffs(dfs) == 0);
+    test_teardown(dfs);
+    return test_done();
+}
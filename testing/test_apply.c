@@ -0,0 +1,87 @@
+#include "test.h"
+#include "apply.h"
+
+#define FILES 12
+#define WRITES 40
+#define OPEN 3  // every node has room for them all open
+
+// the same entries on a sharded five-node cluster, applied by workers
+// threads or one by one when workers is 0
+static dfs_t* run(int workers) {
+    dfs_t* dfs = test_cluster();
+    compressor_init(&dfs->compressor, CODEC_NONE);
+    for (int n = NUM_NODES; n < 5; n++) {
+        if (dfs_node_add(dfs) < 0) {
+            test_failures++;
+        }
+    }
+    CHECK(dfs_shard_enable(dfs, 2, 8) == 0);
+    CHECK(dfs_apply_start(dfs, workers) == 0);
+
+    char name[8];
+    int handles[OPEN];
+    for (int f = 0; f < FILES; f++) {
+        sprintf(name, "p%02d", f);
+        CHECK(test_create(dfs, name) == 0);
+    }
+    // a refused create changes nothing on any node
+    CHECK(test_create(dfs, "p00") == -1);
+
+    for (int f = 0; f < OPEN; f++) {
+        sprintf(name, "p%02d", f);
+        handles[f] = dfs_open(dfs, name);
+        CHECK(handles[f] >= 0);
+    }
+    char data[300];
+    for (int k = 0; k < WRITES; k++) {
+        int f = k % OPEN;
+        memset(data, 'a' + k % 26, sizeof(data));
+        CHECK(dfs_pwrite(dfs, handles[f], data, sizeof(data), (k / OPEN) * 100) == (int) sizeof(data));
+    }
+    for (int f = 0; f < OPEN; f++) {
+        CHECK(dfs_close(dfs, handles[f]) == 0);
+    }
+    for (int f = FILES / 2; f < FILES; f += 2) {
+        sprintf(name, "p%02d", f);
+        CHECK(test_destroy(dfs, name) == 0);
+    }
+    return dfs;
+}
+
+// entries applied by a pool of workers, copies on different nodes
+// side by side, leave every node exactly as applying them one by one does
+int main(void) {
+    dfs_t* serial = run(0);
+    dfs_t* parallel = run(4);
+
+    CHECK(parallel->applier != NULL && parallel->applier->worker_copies > 0);
+    byte a[BLOCK_SIZE];
+    byte b[BLOCK_SIZE];
+    for (int node = 0; node < MAX_NODES; node++) {
+        fs_node_t* x = serial->file_systems[node];
+        fs_node_t* y = parallel->file_systems[node];
+        CHECK((x == NULL) == (y == NULL));
+        if (x == NULL || y == NULL) continue;
+
+        int diffs = 0;
+        for (int k = 0; k < N_BLOCKS; k++) {
+            if (!block_formatted(x, k)) continue;
+            block_read(x, k, a);
+            block_read(y, k, b);
+            diffs += memcmp(a, b, BLOCK_SIZE) != 0;
+        }
+        CHECK(diffs == 0);
+        CHECK(x->operations_applied == y->operations_applied);
+        CHECK(x->operations_failed == y->operations_failed);
+        CHECK(x->applied_sequence == y->applied_sequence);
+    }
+
+    // back to one by one, everything already in flight committed
+    dfs_apply_stop(parallel);
+    CHECK(parallel->applier == NULL);
+    CHECK(test_create(parallel, "after") == 0);
+
+    test_teardown(serial);
+    test_teardown(parallel);
+    return test_done();
+}
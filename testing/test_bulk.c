@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "test.h"
+
+#define FILES 4
+
+static const char* names[FILES] = { "empty", "small", "blocks", "nested" };
+static const int sizes[FILES] = { 0, 100, 1500, 5000 };
+
+static void fill(char* buf, int size, int f) {
+    for (int k = 0; k < size; k++) {
+        buf[k] = 'a' + (k * 7 + f) % 26;
+    }
+}
+
+// whether host file path holds file f's bytes
+static int host_file_is(const char* path, int f) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char want[5000];
+    char got[5001];
+    fill(want, sizes[f], f);
+    int n = (int) fread(got, 1, sizeof(got), file);
+    fclose(file);
+    return n == sizes[f] && memcmp(got, want, n) == 0;
+}
+
+// bulk import and export: a host tree streams into the cluster,
+// subdirectories included, and back out byte for byte on several threads
+int main(void) {
+    char src[] = "/tmp/efs-import-XXXXXX";
+    char dst[] = "/tmp/efs-export-XXXXXX";
+    CHECK(mkdtemp(src) != NULL && mkdtemp(dst) != NULL);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/sub", src);
+    CHECK(mkdir(path, 0755) == 0);
+
+    char buf[5000];
+    for (int f = 0; f < FILES; f++) {
+        snprintf(path, sizeof(path), f == FILES - 1 ? "%s/sub/%s" : "%s/%s", src, names[f]);
+        FILE* file = fopen(path, "wb");
+        CHECK(file != NULL);
+        if (file != NULL) {
+            fill(buf, sizes[f], f);
+            fwrite(buf, 1, sizes[f], file);
+            fclose(file);
+        }
+    }
+
+    dfs_t* dfs = test_cluster();
+    CHECK(dfs_import(dfs, src, 0) == -1);
+    CHECK(dfs_import(dfs, src, 3) == FILES);
+
+    for (int f = 0; f < FILES; f++) {
+        int got;
+        byte* data = dfs_read_file(dfs, names[f], &got);
+        CHECK(data != NULL);
+        if (data != NULL) {
+            fill(buf, sizes[f], f);
+            CHECK(got == sizes[f] && memcmp(data, buf, got) == 0);
+            free(data);
+        }
+    }
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    CHECK(dfs_export(dfs, dst, 2) == FILES);
+    for (int f = 0; f < FILES; f++) {
+        snprintf(path, sizeof(path), "%s/%s", dst, names[f]);
+        CHECK(host_file_is(path, f));
+        remove(path);
+    }
+    test_teardown(dfs);
+
+    for (int f = 0; f < FILES; f++) {
+        snprintf(path, sizeof(path), f == FILES - 1 ? "%s/sub/%s" : "%s/%s", src, names[f]);
+        remove(path);
+    }
+    snprintf(path, sizeof(path), "%s/sub", src);
+    remove(path);
+    remove(src);
+    remove(dst);
+    return test_done();
+}
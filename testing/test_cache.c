@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include "test.h"
+#include "checksum.h"
+#include "dir.h"
+#include "extent.h"
+
+// disk-backed volumes behind a bounded block cache: a cache too
+// small for the blocks open files pin is refused up front, one that is big
+// enough keeps every byte of several open files, and a block the cache cannot
+// hand out fails the operation so the log marks it failed
+int main(void) {
+    char dir[] = "/tmp/efs-cache-XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+
+    dfs_t* dfs = test_cluster();
+    for (int slots = 1; slots < CACHE_MIN_SLOTS; slots++) {
+        CHECK(dfs_attach_storage(dfs, dir, slots) == -1);
+    }
+    CHECK(dfs_attach_storage(dfs, dir, CACHE_MIN_SLOTS) == 0);
+
+    // three files open at once, each with a full window pinned
+    const char* names[3] = { "a", "b", "c" };
+    int handles[3];
+    char buf[6000];
+    for (int f = 0; f < 3; f++) {
+        CHECK(test_create(dfs, names[f]) == 0);
+        handles[f] = dfs_open(dfs, names[f]);
+        CHECK(handles[f] >= 0);
+    }
+    for (int f = 0; f < 3; f++) {
+        memset(buf, 'a' + f, sizeof(buf));
+        CHECK(dfs_pwrite(dfs, handles[f], buf, sizeof(buf), 0) == (int) sizeof(buf));
+    }
+    for (int f = 0; f < 3; f++) {
+        CHECK(dfs_close(dfs, handles[f]) == 0);
+        CHECK(test_file_is(dfs, names[f], sizeof(buf), 'a' + f));
+    }
+    CHECK(dfs->file_systems[0]->cache->evictions > 0);
+    CHECK(test_replica_diffs(dfs) == 0);
+    test_teardown(dfs);
+
+    // a block the first node cannot pin fails the write on every node: its
+    // copy on disk is corrupted and checked when the cache loads it again
+    dfs = test_cluster();
+    CHECK(dfs_attach_storage(dfs, dir, CACHE_MIN_SLOTS) == 0);
+    CHECK(dfs_enable_checksums(dfs) == 0);
+    CHECK(test_file(dfs, "sum", 3000, 's') == 0);
+
+    fs_node_t* fs = dfs->file_systems[0];
+    int fd = dir_lookup(fs, "sum");
+    block_read(fs, FD_BLOCK(fd), fs->I);
+    int block = extent_lookup(fs, fd, 2);
+    byte other[BLOCK_SIZE];
+    for (int b = N_BLOCKS - 1; b >= N_BLOCKS - 2 * CACHE_MIN_SLOTS; b--) {
+        block_read(fs, b, other);
+    }
+    CHECK(fs->cache->map[block] == -1);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/node0.vol", dir);
+    FILE* vol = fopen(path, "r+b");
+    CHECK(vol != NULL);
+    if (vol != NULL) {
+        fseek(vol, (long) block * BLOCK_SIZE + 7, SEEK_SET);
+        fputc('!', vol);
+        fclose(vol);
+    }
+
+    int handle = dfs_open(dfs, "sum");
+    CHECK(handle >= 0);
+    int before = fs->operations_failed;
+    CHECK(dfs_pwrite(dfs, handle, "xyz", 3, 2 * BLOCK_SIZE) == -1);
+    CHECK(fs->operations_failed == before + 1);
+    char got[3];
+    CHECK(dfs_pread(dfs, 1, handle, got, 3, 2 * BLOCK_SIZE) == 3 && memcmp(got, "sss", 3) == 0);
+    CHECK(dfs_pread(dfs, 0, handle, got, 3, 2 * BLOCK_SIZE) == -1);
+    dfs_close(dfs, handle);
+
+    test_teardown(dfs);
+
+    for (int i = 0; i < NUM_NODES; i++) {
+        snprintf(path, sizeof(path), "%s/node%d.vol", dir, i);
+        remove(path);
+    }
+    remove(dir);
+    return test_done();
+}
@@ -0,0 +1,50 @@
+#include "test.h"
+
+// commands go through the dispatcher with argc counting the command itself,
+// from the shell driver and from a command file alike: wm joins every word
+// after the position and no more, wr copies the leader's buffer to each
+// node's file and rm reads a node's buffer back
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    fs_node_t* leader = dfs->file_systems[dfs->leader];
+
+    test_cmd(dfs, "wm 0 0 hello there world");
+    CHECK(memcmp(leader->M, "hello there world", 17) == 0 && leader->M[17] == '\0');
+    test_cmd(dfs, "wm 0 6 over");
+    CHECK(memcmp(leader->M, "hello overe world", 17) == 0);
+
+    // no text, or a position that is not a number, writes nothing
+    test_cmd(dfs, "wm 0 20");
+    test_cmd(dfs, "wm 0 5x X");
+    test_cmd(dfs, "wm 0 -1 X");
+    CHECK(memcmp(leader->M, "hello overe world", 17) == 0 && leader->M[20] == '\0');
+
+    CHECK(test_create(dfs, "log") == 0);
+    int handle = dfs_open(dfs, "log");
+    CHECK(handle >= 0);
+    char line[64];
+    snprintf(line, sizeof(line), "wr %d 0 11", handle);
+    test_cmd(dfs, line);
+    for (int node = 0; node < NUM_NODES; node++) {
+        char got[11];
+        CHECK(dfs_pread(dfs, node, handle, got, 11, 0) == 11 && memcmp(got, "hello overe", 11) == 0);
+    }
+    test_cmd(dfs, "rm 0 0 11");
+    test_cmd(dfs, "rm 0 0");
+    CHECK(dfs_close(dfs, handle) == 0);
+
+    // the same commands from a file
+    char path[] = "/tmp/efs-commands-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    FILE* fp = fdopen(fd, "w");
+    fprintf(fp, "wm 1 0 from a file\nwm 1 40\nrm 1 0 11\n");
+    fclose(fp);
+    CHECK(dfs_read_operation(dfs, path) == 0);
+    remove(path);
+    CHECK(memcmp(dfs->file_systems[1]->M, "from a file", 11) == 0 && dfs->file_systems[1]->M[11] == '\0');
+
+    CHECK(test_replica_diffs(dfs) == 0);
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,57 @@
+#include "test.h"
+
+// pauses node 2, logs a scratch file's create, a write to name and the
+// scratch file's destroy, and returns the entries a compacted catch-up replays
+static int lagged_run(dfs_t* dfs, int handle, const char* scratch) {
+    if (dfs_node_pause(dfs, 2) < 0) {
+        return -1;
+    }
+
+    char data[100];
+    memset(data, 'w', sizeof(data));
+    if (test_create(dfs, scratch) < 0 || dfs_pwrite(dfs, handle, data, sizeof(data), 0) != (int) sizeof(data) ||
+        test_destroy(dfs, scratch) < 0) {
+        return -1;
+    }
+    return dfs_node_catch_up(dfs, 2, 1);
+}
+
+// compacting the span a lagging node replays: merged writes and a
+// create/destroy pair that took and freed no block both go, and the replica
+// comes out like the leader. A create that laid out a descriptor block, or
+// split a directory node, keeps its pair
+int main(void) {
+    for (int workers = 0; workers <= 2; workers += 2) {
+        dfs_t* dfs = test_cluster();
+        CHECK(dfs_apply_start(dfs, workers) == 0);
+        CHECK(test_create(dfs, "keep") == 0);
+        int handle = dfs_open(dfs, "keep");
+        CHECK(handle >= 0);
+
+        // only the write is left to replay
+        CHECK(lagged_run(dfs, handle, "tmp") == 1);
+
+        // descriptors 1 to 31 share block 1, the 32nd file's create lays out block 2
+        char name[16];
+        for (int f = 2; f < 32; f++) {
+            snprintf(name, sizeof(name), "f%d", f);
+            CHECK(test_create(dfs, name) == 0);
+        }
+        CHECK(!block_formatted(dfs->file_systems[0], FD_BLOCK(32)));
+        CHECK(lagged_run(dfs, handle, "tmp") == 3);
+        CHECK(block_formatted(dfs->file_systems[2], FD_BLOCK(32)));
+
+        // block 2 is laid out now, the next pair takes nothing
+        CHECK(lagged_run(dfs, handle, "tmp") == 1);
+
+        dfs_close(dfs, handle);
+        CHECK(test_replica_diffs(dfs) == 0);
+        test_teardown(dfs);
+    }
+
+    // random spans with creates, writes and destroys between them
+    CHECK(wal_compact_check(60) == 0);
+    CHECK(wal_compact_check(400) == 0);
+
+    return test_done();
+}
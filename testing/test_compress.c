@@ -0,0 +1,84 @@
+#include "test.h"
+#include "compress.h"
+
+#define LEN 4000
+
+static payload_t* sample(int len, int random, unsigned* seed) {
+    payload_t* p = payload_alloc(len);
+    for (int k = 0; k < len; k++) {
+        p->data[k] = random ? (byte) rand_r(seed) : "abcdefgh"[(k / 3) % 8];
+    }
+    return p;
+}
+
+// whether p unpacks to raw's bytes
+static int unpacks_to(const payload_t* p, const payload_t* raw) {
+    byte out[LEN];
+    if (p->codec == CODEC_NONE) {
+        return p->len == raw->len && memcmp(p->data, raw->data, raw->len) == 0;
+    }
+    return payload_unpack(p, out) == raw->len && memcmp(out, raw->data, raw->len) == 0;
+}
+
+// write payloads are compressed once as they are logged and
+// unpacked on apply: repetitive data packs and round-trips, small or
+// incompressible payloads go raw, with a backoff after repeated misses
+int main(void) {
+    unsigned seed = 7;
+    compressor_t z;
+    compressor_init(&z, CODEC_LZ);
+
+    int lens[] = { 64, 65, 511, 512, 513, LEN };
+    for (int k = 0; k < (int) (sizeof(lens) / sizeof(lens[0])); k++) {
+        payload_t* raw = sample(lens[k], 0, &seed);
+        payload_t* packed = compressor_pack(&z, raw);
+        CHECK(packed != raw && packed->codec == CODEC_LZ);
+        CHECK(packed->len <= raw->len - raw->len / COMPRESS_MIN_GAIN);
+        CHECK(unpacks_to(packed, raw));
+        payload_release(packed);
+        payload_release(raw);
+    }
+
+    payload_t* small = sample(COMPRESS_MIN_LEN - 1, 0, &seed);
+    payload_t* same = compressor_pack(&z, small);
+    CHECK(same == small && small->refcount == 2);
+    payload_release(same);
+    payload_release(small);
+
+    // random bytes are rejected, then sent raw without a try for a stretch
+    // that doubles with each miss in a row: tried, skipped twice, tried,
+    // skipped four times
+    for (int k = 0; k < 8; k++) {
+        payload_t* raw = sample(LEN, 1, &seed);
+        payload_t* out = compressor_pack(&z, raw);
+        CHECK(out == raw);
+        payload_release(out);
+        payload_release(raw);
+    }
+    CHECK(z.rejected == 2 && z.skipped == 6);
+
+    // through the cluster: the logs hold the packed copy and every node
+    // applies the raw bytes
+    dfs_t* dfs = test_cluster();
+    compressor_init(&dfs->compressor, CODEC_LZ);
+    CHECK(test_create(dfs, "z") == 0);
+    int handle = dfs_open(dfs, "z");
+    CHECK(handle >= 0);
+
+    payload_t* raw = sample(LEN, 0, &seed);
+    CHECK(dfs_pwrite(dfs, handle, raw->data, LEN, 0) == LEN);
+    payload_t* logged = dfs->file_systems[0]->wal_tail->params.pwrite_params.data;
+    CHECK(logged->codec == CODEC_LZ && logged->raw_len == LEN && logged->len < LEN / 2);
+
+    byte got[LEN];
+    for (int node = 0; node < NUM_NODES; node++) {
+        CHECK(dfs->file_systems[node]->payloads_unpacked > 0);
+        CHECK(dfs_pread(dfs, node, handle, got, LEN, 0) == LEN && memcmp(got, raw->data, LEN) == 0);
+    }
+    payload_release(raw);
+
+    dfs_close(dfs, handle);
+    CHECK(test_replica_diffs(dfs) == 0);
+    test_teardown(dfs);
+    return test_done();
+}
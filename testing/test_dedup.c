@@ -0,0 +1,102 @@
+#include "test.h"
+#include "dedup.h"
+#include "dir.h"
+#include "extent.h"
+
+#define SIZE (3 * BLOCK_SIZE)
+
+static int used_blocks(fs_node_t* fs) {
+    int count = 0;
+    for (int b = 0; b < N_BLOCKS; b++) {
+        count += get_bit_map_info(fs, b) != 0;
+    }
+    return count;
+}
+
+static int file_block(fs_node_t* fs, const char* name, int blk) {
+    int fd = dir_lookup(fs, name);
+    if (fd < 0 || block_read(fs, FD_BLOCK(fd), fs->I) < 0) {
+        return -1;
+    }
+    return extent_lookup(fs, fd, blk);
+}
+
+// three blocks that differ from each other
+static int write_file(dfs_t* dfs, const char* name) {
+    char buf[SIZE];
+    for (int k = 0; k < SIZE; k++) {
+        buf[k] = 'a' + k / BLOCK_SIZE;
+    }
+    if (test_create(dfs, name) < 0) {
+        return -1;
+    }
+    int handle = dfs_open(dfs, name);
+    int written = dfs_pwrite(dfs, handle, buf, SIZE, 0);
+    dfs_close(dfs, handle);
+    return written == SIZE ? 0 : -1;
+}
+
+// full blocks with the same content are stored once and shared
+// across files, a follower that already holds a block is sent its
+// fingerprint, and a write to a shared block copies it first
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    compressor_init(&dfs->compressor, CODEC_NONE);
+    CHECK(dfs_enable_dedup(dfs) == 0);
+    CHECK(write_file(dfs, "a") == 0);
+
+    fs_node_t* fs = dfs->file_systems[0];
+    int used = used_blocks(fs);
+    long by_hash = dfs->replication_by_hash;
+    CHECK(write_file(dfs, "b") == 0);
+
+    // b's three blocks are a's, still in one run: one copy of the content,
+    // and every follower was sent fingerprints only
+    CHECK(used_blocks(fs) == used);
+    CHECK(fs->dedup->shared == 3);
+    CHECK(dfs->replication_by_hash - by_hash == 3 * (NUM_NODES - 1));
+    for (int node = 0; node < NUM_NODES; node++) {
+        fs_node_t* n = dfs->file_systems[node];
+        for (int blk = 0; blk < 3; blk++) {
+            int block = file_block(n, "a", blk);
+            CHECK(block >= 0 && block == file_block(n, "b", blk));
+            CHECK(dedup_refs(n, block) == 2);
+        }
+        CHECK(get_fd_info(n, dir_lookup(n, "b"), EXT_TREE) <= 0);
+    }
+
+    // writing into b copies its block and leaves a's content alone
+    int shared = file_block(fs, "b", 1);
+    int handle = dfs_open(dfs, "b");
+    CHECK(handle >= 0);
+    CHECK(dfs_pwrite(dfs, handle, "y", 1, BLOCK_SIZE + 5) == 1);
+    CHECK(dfs_close(dfs, handle) == 0);
+    CHECK(fs->dedup->cow_copies >= 1);
+    CHECK(file_block(fs, "b", 1) != shared && file_block(fs, "a", 1) == shared);
+    CHECK(dedup_refs(fs, shared) == 1);
+    int got;
+    byte* data = dfs_read_file(dfs, "a", &got);
+    CHECK(data != NULL && got == SIZE);
+    if (data != NULL) {
+        CHECK(data[BLOCK_SIZE + 5] == 'b');
+        free(data);
+    }
+
+    // destroying a frees only what b does not hold
+    CHECK(test_destroy(dfs, "a") == 0);
+    CHECK(get_bit_map_info(fs, shared) == 0);
+    for (int blk = 0; blk < 3; blk++) {
+        int block = file_block(fs, "b", blk);
+        CHECK(get_bit_map_info(fs, block) != 0 && dedup_refs(fs, block) == 1);
+    }
+    data = dfs_read_file(dfs, "b", &got);
+    CHECK(data != NULL && got == SIZE);
+    if (data != NULL) {
+        CHECK(data[BLOCK_SIZE + 5] == 'y' && data[BLOCK_SIZE + 4] == 'b' && data[SIZE - 1] == 'c');
+        free(data);
+    }
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,85 @@
+#include <time.h>
+#include "test.h"
+
+#define BLOCKS 6
+
+static void pause_ms(int ms) {
+    struct timespec pause = { 0, ms * 1000000L };
+    nanosleep(&pause, NULL);
+}
+
+// files whose blocks got interleaved are moved back into one run
+// each, on every node alike and without changing a byte, whether asked for,
+// with the file still open, or found by the background defragmenter
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    const char* names[3] = { "a", "b", "c" };
+    int handles[3];
+    for (int f = 0; f < 3; f++) {
+        CHECK(test_create(dfs, names[f]) == 0);
+        handles[f] = dfs_open(dfs, names[f]);
+    }
+
+    // one block of each file in turn leaves every file scattered, its runs
+    // in a tree that counts as one more
+    char block[BLOCK_SIZE];
+    for (int b = 0; b < BLOCKS; b++) {
+        for (int f = 0; f < 3; f++) {
+            memset(block, 'a' + f * BLOCKS + b, BLOCK_SIZE);
+            CHECK(dfs_pwrite(dfs, handles[f], block, BLOCK_SIZE, b * BLOCK_SIZE) == BLOCK_SIZE);
+        }
+    }
+    fs_node_t* fs = dfs->file_systems[0];
+    for (int f = 0; f < 3; f++) {
+        CHECK(file_runs(fs, names[f]) == BLOCKS + 1);
+    }
+    char name[FILE_NAME_MAX + 1];
+    CHECK(fragmented_file(fs, "", name) == 0 && strcmp(name, "a") == 0);
+
+    // c is still open while it moves and takes further writes after
+    CHECK(dfs_close(dfs, handles[0]) == 0 && dfs_close(dfs, handles[1]) == 0);
+    CHECK(dfs_defragment(dfs, "c") == 0);
+    memset(block, 'z', BLOCK_SIZE);
+    CHECK(dfs_pwrite(dfs, handles[2], block, BLOCK_SIZE, BLOCKS * BLOCK_SIZE) == BLOCK_SIZE);
+    CHECK(dfs_close(dfs, handles[2]) == 0);
+    for (int node = 0; node < NUM_NODES; node++) {
+        CHECK(file_runs(dfs->file_systems[node], "c") <= 2);
+        CHECK(dfs->file_systems[node]->blocks_defragmented > 0);
+    }
+
+    // the background pass finds the rest
+    pthread_mutex_lock(&dfs->lock);
+    CHECK(dfs_defrag_start(dfs, 1000) == 0);
+    pthread_mutex_unlock(&dfs->lock);
+    int done = 0;
+    for (int k = 0; k < 1000 && !done; k++) {
+        pause_ms(1);
+        pthread_mutex_lock(&dfs->lock);
+        done = file_runs(fs, "a") == 1 && file_runs(fs, "b") == 1;
+        pthread_mutex_unlock(&dfs->lock);
+    }
+    CHECK(done);
+    pthread_mutex_lock(&dfs->lock);
+    dfs_defrag_stop(dfs);
+    CHECK(!dfs->defrag.running);
+    pthread_mutex_unlock(&dfs->lock);
+    CHECK(dfs->defrag.files >= 2);
+
+    for (int f = 0; f < 3; f++) {
+        int got;
+        byte* data = dfs_read_file(dfs, names[f], &got);
+        CHECK(data != NULL && got == (f == 2 ? BLOCKS + 1 : BLOCKS) * BLOCK_SIZE);
+        for (int b = 0; data != NULL && b < BLOCKS; b++) {
+            CHECK(data[b * BLOCK_SIZE] == 'a' + f * BLOCKS + b && data[b * BLOCK_SIZE + BLOCK_SIZE - 1] == 'a' + f * BLOCKS + b);
+        }
+        free(data);
+    }
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    // torn down while the defragmenter is still walking the directories
+    pthread_mutex_lock(&dfs->lock);
+    CHECK(dfs_defrag_start(dfs, 100000) == 0);
+    pthread_mutex_unlock(&dfs->lock);
+    test_teardown(dfs);
+    return test_done();
+}
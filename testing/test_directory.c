@@ -0,0 +1,78 @@
+#include "test.h"
+#include "dir.h"
+
+#define FILES 150
+
+// the directory is a B+ tree keyed by name: enough long names to
+// split its nodes still look up and list in order, and slot 0, which once
+// staged the directory block, is refused by every per-slot call instead of
+// writing a stale buffer over the root
+int main(void) {
+    dfs_t* dfs = test_cluster();
+
+    char name[FILE_NAME_MAX + 1];
+    for (int k = 0; k < FILES; k++) {
+        snprintf(name, sizeof(name), "file-%03d-with-a-name-long-enough-to-fill-nodes", k);
+        CHECK(test_create(dfs, name) == 0);
+    }
+    CHECK(test_file(dfs, "data", 700, 'd') == 0);
+
+    snprintf(name, sizeof(name), "file-%03d-with-a-name-long-enough-to-fill-nodes", 77);
+    for (int node = 0; node < NUM_NODES; node++) {
+        CHECK(dir_lookup(dfs->file_systems[node], name) >= 0);
+        CHECK(dir_lookup(dfs->file_systems[node], "missing") == -1);
+    }
+
+    // slot 0 is never open: closing, seeking, reading or writing it fails and
+    // leaves the directory as it was
+    fs_node_t* fs = dfs->file_systems[0];
+    byte root[BLOCK_SIZE];
+    byte after[BLOCK_SIZE];
+    block_read(fs, DIR_ROOT, root);
+
+    test_cmd(dfs, "cl 0 0");
+    CHECK(close(fs, 0) == -1);
+    CHECK(seek(fs, 0, 0) == -1);
+    CHECK(f_read(fs, 0, 0, 10) == -1);
+    CHECK(f_pwrite(fs, 0, "x", 1, 0) == -1);
+    CHECK(f_pread(fs, 0, after, 1, 0) == -1);
+    CHECK(dfs_pwrite(dfs, 0, "x", 1, 0) == -1);
+
+    block_read(fs, DIR_ROOT, after);
+    CHECK(memcmp(root, after, BLOCK_SIZE) == 0);
+    CHECK(dir_lookup(fs, name) >= 0);
+    CHECK(test_file_is(dfs, "data", 700, 'd'));
+
+    // listings walk the leaves in name order
+    int listed = 0;
+    char prev[FILE_NAME_MAX + 1] = "";
+    char next[FILE_NAME_MAX + 1];
+    while (dfs_next_file(dfs, prev, next) >= 0) {
+        CHECK(strcmp(prev, next) < 0);
+        strcpy(prev, next);
+        listed++;
+    }
+    CHECK(listed == FILES + 1);
+
+    // removals empty leaves without losing their neighbours
+    for (int k = 0; k < FILES; k += 2) {
+        snprintf(name, sizeof(name), "file-%03d-with-a-name-long-enough-to-fill-nodes", k);
+        CHECK(test_destroy(dfs, name) == 0);
+    }
+    for (int k = 0; k < FILES; k++) {
+        snprintf(name, sizeof(name), "file-%03d-with-a-name-long-enough-to-fill-nodes", k);
+        CHECK((dir_lookup(fs, name) >= 0) == (k % 2 == 1));
+    }
+
+    // a node added now takes the leader's volume, and no directory slot with it
+    int added = dfs_node_add(dfs);
+    CHECK(added >= 0);
+    if (added >= 0) {
+        CHECK(dfs->file_systems[added]->OFT[0].curr_pos == -1);
+        CHECK(dir_lookup(dfs->file_systems[added], name) >= 0);
+    }
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    test_teardown(dfs);
+    return test_done();
+}
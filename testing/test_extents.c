@@ -0,0 +1,93 @@
+#include "test.h"
+#include "dir.h"
+#include "extent.h"
+
+#define RUNS EXT_NODE_ENTRIES
+
+// the volume is smaller than a full leaf's worth of runs, so the runs reuse
+// block numbers the way shared blocks do under dedup
+#define RUN_START(r) (10 + ((r) % 10) * 4)
+
+// blocks left free on the volume
+static int free_blocks(fs_node_t* fs) {
+    int count = 0;
+    for (int b = 8; b < N_BLOCKS; b++) {
+        count += get_bit_map_info(fs, b) == 0;
+    }
+    return count;
+}
+
+// every logical block of the file but skip maps where the runs put it
+static int runs_intact(fs_node_t* fs, int fd, int skip) {
+    int intact = 1;
+    for (int blk = 0; blk < 2 * RUNS; blk++) {
+        if (blk == skip) continue;
+        intact &= extent_lookup(fs, fd, blk) == RUN_START(blk / 2) + blk % 2;
+    }
+    return intact;
+}
+
+// files map runs of contiguous blocks, inline while they fit and in
+// a B+ tree past that. A split that cannot get its blocks on a full volume
+// leaves the overflowing node as it was
+int main(void) {
+    fs_node_t* fs = calloc(1, sizeof(fs_node_t));
+    CHECK(init(fs) == 0);
+    CHECK(create(fs, "runs") == 0);
+
+    int fd = dir_lookup(fs, "runs");
+    block_read(fs, FD_BLOCK(fd), fs->I);
+    block_read(fs, 0, fs->O);
+
+    // contiguous appends grow one run
+    for (int b = 20; b < 30; b++) {
+        CHECK(alloc_block(fs, b) == b);
+        CHECK(extent_append(fs, fd, b) == 0);
+    }
+    CHECK(extent_block_count(fs, fd) == 10);
+    CHECK(get_fd_info(fs, fd, EXT_TREE) <= 0);
+    CHECK(EXTENT_LEN(get_fd_info(fs, fd, EXT_INLINE)) == 10);
+    CHECK(extent_lookup(fs, fd, 9) == 29 && extent_lookup(fs, fd, 10) == -1);
+    extent_free_all(fs, fd);
+    CHECK(extent_block_count(fs, fd) == 0);
+    CHECK(get_bit_map_info(fs, 20) == 0);
+
+    // runs of two that never continue each other fill the root leaf exactly
+    for (int r = 0; r < RUNS; r++) {
+        for (int k = 0; k < 2; k++) {
+            CHECK(extent_append(fs, fd, RUN_START(r) + k) == 0);
+        }
+    }
+    CHECK(get_fd_info(fs, fd, EXT_TREE) > 0);
+    CHECK(extent_block_count(fs, fd) == 2 * RUNS);
+    CHECK(runs_intact(fs, fd, -1));
+
+    // remapping a run's second block cuts the run and inserts a piece into the
+    // full leaf. Without room for the split the run and the leaf stay as they
+    // were, even with room for the sibling but not the new root
+    while (alloc_block(fs, 8) != -1) {
+    }
+    int target = N_BLOCKS - 1;
+    int root = get_fd_info(fs, fd, EXT_TREE);
+    for (int spare = 0; spare < 2; spare++) {
+        if (spare > 0) free_block(fs, N_BLOCKS - 1 - spare);
+        CHECK(free_blocks(fs) == spare);
+        CHECK(extent_remap(fs, fd, 1, target) == -1);
+        CHECK(free_blocks(fs) == spare);
+        CHECK(get_fd_info(fs, fd, EXT_TREE) == root);
+        CHECK(runs_intact(fs, fd, -1));
+    }
+
+    // with room the split goes through and nothing moves but the block
+    free_block(fs, N_BLOCKS - 3);
+    free_block(fs, N_BLOCKS - 4);
+    CHECK(extent_remap(fs, fd, 1, target) == 0);
+    CHECK(get_fd_info(fs, fd, EXT_TREE) != root);
+    CHECK(extent_lookup(fs, fd, 1) == target);
+    CHECK(runs_intact(fs, fd, 1));
+    CHECK(extent_block_count(fs, fd) == 2 * RUNS);
+
+    block_close(fs);
+    free(fs);
+    return test_done();
+}
@@ -0,0 +1,78 @@
+#include "test.h"
+
+#define RESERVE (5 * BLOCK_SIZE)
+
+static int used_blocks(fs_node_t* fs) {
+    int count = 0;
+    for (int b = 8; b < N_BLOCKS; b++) {
+        count += get_bit_map_info(fs, b) != 0;
+    }
+    return count;
+}
+
+// blocks reserved ahead of the writes that fill them: one run
+// that other files growing meanwhile cannot break up, a size that only
+// writes move, and bytes a reserved block held before that never show
+int main(void) {
+    dfs_t* dfs = test_cluster();
+
+    // a destroyed file leaves its bytes in the blocks the reservation takes
+    CHECK(test_file(dfs, "junk", RESERVE, 'j') == 0);
+    CHECK(test_destroy(dfs, "junk") == 0);
+
+    // a new file holds its first block already
+    CHECK(test_create(dfs, "pre") == 0);
+    int pre = dfs_open(dfs, "pre");
+    CHECK(pre >= 0);
+
+    fs_node_t* fs = dfs->file_systems[0];
+    int used = used_blocks(fs);
+    CHECK(dfs_fallocate(dfs, pre, RESERVE) >= 0);
+    CHECK(used_blocks(fs) == used + 4);
+    CHECK(fs->OFT[pre].file_size == 0);
+    CHECK(dfs_fallocate(dfs, pre, RESERVE - 100) >= 0);
+    CHECK(used_blocks(fs) == used + 4);
+
+    CHECK(test_create(dfs, "other") == 0);
+    int other = dfs_open(dfs, "other");
+    CHECK(other >= 0);
+
+    // writes to both files in turn, pre stays one run
+    char block[BLOCK_SIZE];
+    memset(block, 'p', BLOCK_SIZE);
+    for (int b = 0; b < 4; b++) {
+        CHECK(dfs_pwrite(dfs, other, block, BLOCK_SIZE, b * BLOCK_SIZE) == BLOCK_SIZE);
+        if (b % 2 == 1) {
+            CHECK(dfs_pwrite(dfs, pre, block, 10, b * BLOCK_SIZE + 20) == 10);
+        }
+    }
+    CHECK(used_blocks(fs) == used + 4 + 4);
+
+    // up to what was written: zeros where nothing was, never the junk
+    CHECK(fs->OFT[pre].file_size == 3 * BLOCK_SIZE + 30);
+    char got[RESERVE];
+    int size = fs->OFT[pre].file_size;
+    for (int node = 0; node < NUM_NODES; node++) {
+        CHECK(dfs_pread(dfs, node, pre, got, RESERVE, 0) == size);
+        for (int k = 0; k < size; k++) {
+            int written = (k / BLOCK_SIZE) % 2 == 1 && k % BLOCK_SIZE >= 20 && k % BLOCK_SIZE < 30;
+            if (got[k] != (written ? 'p' : 0)) {
+                CHECK(got[k] == (written ? 'p' : 0));
+                break;
+            }
+        }
+    }
+    CHECK(dfs_close(dfs, pre) == 0 && dfs_close(dfs, other) == 0);
+    CHECK(file_runs(fs, "pre") == 1);
+
+    // more than the volume has left reserves nothing
+    pre = dfs_open(dfs, "pre");
+    used = used_blocks(fs);
+    CHECK(dfs_fallocate(dfs, pre, N_BLOCKS * BLOCK_SIZE) == -1);
+    CHECK(used_blocks(fs) == used);
+    CHECK(dfs_close(dfs, pre) == 0);
+
+    CHECK(test_replica_diffs(dfs) == 0);
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,68 @@
+#include "test.h"
+#include "dir.h"
+
+#define FILES 40  // past the first descriptor block, one data block each
+
+static int make_files(fs_node_t* fs, char fill) {
+    char name[8];
+    char data[300];
+    memset(data, fill, sizeof(data));
+    for (int f = 0; f < FILES; f++) {
+        sprintf(name, "f%02d", f);
+        if (create(fs, name) < 0) {
+            return -1;
+        }
+        int i = open(fs, name);
+        if (i < 1 || f_pwrite(fs, i, data, sizeof(data), 0) != (int) sizeof(data) || close(fs, i) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// a format rewrites block 0, the directory's descriptor block and
+// the directory root only. Every other descriptor block keeps what an older
+// format left until create first reaches it, and none of it is ever read
+int main(void) {
+    fs_node_t* fs = calloc(1, sizeof(fs_node_t));
+    CHECK(init(fs) == 0);
+    CHECK(make_files(fs, 'a') == 0);
+    CHECK(block_formatted(fs, FD_BLOCK(32)));
+
+    byte before[N_BLOCKS][BLOCK_SIZE];
+    memcpy(before, fs->D, sizeof(before));
+
+    // formatting again leaves the second descriptor block and the data as they were
+    CHECK(init(fs) == 0);
+    for (int b = 1; b < N_BLOCKS; b++) {
+        int rewritten = b == FD_BLOCK(0) || b == DIR_ROOT;
+        CHECK((memcmp(fs->D[b], before[b], BLOCK_SIZE) != 0) == rewritten);
+    }
+    CHECK(!block_formatted(fs, FD_BLOCK(32)));
+    CHECK(!block_formatted(fs, 8));
+    CHECK(dir_lookup(fs, "f00") == -1 && dir_lookup(fs, "f35") == -1);
+
+    // the old descriptors never show through: every file starts empty and
+    // gets a fresh descriptor
+    CHECK(make_files(fs, 'b') == 0);
+    CHECK(block_formatted(fs, FD_BLOCK(32)));
+    char name[8];
+    char got[800];
+    for (int f = 0; f < FILES; f++) {
+        sprintf(name, "f%02d", f);
+        int i = open(fs, name);
+        CHECK(i >= 1);
+        CHECK(f_pread(fs, i, got, sizeof(got), 0) == 300 && got[0] == 'b' && got[299] == 'b');
+        close(fs, i);
+    }
+
+    block_close(fs);
+    free(fs);
+
+    // a fresh cluster formats its nodes the same way
+    dfs_t* dfs = test_cluster();
+    CHECK(!block_formatted(dfs->file_systems[0], FD_BLOCK(32)));
+    CHECK(test_replica_diffs(dfs) == 0);
+    test_teardown(dfs);
+    return test_done();
+}
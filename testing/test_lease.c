@@ -0,0 +1,64 @@
+#include <time.h>
+#include "test.h"
+#include "client.h"
+
+// clients cache whole files under read leases: repeat reads are
+// served locally until a committed write or destroy of the file revokes the
+// lease on every client holding it, or the lease lapses on its own
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    CHECK(test_file(dfs, "doc", 1200, 'd') == 0);
+    CHECK(test_file(dfs, "other", 100, 'o') == 0);
+    CHECK(test_file(dfs, "short", 100, 's') == 0);
+    CHECK(test_file(dfs, "none", 100, 'n') == 0);
+
+    client_t a;
+    client_t b;
+    CHECK(client_setup(&a, dfs) == 0 && client_setup(&b, dfs) == 0);
+
+    char buf[16];
+    CHECK(client_read(&a, "doc", buf, 4, 1000) == 4 && memcmp(buf, "dddd", 4) == 0);
+    CHECK(client_read(&a, "doc", buf, 4, 0) == 4);
+    CHECK(client_read(&b, "doc", buf, 4, 0) == 4);
+    CHECK(client_read(&b, "other", buf, 4, 0) == 4);
+    CHECK(a.misses == 1 && a.hits == 1);
+
+    // a write to doc ends both leases on it and nothing else
+    int handle = dfs_open(dfs, "doc");
+    CHECK(dfs_pwrite(dfs, handle, "NEW", 3, 1000) == 3);
+    dfs_close(dfs, handle);
+    CHECK(a.revocations == 1 && b.revocations == 1);
+    CHECK(client_read(&a, "doc", buf, 4, 1000) == 4 && memcmp(buf, "NEWd", 4) == 0);
+    CHECK(a.misses == 2);
+    CHECK(client_read(&b, "other", buf, 4, 0) == 4 && b.hits == 1);
+
+    // a destroy does the same, and the file is gone for the client too
+    CHECK(test_destroy(dfs, "doc") == 0);
+    CHECK(a.revocations == 2);
+    CHECK(client_read(&a, "doc", buf, 4, 0) == -1);
+
+    // a lapsed lease is read through again without a callback
+    dfs->leases.ttl_ms = 20;
+    long misses = b.misses;
+    CHECK(client_read(&b, "short", buf, 4, 0) == 4);
+    CHECK(client_read(&b, "short", buf, 4, 0) == 4);
+    CHECK(b.misses == misses + 1);
+    long revoked = dfs->leases.revoked;
+    misses = b.misses;
+    struct timespec pause = { 0, 40 * 1000000L };
+    nanosleep(&pause, NULL);
+    CHECK(client_read(&b, "short", buf, 4, 0) == 4);
+    CHECK(b.misses == misses + 1 && dfs->leases.revoked == revoked);
+
+    // with no leases granted every read goes to the cluster
+    dfs->leases.ttl_ms = 0;
+    misses = b.misses;
+    CHECK(client_read(&b, "none", buf, 4, 0) == 4);
+    CHECK(client_read(&b, "none", buf, 4, 0) == 4);
+    CHECK(b.misses == misses + 2);
+
+    client_teardown(&a);
+    client_teardown(&b);
+    test_teardown(dfs);
+    return test_done();
+}
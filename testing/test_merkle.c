@@ -0,0 +1,66 @@
+#include "test.h"
+#include "merkle.h"
+#include "dir.h"
+#include "extent.h"
+
+#define LEVELS 7  // root to leaf in a tree over 64 blocks
+
+// replicas compare hash trees from the root down, only into the
+// subtrees where they disagree: a block one node lost is found by a walk
+// down one path and rewritten from the copy the other nodes agree on
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    CHECK(test_file(dfs, "m", 2000, 'm') == 0);
+
+    // replicas that agree compare their roots only
+    CHECK(dfs_anti_entropy(dfs) == 0);
+    long compared = dfs->anti_entropy.compared;
+    CHECK(dfs_anti_entropy(dfs) == 0);
+    CHECK(dfs->anti_entropy.compared - compared == 1);
+
+    // the file's data blocks, laid out alike on every replica; blocks no
+    // file holds read as unformatted whatever is in them
+    fs_node_t* fs = dfs->file_systems[0];
+    int fd = dir_lookup(fs, "m");
+    block_read(fs, FD_BLOCK(fd), fs->I);
+    int blocks[4];
+    for (int blk = 0; blk < 4; blk++) {
+        blocks[blk] = extent_lookup(fs, fd, blk);
+        CHECK(blocks[blk] > 0);
+    }
+
+    // one block written behind the log's back on node 1
+    byte data[BLOCK_SIZE];
+    byte before[BLOCK_SIZE];
+    int block = blocks[1];
+    block_read(dfs->file_systems[0], block, before);
+    memcpy(data, before, BLOCK_SIZE);
+    data[3] ^= 0x40;
+    CHECK(block_write(dfs->file_systems[1], block, data) == 0);
+
+    compared = dfs->anti_entropy.compared;
+    CHECK(dfs_anti_entropy(dfs) == 1);
+    CHECK(dfs->anti_entropy.compared - compared == 2 * LEVELS - 1);
+    CHECK(test_replica_diffs(dfs) == 0);
+    block_read(dfs->file_systems[1], block, data);
+    CHECK(memcmp(data, before, BLOCK_SIZE) == 0);
+
+    // two nodes off on different blocks are both repaired in the same pass
+    memset(data, 'x', BLOCK_SIZE);
+    CHECK(block_write(dfs->file_systems[0], blocks[2], data) == 0);
+    CHECK(block_write(dfs->file_systems[2], blocks[3], data) == 0);
+    CHECK(dfs_anti_entropy(dfs) == 2);
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    // every node different leaves no majority to repair from
+    for (int node = 0; node < NUM_NODES; node++) {
+        memset(data, 'a' + node, BLOCK_SIZE);
+        CHECK(block_write(dfs->file_systems[node], blocks[0], data) == 0);
+    }
+    long unresolved = dfs->anti_entropy.unresolved;
+    CHECK(dfs_anti_entropy(dfs) == 0);
+    CHECK(dfs->anti_entropy.unresolved == unresolved + 1);
+
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,61 @@
+#include "test.h"
+#include "dir.h"
+
+#define OBJECTS 100
+
+// nodes come and go at run time under ids below MAX_NODES, their
+// state drawn from a pool that hands memory back as objects are freed
+int main(void) {
+    // the pool keeps at most one empty chunk around
+    pool_t pool;
+    pool_init(&pool, "test", 24, 8);
+    void* objs[OBJECTS];
+    for (int k = 0; k < OBJECTS; k++) {
+        objs[k] = pool_alloc(&pool);
+        CHECK(objs[k] != NULL);
+        memset(objs[k], k, 24);
+    }
+    CHECK(pool.live == OBJECTS && pool.chunks == (OBJECTS + 7) / 8);
+    size_t full = pool_footprint(&pool);
+    for (int k = 0; k < OBJECTS; k++) {
+        pool_free(&pool, objs[k]);
+    }
+    CHECK(pool.live == 0 && pool.chunks == 1);
+    CHECK(pool_footprint(&pool) < full);
+    CHECK(pool_alloc(&pool) != NULL && pool.chunks == 1);
+    pool_destroy(&pool);
+
+    dfs_t* dfs = test_cluster();
+    CHECK(test_file(dfs, "kept", 900, 'k') == 0);
+
+    // registry slots fill up, a removed id is the next one handed out
+    while (dfs->node_count < MAX_NODES) {
+        CHECK(dfs_node_add(dfs) == dfs->node_count - 1);
+    }
+    CHECK(dfs_node_add(dfs) == -1);
+    CHECK(dfs->node_pool.live == MAX_NODES);
+    CHECK(dfs_node_remove(dfs, 5) == 0);
+    CHECK(dfs_node(dfs, 5) == NULL && dfs->node_count == MAX_NODES - 1);
+    CHECK(dfs_node_add(dfs) == 5);
+
+    // a write goes to every node, a new one included
+    CHECK(test_file(dfs, "late", 300, 'l') == 0);
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    // removing the leader hands leadership on; the last node stays
+    for (int id = MAX_NODES - 1; id > 0; id--) {
+        CHECK(dfs_node_remove(dfs, id) == 0);
+    }
+    CHECK(dfs_node_elect(dfs, 0) == 0);
+    CHECK(dfs_node_add(dfs) == 1);
+    CHECK(dfs_node_elect(dfs, 1) == 0);
+    CHECK(dfs_node_remove(dfs, 1) == 0);
+    CHECK(dfs->leader == 0);
+    CHECK(dfs_node_remove(dfs, 0) == -1);
+    CHECK(dfs->node_pool.live == 1 && dfs->node_pool.chunks <= 2);
+
+    CHECK(test_file_is(dfs, "kept", 900, 'k'));
+    CHECK(test_file_is(dfs, "late", 300, 'l'));
+    test_teardown(dfs);
+    return test_done();
+}
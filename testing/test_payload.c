@@ -0,0 +1,53 @@
+#include "test.h"
+
+#define SIZE 3000
+
+// a write's bytes are copied once into a payload and packed once,
+// and every node's log shares the packed copy: one entry per transfer, one
+// reference per log, and the references go when the logs are cut back
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    CHECK(test_create(dfs, "big") == 0);
+    int handle = dfs_open(dfs, "big");
+    CHECK(handle >= 0);
+
+    char buf[SIZE];
+    for (int k = 0; k < SIZE; k++) {
+        buf[k] = 'a' + k % 26;
+    }
+    CHECK(dfs_pwrite(dfs, handle, buf, SIZE, 0) == SIZE);
+
+    payload_t* shared = dfs->file_systems[0]->wal_tail->params.pwrite_params.data;
+    CHECK(shared != NULL && shared->raw_len == SIZE);
+    for (int node = 0; node < NUM_NODES; node++) {
+        wal_entry_t* entry = dfs->file_systems[node]->wal_tail;
+        CHECK(entry->op_type == OP_PWRITE);
+        CHECK(entry->params.pwrite_params.data == shared);
+    }
+    CHECK(shared != NULL && shared->refcount == NUM_NODES);
+
+    char got[SIZE];
+    for (int node = 0; node < NUM_NODES; node++) {
+        CHECK(dfs_pread(dfs, node, handle, got, SIZE, 0) == SIZE && memcmp(got, buf, SIZE) == 0);
+    }
+
+    // the sequence counter advanced once for the whole transfer
+    CHECK(dfs->global_sequence_counter == 2);
+
+    dfs_checkpoint(dfs);
+    for (int node = 0; node < NUM_NODES; node++) {
+        CHECK(dfs->file_systems[node]->wal_count == 0);
+    }
+
+    // a range outside the leader's buffer is refused before anything is copied
+    int seq = dfs->global_sequence_counter;
+    test_cmd(dfs, "wr 1 -5 20");
+    test_cmd(dfs, "wr 1 0 -5");
+    test_cmd(dfs, "wr 1 500 20");
+    CHECK(dfs->global_sequence_counter == seq);
+
+    dfs_close(dfs, handle);
+    CHECK(test_replica_diffs(dfs) == 0);
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,80 @@
+#include "test.h"
+
+#define WRITERS 4
+#define WRITES 300
+#define SPAN 64
+
+typedef struct {
+    dfs_t* dfs;
+    int handle;
+    int writer;
+    int failed;
+} writer_t;
+
+static void* writer_main(void* arg) {
+    writer_t* w = arg;
+    char data[SPAN];
+    memset(data, 'a' + w->writer, SPAN);
+    for (int k = 0; k < WRITES; k++) {
+        w->failed += dfs_pwrite_shared(w->dfs, w->handle, data, SPAN, w->writer * SPAN) != SPAN;
+    }
+    return NULL;
+}
+
+// appends publish to the log queue without a lock: writers on
+// their own threads all land on every replica, and one pass of the lock
+// holder takes every entry published before it ran
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    CHECK(test_create(dfs, "shared") == 0);
+    int handle = dfs_open(dfs, "shared");
+    CHECK(handle >= 0);
+
+    writer_t writers[WRITERS];
+    pthread_t ids[WRITERS];
+    for (int w = 0; w < WRITERS; w++) {
+        writers[w] = (writer_t) { dfs, handle, w, 0 };
+        CHECK(pthread_create(&ids[w], NULL, writer_main, &writers[w]) == 0);
+    }
+    for (int w = 0; w < WRITERS; w++) {
+        pthread_join(ids[w], NULL);
+        CHECK(writers[w].failed == 0);
+    }
+
+    char got[WRITERS * SPAN];
+    for (int node = 0; node < NUM_NODES; node++) {
+        CHECK(dfs_pread(dfs, node, handle, got, sizeof(got), 0) == (int) sizeof(got));
+        for (int k = 0; k < (int) sizeof(got); k++) {
+            if (got[k] != 'a' + k / SPAN) {
+                CHECK(got[k] == 'a' + k / SPAN);
+                break;
+            }
+        }
+    }
+    CHECK(dfs->queue->drained >= WRITERS * WRITES);
+
+    // entries published while nobody drains go in one batch, in order
+    long drains = dfs->queue->drains;
+    int first = dfs->global_sequence_counter;
+    for (int k = 0; k < 5; k++) {
+        payload_t* data = payload_alloc(1);
+        data->data[0] = '0' + k;
+        wal_entry_t entry = wal_log_pwrite(dfs, handle, k, data);
+        payload_release(data);
+        CHECK(entry.sequence_number >= 0);
+    }
+    CHECK(dfs_drain_published(dfs) == 5);
+    CHECK(dfs->queue->drains == drains + 1);
+    CHECK(dfs_drain_published(dfs) == 0);
+    CHECK(dfs->queue->drains == drains + 1);
+    for (int k = 0; k < 5; k++) {
+        int result = -1;
+        CHECK(wal_queue_collect(dfs->queue, first + k, &result) == 0 && result == 0);
+    }
+
+    CHECK(dfs_pread(dfs, 2, handle, got, 5, 0) == 5 && memcmp(got, "01234", 5) == 0);
+    dfs_close(dfs, handle);
+    CHECK(test_replica_diffs(dfs) == 0);
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,79 @@
+#include <time.h>
+#include "test.h"
+#include "checksum.h"
+#include "dir.h"
+#include "extent.h"
+
+// waits up to a second for the background scrubber to visit every block of
+// every node once more, then stops it
+static int scrub_round(dfs_t* dfs) {
+    pthread_mutex_lock(&dfs->lock);
+    long target = dfs->scrub.scanned + NUM_NODES * N_BLOCKS;
+    int started = dfs_scrub_start(dfs, 100000) == 0;
+    pthread_mutex_unlock(&dfs->lock);
+
+    struct timespec pause = { 0, 1000000 };
+    for (int k = 0; started && k < 1000; k++) {
+        pthread_mutex_lock(&dfs->lock);
+        int done = dfs->scrub.scanned >= target;
+        pthread_mutex_unlock(&dfs->lock);
+        if (done) break;
+        nanosleep(&pause, NULL);
+    }
+
+    pthread_mutex_lock(&dfs->lock);
+    dfs_scrub_stop(dfs);
+    int stopped = !dfs->scrub.running;
+    pthread_mutex_unlock(&dfs->lock);
+    return stopped && dfs->scrub.scanned >= target;
+}
+
+// every block carries a CRC32C: a scrub finds a block whose bytes
+// no longer match and rewrites it from a replica holding an intact copy,
+// whether run as a pass or by the background scrubber
+int main(void) {
+    CHECK(crc32c(0, "123456789", 9) == 0xe3069283);
+    CHECK(crc32c(crc32c(0, "1234", 4), "56789", 5) == 0xe3069283);
+
+    dfs_t* dfs = test_cluster();
+    CHECK(dfs_enable_checksums(dfs) == 0);
+    CHECK(test_file(dfs, "sum", 1500, 's') == 0);
+    CHECK(dfs_scrub_pass(dfs) == 0);
+
+    fs_node_t* fs = dfs->file_systems[1];
+    int fd = dir_lookup(fs, "sum");
+    block_read(fs, FD_BLOCK(fd), fs->I);
+    int block = extent_lookup(fs, fd, 1);
+    CHECK(block > 0);
+
+    // a flipped byte on one node is found and repaired from another
+    fs->D[block][100] ^= 0x20;
+    CHECK(dfs_scrub_block(dfs, 1, block) == 0);
+    CHECK(dfs->scrub.repaired == 1);
+    CHECK(dfs_scrub_block(dfs, 1, block) == 1);
+    int handle = dfs_open(dfs, "sum");
+    char c;
+    CHECK(dfs_pread(dfs, 1, handle, &c, 1, BLOCK_SIZE + 100) == 1 && c == 's');
+    CHECK(dfs_close(dfs, handle) == 0);
+
+    // the same, left to the background scrubber
+    fs = dfs->file_systems[2];
+    fs->D[block][7] ^= 0x01;
+    CHECK(scrub_round(dfs));
+    CHECK(dfs->scrub.corrupt == 2 && dfs->scrub.repaired == 2);
+    CHECK(fs->D[block][7] == 's');
+
+    // corrupt on every node there is no copy to trust
+    for (int node = 0; node < NUM_NODES; node++) {
+        dfs->file_systems[node]->D[block][9] ^= 0x01;
+    }
+    CHECK(dfs_scrub_pass(dfs) == NUM_NODES);
+    CHECK(dfs->scrub.unrepaired == NUM_NODES);
+
+    // torn down while the scrubber is still walking the nodes
+    pthread_mutex_lock(&dfs->lock);
+    CHECK(dfs_scrub_start(dfs, 100000) == 0);
+    pthread_mutex_unlock(&dfs->lock);
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,102 @@
+#include "test.h"
+#include "dir.h"
+
+#define FILES 24
+#define REPLICAS 2
+
+static void file_name(char* name, int f) {
+    sprintf(name, "s%02d", f);
+}
+
+// whether every file sits on exactly its ring replicas and reads back whole
+static int placed(dfs_t* dfs) {
+    int ok = 1;
+    char name[8];
+    for (int f = 0; f < FILES; f++) {
+        file_name(name, f);
+        int nodes[MAX_NODES];
+        int count = ring_replicas(&dfs->ring, name, nodes);
+        ok &= count == REPLICAS;
+
+        int holders = 0;
+        for (int i = 0; i < MAX_NODES; i++) {
+            if (dfs->file_systems[i] != NULL && dir_lookup(dfs->file_systems[i], name) >= 0) {
+                holders++;
+                int listed = 0;
+                for (int k = 0; k < count; k++) {
+                    listed |= nodes[k] == i;
+                }
+                ok &= listed;
+            }
+        }
+        ok &= holders == REPLICAS && test_file_is(dfs, name, 100 + f, 'a' + f % 26);
+    }
+    return ok;
+}
+
+// files are placed on a consistent-hash ring over every node:
+// each lands on its replication count of nodes, a node joining takes only
+// the files whose walk now reaches it, and one leaving hands its files on
+int main(void) {
+    dfs_t* dfs = test_cluster();
+    CHECK(dfs_node_add(dfs) >= 0);
+    CHECK(dfs->node_count == NUM_NODES + 1);
+
+    char name[8];
+    for (int f = 0; f < FILES; f++) {
+        file_name(name, f);
+        CHECK(test_file(dfs, name, 100 + f, 'a' + f % 26) == 0);
+    }
+    CHECK(dfs_shard_enable(dfs, NUM_NODES + 2, 16) == -1);
+    CHECK(dfs_shard_enable(dfs, REPLICAS, 16) == 0);
+    CHECK(placed(dfs));
+
+    // the files spread over every node and each leads some
+    int leads[MAX_NODES] = { 0 };
+    int before[FILES][REPLICAS];
+    for (int f = 0; f < FILES; f++) {
+        file_name(name, f);
+        ring_replicas(&dfs->ring, name, before[f]);
+        leads[before[f][0]]++;
+    }
+    for (int i = 0; i < dfs->node_count; i++) {
+        CHECK(leads[i] > 0);
+    }
+
+    // a node added now joins the ring; files it does not take stay put
+    int added = dfs_node_add(dfs);
+    CHECK(added >= 0);
+    CHECK(placed(dfs));
+    int moved = 0;
+    for (int f = 0; f < FILES; f++) {
+        int nodes[MAX_NODES];
+        file_name(name, f);
+        ring_replicas(&dfs->ring, name, nodes);
+        int kept = 1;
+        for (int k = 0; k < REPLICAS; k++) {
+            kept &= nodes[k] == added || nodes[k] == before[f][0] || nodes[k] == before[f][1];
+        }
+        CHECK(kept);
+        moved += nodes[0] == added || nodes[1] == added;
+    }
+    CHECK(moved > 0 && moved < FILES);
+
+    // leaving hands every file on before the node's state goes
+    CHECK(dfs_shard_leave(dfs, 1) == 0);
+    CHECK(placed(dfs));
+    for (int f = 0; f < FILES; f++) {
+        file_name(name, f);
+        CHECK(dir_lookup(dfs->file_systems[1], name) == -1);
+    }
+    CHECK(dfs->rebalance.move_failures == 0);
+
+    // the ring never shrinks below the replica count, a node that already
+    // left still being attached
+    CHECK(dfs_shard_leave(dfs, 0) == 0 && dfs_shard_leave(dfs, 2) == 0);
+    test_cmd(dfs, "sl 3");
+    CHECK(dfs->ring.member[3] && dfs->nodes[3].status == ACTIVE);
+    CHECK(placed(dfs));
+
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,48 @@
+#include "test.h"
+#include "sim.h"
+
+#define FAULTS 3
+
+static int parse_all(sim_fault_t* faults) {
+    const char* text[FAULTS] = { "crash:L@1000+2000", "pause:1@5000+500", "slow:2@7000+1000x4" };
+    for (int f = 0; f < FAULTS; f++) {
+        if (sim_parse_fault(text[f], &faults[f]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// a seeded fault simulation on a virtual clock: faults parse from
+// their short form, the same seed and faults measure the same times, and a
+// crashed leader is replaced after an election timeout and replays what it
+// missed once it is back
+int main(void) {
+    sim_fault_t fault;
+    CHECK(sim_parse_fault("part:0@10+20", &fault) == 0);
+    CHECK(fault.kind == SIM_PARTITION && fault.node == 0 && fault.start_ms == 10 && fault.length_ms == 20);
+    CHECK(sim_parse_fault("slow:L@0+5x3", &fault) == 0 && fault.node == -1 && fault.factor == 3);
+    CHECK(sim_parse_fault("slow:1@0+5", &fault) == -1);
+    CHECK(sim_parse_fault("crash:9@0+5", &fault) == -1);
+    CHECK(sim_parse_fault("crash:1@0+0", &fault) == -1);
+    CHECK(sim_parse_fault("melt:1@0+5", &fault) == -1);
+    CHECK(sim_parse_fault("crash:1@0+5z", &fault) == -1);
+
+    sim_fault_t first[FAULTS];
+    sim_fault_t second[FAULTS];
+    CHECK(parse_all(first) == 0 && parse_all(second) == 0);
+    CHECK(sim_run(42, 10000, 50, 300, first, FAULTS) == 0);
+    CHECK(sim_run(42, 10000, 50, 300, second, FAULTS) == 0);
+    CHECK(memcmp(first, second, sizeof(first)) == 0);
+
+    // the crashed leader is noticed and replaced within two election timeouts
+    CHECK(first[0].skipped == 0 && first[0].led == 1);
+    CHECK(first[0].detect_us > 0 && first[0].elect_us >= 0);
+    CHECK(first[0].detect_us + first[0].elect_us <= 2 * 300 * 1000L);
+    CHECK(first[0].catch_up_us >= 0 && first[0].replayed > 0);
+
+    // a paused follower replays the writes it missed
+    CHECK(first[1].skipped == 0 && first[1].replayed > 0);
+
+    return test_done();
+}
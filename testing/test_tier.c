@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include "test.h"
+#include "tier.h"
+
+// data blocks still in a frame on the node
+static int hot_data(fs_node_t* fs) {
+    int hot = 0;
+    for (int f = 0; f < fs->tier->n_hot; f++) {
+        hot += fs->tier->owner[f] >= TIER_RESIDENT;
+    }
+    return hot;
+}
+
+// a few memory frames over a cold file per node: open files work
+// with fewer frames than the volume has blocks, blocks nobody touches for a
+// pass are demoted, and reading them promotes them back intact
+int main(void) {
+    char dir[] = "/tmp/efs-tier-XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+
+    dfs_t* dfs = test_cluster();
+    CHECK(dfs_attach_tiers(dfs, dir, TIER_MIN_HOT - 1) == -1);
+    CHECK(dfs_attach_tiers(dfs, dir, TIER_MIN_HOT) == 0);
+
+    const char* names[3] = { "a", "b", "c" };
+    int handles[3];
+    char buf[6000];
+    for (int f = 0; f < 3; f++) {
+        CHECK(test_create(dfs, names[f]) == 0);
+        handles[f] = dfs_open(dfs, names[f]);
+        CHECK(handles[f] >= 0);
+    }
+    for (int f = 0; f < 3; f++) {
+        memset(buf, 'a' + f, sizeof(buf));
+        CHECK(dfs_pwrite(dfs, handles[f], buf, sizeof(buf), 0) == (int) sizeof(buf));
+    }
+    for (int f = 0; f < 3; f++) {
+        CHECK(dfs_close(dfs, handles[f]) == 0);
+    }
+
+    fs_node_t* fs = dfs->file_systems[0];
+    CHECK(fs->tier->forced > 0);
+    CHECK(hot_data(fs) > 0);
+
+    // heat halves each pass, so every data block goes within a few
+    for (int pass = 0; pass < 8; pass++) {
+        dfs_migrate_pass(dfs);
+    }
+    CHECK(hot_data(fs) == 0);
+    CHECK(dfs->migrator.demoted > 0);
+
+    long promotions = fs->tier->promotions;
+    for (int f = 0; f < 3; f++) {
+        CHECK(test_file_is(dfs, names[f], sizeof(buf), 'a' + f));
+    }
+    CHECK(fs->tier->promotions > promotions);
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    // stopping waits for the migrator, and teardown stops a running one
+    pthread_mutex_lock(&dfs->lock);
+    CHECK(dfs_migrate_start(dfs, 1) == 0);
+    dfs_migrate_stop(dfs);
+    CHECK(!dfs->migrator.running);
+    CHECK(dfs_migrate_start(dfs, 1) == 0);
+    pthread_mutex_unlock(&dfs->lock);
+    test_teardown(dfs);
+
+    char path[64];
+    for (int i = 0; i < NUM_NODES; i++) {
+        snprintf(path, sizeof(path), "%s/node%d.cold", dir, i);
+        remove(path);
+    }
+    remove(dir);
+    return test_done();
+}
@@ -0,0 +1,59 @@
+#include "test.h"
+
+// positional and vectored I/O: a vector is gathered into one
+// logged write that every replica applies whole, and reads scatter straight
+// into caller buffers on any node
+int main(void) {
+    dfs_t* dfs = test_cluster();
+
+    CHECK(test_create(dfs, "vec") == 0);
+    int handle = dfs_open(dfs, "vec");
+    CHECK(handle >= 0);
+
+    char a[300], b[700], c[50];
+    memset(a, 'a', sizeof(a));
+    memset(b, 'b', sizeof(b));
+    memset(c, 'c', sizeof(c));
+    struct iovec iov[3] = { { a, sizeof(a) }, { b, sizeof(b) }, { c, sizeof(c) } };
+
+    int before = dfs->global_sequence_counter;
+    CHECK(dfs_pwritev(dfs, handle, iov, 3, 100) == 1050);
+    CHECK(dfs->global_sequence_counter == before + 1);
+
+    // every node scatters the same bytes, the gap before offset 100 reads as zeroes
+    for (int node = 0; node < NUM_NODES; node++) {
+        char head[100], x[300], y[700], z[50];
+        struct iovec out[4] = { { head, 100 }, { x, 300 }, { y, 700 }, { z, 50 } };
+        CHECK(dfs_preadv(dfs, node, handle, out, 4, 0) == 1150);
+        int zero = 1;
+        for (int k = 0; k < 100; k++) zero &= head[k] == 0;
+        CHECK(zero);
+        CHECK(memcmp(x, a, 300) == 0 && memcmp(y, b, 700) == 0 && memcmp(z, c, 50) == 0);
+    }
+
+    // a bad element refuses the whole vector, no prefix reaches any replica
+    struct iovec bad[3] = { { c, sizeof(c) }, { NULL, 10 }, { c, sizeof(c) } };
+    before = dfs->global_sequence_counter;
+    CHECK(dfs_pwritev(dfs, handle, bad, 3, 0) == -1);
+    CHECK(dfs->global_sequence_counter == before);
+    char first;
+    CHECK(dfs_pread(dfs, 1, handle, &first, 1, 100) == 1 && first == 'a');
+
+    // an entry the first node refuses is a no-op everywhere
+    CHECK(dfs_pwritev(dfs, 3, iov, 3, 0) == -1);
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    // positional writes leave the file position alone and stay within the file
+    char p[10];
+    memset(p, 'p', sizeof(p));
+    CHECK(dfs_pwrite(dfs, handle, p, 10, 2000) == 10);
+    char tail[10];
+    CHECK(dfs_pread(dfs, 2, handle, tail, 10, 2000) == 10 && memcmp(tail, p, 10) == 0);
+    CHECK(dfs_pread(dfs, 2, handle, tail, 10, 2010) == 0);
+
+    dfs_close(dfs, handle);
+    CHECK(test_replica_diffs(dfs) == 0);
+
+    test_teardown(dfs);
+    return test_done();
+}
@@ -0,0 +1,54 @@
+#include "test.h"
+
+#define BLOCKS 8
+
+// each open file keeps a window of blocks: a sequential reader
+// finds the blocks ahead of it already loaded, a reader jumping about gets
+// no readahead, and dirty blocks reach the volume when they leave the window
+int main(void) {
+    fs_node_t* fs = calloc(1, sizeof(fs_node_t));
+    CHECK(init(fs) == 0);
+    CHECK(create(fs, "seq") == 0);
+    int i = open(fs, "seq");
+    CHECK(i >= 1);
+
+    char block[BLOCK_SIZE];
+    for (int b = 0; b < BLOCKS; b++) {
+        memset(block, 'a' + b, BLOCK_SIZE);
+        CHECK(f_pwrite(fs, i, block, BLOCK_SIZE, b * BLOCK_SIZE) == BLOCK_SIZE);
+    }
+    // more blocks than the window holds were written, the older ones went back dirty
+    CHECK(fs->window_writebacks >= BLOCKS - OFT_WINDOW);
+    CHECK(close(fs, i) == 0);
+    CHECK(fs->window_writebacks == BLOCKS);
+
+    // block by block in order: every block past the first was read ahead, once
+    i = open(fs, "seq");
+    CHECK(i >= 1);
+    int hits = fs->window_hits;
+    int misses = fs->window_misses;
+    int ahead = fs->readahead_blocks;
+    for (int b = 0; b < BLOCKS; b++) {
+        CHECK(f_pread(fs, i, block, BLOCK_SIZE, b * BLOCK_SIZE) == BLOCK_SIZE);
+        CHECK(block[0] == 'a' + b && block[BLOCK_SIZE - 1] == 'a' + b);
+    }
+    CHECK(fs->window_misses - misses == 1);
+    CHECK(fs->window_hits - hits == BLOCKS - 1);
+    CHECK(fs->readahead_blocks - ahead == BLOCKS - 1);
+    CHECK(close(fs, i) == 0);
+
+    // jumping back and forth never runs two blocks in order
+    i = open(fs, "seq");
+    CHECK(i >= 1);
+    ahead = fs->readahead_blocks;
+    int order[BLOCKS] = { 6, 1, 4, 0, 7, 2, 5, 3 };
+    for (int k = 0; k < BLOCKS; k++) {
+        CHECK(f_pread(fs, i, block, 1, order[k] * BLOCK_SIZE + 9) == 1 && block[0] == 'a' + order[k]);
+    }
+    CHECK(fs->readahead_blocks == ahead);
+    CHECK(close(fs, i) == 0);
+
+    block_close(fs);
+    free(fs);
+    return test_done();
+}